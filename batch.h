@@ -0,0 +1,118 @@
+/*
+batch.h
+Runs every program of a corpus against every cache configuration, one job
+per (program, configuration) pair on a work-stealing thread pool
+*/
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "log.h"
+#include "policy.h"
+#include "pool.h"
+#include "simulator.h"
+#include "sweep.h"
+
+/*
+    Reads a batch file: one program path per line, machine code or
+    .e20img. Blank lines and lines starting with # are skipped.
+
+    @param path The batch file
+
+    @param programs Receives the program paths, in file order
+
+    @return false, after printing an error, if the file can't be read or
+        lists no programs
+*/
+inline bool read_batch_programs(const char *path, std::vector<std::string> &programs) {
+    std::ifstream f(path);
+    if (!f.is_open()) {
+        fprintf(stderr, "Can't open file %s\n", path);
+        return false;
+    }
+    std::string line;
+    while (getline(f, line)) {
+        line.erase(0, line.find_first_not_of(" \t\r"));
+        line.erase(line.find_last_not_of(" \t\r") + 1);
+        if (line.empty() || line[0] == '#')
+            continue;
+        programs.push_back(line);
+    }
+    if (programs.empty()) {
+        fprintf(stderr, "No programs in batch file %s\n", path);
+        return false;
+    }
+    return true;
+}
+
+/*
+    Runs every program against every configuration and writes one table row
+    per pair, program-major, in the order both were given. Each job runs the
+    program from its initial memory with its own registers and cache; the
+    programs are only loaded once.
+
+    @param programs The program files
+
+    @param configs The cache configurations, all valid
+
+    @param policy The replacement policy of every cache
+
+    @param out Where the table is written
+
+    @param num_threads Number of worker threads, 0 to use one per hardware thread
+
+    @param corrected Whether to run the corrected memory model (see set_corrected in simulator.h)
+
+    @return false, after printing an error, if a program can't be loaded, in
+        which case nothing is run
+*/
+inline bool run_batch(const std::vector<std::string> &programs, const std::vector<std::string> &configs,
+    replacement_policy policy, FILE *out, unsigned num_threads = 0, bool corrected = false) {
+    work_stealing_pool pool(num_threads);
+
+    //Loads the programs in parallel too: a corpus of text programs takes a while to parse
+    std::vector<E20Machine> loaded(programs.size());
+    std::vector<std::string> errors(programs.size());
+    pool.run(programs.size(), [&](size_t p) {
+        loaded[p].set_corrected(corrected);
+        loaded[p].load(programs[p].c_str(), errors[p]);
+    });
+    for (size_t p = 0; p < programs.size(); p++) {
+        if (!errors[p].empty()) {
+            fprintf(stderr, "%s: %s\n", programs[p].c_str(), errors[p].c_str());
+            return false;
+        }
+    }
+
+    //Job j is program j / configs.size() on configuration j % configs.size(), so a thread's share of
+    //the jobs covers few programs. Each job runs a copy of the loaded machine and writes only its own
+    //slot of results.
+    std::vector<count_log> results(programs.size() * configs.size());
+    pool.run(results.size(), [&](size_t j) {
+        size_t p = j / configs.size(), c = j % configs.size();
+        E20Machine machine(loaded[p]);
+        CacheHierarchy My_cache;
+        My_cache.set_corrected(corrected);
+        My_cache.configure(configs[c], policy);
+        count_log counts(My_cache.num_levels());
+        My_cache.run(machine, counts);
+        results[j] = std::move(counts);
+    });
+
+    std::vector<std::string> labels;
+    for (const std::string &program : programs) {
+        for (const std::string &config : configs)
+            labels.push_back(program + "\t" + config);
+    }
+    write_count_table(out, "program\tconfig", labels, results);
+    return true;
+}
+
+#endif
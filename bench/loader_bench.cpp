@@ -0,0 +1,111 @@
+/*
+loader_bench.cpp
+Measures program startup: the original regex loader against the
+hand-written text loader and the .e20img binary image in loader.h, on a
+generated program that fills all of memory.
+
+Built by the loader_bench CMake target, or from the repository root with
+    g++ -O2 -I. bench/loader_bench.cpp -o loader_bench && ./loader_bench
+*/
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <regex>
+#include <string>
+
+#include "loader.h"
+
+using namespace std;
+
+//The original loader, minus the exit(1) on errors
+namespace legacy {
+bool load_machine_code(ifstream &f, uint16_t mem[]) {
+    regex machine_code_re("^ram\\[(\\d+)\\] = 16'b(\\d+);.*$");
+    size_t expectedaddr = 0;
+    string line;
+    while (getline(f, line)) {
+        smatch sm;
+        if (!regex_match(line, sm, machine_code_re))
+            return false;
+        size_t addr = stoi(sm[1], nullptr, 10);
+        uint16_t instr = stoi(sm[2], nullptr, 2);
+        if (addr != expectedaddr || addr >= MEM_SIZE)
+            return false;
+        expectedaddr ++;
+        mem[addr] = instr;
+    }
+    return true;
+}
+}
+
+//Writes a program of MEM_SIZE random words in the form the assembler produces
+static void make_program(const char *path) {
+    FILE *out = fopen(path, "w");
+    uint32_t x = 12345;
+    for (size_t i = 0; i < MEM_SIZE; i++) {
+        x = x * 1103515245u + 12345u;
+        uint16_t word = x >> 16;
+        char bits[17];
+        for (int b = 0; b < 16; b++)
+            bits[b] = (word >> (15 - b)) & 1 ? '1' : '0';
+        bits[16] = '\0';
+        fprintf(out, "ram[%zu] = 16'b%s;\t\t// %u\n", i, bits, word);
+    }
+    fclose(out);
+}
+
+//Runs load() reps times and returns the mean time per load in microseconds
+template <class Load>
+static double time_loads(int reps, Load load) {
+    auto t0 = chrono::steady_clock::now();
+    for (int i = 0; i < reps; i++)
+        load();
+    auto t1 = chrono::steady_clock::now();
+    return chrono::duration<double, micro>(t1 - t0).count() / reps;
+}
+
+int main() {
+    const char *text_path = "/tmp/loader_bench.bin";
+    const char *image_path = "/tmp/loader_bench.e20img";
+    const int reps = 200;
+    make_program(text_path);
+
+    static uint16_t expected[MEM_SIZE], mem[MEM_SIZE];
+    string error;
+    if (!load_machine_code(text_path, expected, error) || !write_image(image_path, expected)) {
+        fprintf(stderr, "Can't set up benchmark files: %s\n", error.c_str());
+        return 1;
+    }
+
+    bool same = true;
+    double regex_us = time_loads(reps, [&]() {
+        memset(mem, 0, sizeof(mem));
+        ifstream f(text_path);
+        legacy::load_machine_code(f, mem);
+        same = same && memcmp(mem, expected, sizeof(mem)) == 0;
+    });
+    double text_us = time_loads(reps, [&]() {
+        memset(mem, 0, sizeof(mem));
+        load_program(text_path, mem, error);
+        same = same && memcmp(mem, expected, sizeof(mem)) == 0;
+    });
+    double image_us = time_loads(reps, [&]() {
+        memset(mem, 0, sizeof(mem));
+        load_program(image_path, mem, error);
+        same = same && memcmp(mem, expected, sizeof(mem)) == 0;
+    });
+
+    printf("%zu-word program, mean of %d loads\n", MEM_SIZE, reps);
+    printf("%-12s %12s %8s\n", "loader", "us/load", "speedup");
+    printf("%-12s %12.1f %7.2fx\n", "regex", regex_us, 1.0);
+    printf("%-12s %12.1f %7.2fx\n", "text", text_us, regex_us / text_us);
+    printf("%-12s %12.1f %7.2fx\n", "image", image_us, regex_us / image_us);
+    if (!same)
+        printf("MISMATCH\n");
+    remove(text_path);
+    remove(image_path);
+    return same ? 0 : 1;
+}
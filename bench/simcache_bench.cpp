@@ -0,0 +1,151 @@
+/*
+simcache_bench.cpp
+End-to-end simulator throughput: runs each generated workload in
+workloads.h through the interpreter and a matrix of L1 and L1+L2 caches,
+and reports simulated instructions/sec, cache accesses/sec and peak RSS.
+Each workload is loaded into one E20Machine (simulator.h) and reset for
+every configuration. Every run happens in a forked child, so its peak RSS
+is its own, not the high-water mark of the runs before it.
+
+Built by the simcache_bench CMake target. Usage:
+    simcache_bench [--policy POLICY] [--jit] [--ifetch IFETCH] [OUTER]
+OUTER is the number of 65536-iteration passes per workload (default 16).
+--jit runs the workloads on the JIT in jit.h instead of the interpreter.
+--ifetch sends instruction fetches through every cache as well (see
+CacheHierarchy::set_ifetch); accesses/sec then counts them.
+*/
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "policy.h"
+#include "simulator.h"
+#include "workloads.h"
+
+using namespace std;
+
+//What one timed run reports back from its child process
+struct run_result
+{
+    uint64_t cycles = 0, accesses = 0, l1_hits = 0;
+    double seconds = 0;
+};
+
+/*
+    Calls run() in a child process and collects its result.
+
+    @param peak_kb Receives the child's peak resident set size, in KB
+
+    @return false if the child couldn't be started or didn't report back
+*/
+template <class Run>
+static bool run_in_child(Run run, run_result &result, long &peak_kb) {
+    int fds[2];
+    if (pipe(fds) != 0)
+        return false;
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        run_result r = run();
+        bool sent = write(fds[1], &r, sizeof(r)) == static_cast<ssize_t>(sizeof(r));
+        _exit(sent ? 0 : 1);
+    }
+    close(fds[1]);
+    bool ok = read(fds[0], &result, sizeof(result)) == static_cast<ssize_t>(sizeof(result));
+    close(fds[0]);
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        return false;
+    peak_kb = usage.ru_maxrss;
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    unsigned outer = 16;
+    replacement_policy policy = POLICY_LRU;
+    bool use_jit = false;
+    string ifetch;
+    for (int i = 1; i < argc; i++) {
+        string arg(argv[i]);
+        if (arg == "--policy" && i + 1 < argc && parse_policy(argv[i + 1], policy)) {
+            i++;
+        } else if (arg == "--jit") {
+            use_jit = true;
+        } else if (arg == "--ifetch" && i + 1 < argc && CacheHierarchy().set_ifetch(argv[i + 1])) {
+            ifetch = argv[++i];
+        } else if (atoi(argv[i]) > 0) {
+            outer = atoi(argv[i]);
+        } else {
+            fprintf(stderr, "usage %s [--policy POLICY] [--jit] [--ifetch IFETCH] [OUTER]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    //"none" runs the program with no cache at all
+    const char *configs[] = {
+        "none",
+        "64,1,4", "256,2,4", "1024,4,8", "4096,16,16",
+        "64,1,4,1024,4,8", "256,2,4,4096,8,16", "1024,4,8,8192,16,32",
+    };
+
+    vector<workload> workloads = make_workloads(outer);
+    printf("%-14s %-20s %12s %12s %12s %10s %10s\n", "workload", "config", "instrs", "instr/s", "access/s",
+        "L1 hit", "peak KB");
+    for (const workload &w : workloads) {
+        E20Machine machine;
+        machine.load(w.memory.data(), w.memory.size());
+        if (use_jit && !machine.enable_jit()) {
+            fprintf(stderr, "The JIT isn't supported on this host\n");
+            return 1;
+        }
+        for (const char *config : configs) {
+            machine.reset();
+            run_result r;
+            long peak_kb = 0;
+            bool ok = run_in_child([&]() {
+                run_result result;
+                auto t0 = chrono::steady_clock::now();
+                if (string(config) == "none") {
+                    result.cycles = machine.run();
+                } else {
+                    CacheHierarchy My_cache;
+                    My_cache.set_ifetch(ifetch);
+                    My_cache.configure(config, policy);
+                    count_log counts(My_cache.num_levels());
+                    result.cycles = My_cache.run(machine, counts);
+                    result.accesses = My_cache.stats(0).accesses();
+                    result.l1_hits = My_cache.stats(0).hits();
+                }
+                result.seconds = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+                return result;
+            }, r, peak_kb);
+            if (!ok) {
+                fprintf(stderr, "Run of %s on %s failed\n", w.name.c_str(), config);
+                return 1;
+            }
+
+            char hit_rate[16] = "-";
+            if (r.accesses > 0)
+                snprintf(hit_rate, sizeof(hit_rate), "%.4f", static_cast<double>(r.l1_hits) / r.accesses);
+            printf("%-14s %-20s %12llu %12.3g %12.3g %10s %10ld\n", w.name.c_str(), config,
+                static_cast<unsigned long long>(r.cycles), r.cycles / r.seconds, r.accesses / r.seconds, hit_rate,
+                peak_kb);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,244 @@
+/*
+workloads.h
+A small E20 assembler and the generated programs the benchmarks run
+*/
+
+#ifndef WORKLOADS_H
+#define WORKLOADS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "e20.h"
+
+//Builds an E20 program one instruction at a time. Branch targets and data words can name a
+//label before it is placed; finish() fills them in.
+class e20_assembler
+{
+public:
+    std::vector<uint16_t> words;
+
+    void label(const std::string &name) { labels.emplace_back(name, words.size()); }
+
+    //Instructions With Three Register Arguments
+    void add(unsigned dst, unsigned a, unsigned b) { three_reg(a, b, dst, 0b0000); }
+    void sub(unsigned dst, unsigned a, unsigned b) { three_reg(a, b, dst, 0b0001); }
+    void or_(unsigned dst, unsigned a, unsigned b) { three_reg(a, b, dst, 0b0010); }
+    void and_(unsigned dst, unsigned a, unsigned b) { three_reg(a, b, dst, 0b0011); }
+    void slt(unsigned dst, unsigned a, unsigned b) { three_reg(a, b, dst, 0b0100); }
+    void jr(unsigned a) { three_reg(a, 0, 0, 0b1000); }
+
+    //Instructions With Two Register Arguments; imm must fit in 7 signed bits
+    void addi(unsigned dst, unsigned src, int imm) { two_reg(0b001, src, dst, imm); }
+    void slti(unsigned dst, unsigned src, int imm) { two_reg(0b111, src, dst, imm); }
+    void lw(unsigned dst, unsigned addr, int imm) { two_reg(0b100, addr, dst, imm); }
+    void sw(unsigned src, unsigned addr, int imm) { two_reg(0b101, addr, src, imm); }
+    void jeq(unsigned a, unsigned b, const std::string &target) {
+        fixups.push_back({words.size(), target, FIX_JEQ});
+        two_reg(0b110, a, b, 0);
+    }
+
+    //Instructions With No Register Arguments
+    void j(const std::string &target) {
+        fixups.push_back({words.size(), target, FIX_J});
+        words.push_back(0b010 << 13);
+    }
+    void jal(const std::string &target) {
+        fixups.push_back({words.size(), target, FIX_J});
+        words.push_back(0b011 << 13);
+    }
+    void halt() { words.push_back(static_cast<uint16_t>((0b010 << 13) | words.size())); }
+
+    //Data words: a constant, or the address of a label
+    void word(uint16_t value) { words.push_back(value); }
+    void address_of(const std::string &target) {
+        fixups.push_back({words.size(), target, FIX_WORD});
+        words.push_back(0);
+    }
+
+    //Returns the encoding addi would emit, for programs that write instructions at run time
+    static uint16_t encode_addi(unsigned dst, unsigned src, int imm) {
+        return static_cast<uint16_t>((0b001 << 13) | (src << 10) | (dst << 7) | (imm & 0x7f));
+    }
+
+    //Resolves every label reference and returns MEM_SIZE words of memory
+    std::vector<uint16_t> finish() {
+        for (const fixup &f : fixups) {
+            size_t target = find(f.target);
+            if (f.kind == FIX_JEQ)
+                words[f.at] |= static_cast<uint16_t>((target - f.at - 1) & 0x7f);
+            else if (f.kind == FIX_J)
+                words[f.at] |= static_cast<uint16_t>(target & 0x1fff);
+            else
+                words[f.at] = static_cast<uint16_t>(target);
+        }
+        std::vector<uint16_t> memory(words);
+        memory.resize(MEM_SIZE, 0);
+        return memory;
+    }
+
+private:
+    enum fixup_kind { FIX_JEQ, FIX_J, FIX_WORD };
+    struct fixup
+    {
+        size_t at;
+        std::string target;
+        fixup_kind kind;
+    };
+    std::vector<std::pair<std::string, size_t>> labels;
+    std::vector<fixup> fixups;
+
+    size_t find(const std::string &name) const {
+        for (const auto &l : labels) {
+            if (l.first == name)
+                return l.second;
+        }
+        return 0;
+    }
+
+    void three_reg(unsigned a, unsigned b, unsigned dst, unsigned func) {
+        words.push_back(static_cast<uint16_t>((a << 10) | (b << 7) | (dst << 4) | func));
+    }
+
+    void two_reg(unsigned opcode, unsigned a, unsigned b, int imm) {
+        words.push_back(static_cast<uint16_t>((opcode << 13) | (a << 10) | (b << 7) | (imm & 0x7f)));
+    }
+};
+
+//Every workload has the same frame: ram[0] jumps over a table of data words at ram[1..], then
+//the body runs 65536 times per outer pass (r6 counts down from 0 and wraps), for outer passes.
+//The body may use r1-r4 and r7.
+template <class Data, class Setup, class Body>
+std::vector<uint16_t> make_workload(unsigned outer, Data data, Setup setup, Body body) {
+    e20_assembler p;
+    p.j("start");
+    data(p);
+    p.label("start");
+    setup(p);
+    p.addi(5, 0, 0);
+    for (unsigned k = outer; k > 0; ) {
+        int step = k > 63 ? 63 : static_cast<int>(k);
+        p.addi(5, 5, step);
+        k -= step;
+    }
+    p.label("outer");
+    p.addi(6, 0, 0);
+    p.label("inner");
+    body(p);
+    p.addi(6, 6, -1);
+    p.jeq(6, 0, "inner_done");
+    p.j("inner");
+    p.label("inner_done");
+    p.addi(5, 5, -1);
+    p.jeq(5, 0, "done");
+    p.j("outer");
+    p.label("done");
+    p.halt();
+    return p.finish();
+}
+
+struct workload
+{
+    std::string name;
+    std::vector<uint16_t> memory;
+};
+
+/*
+    Generates the benchmark programs.
+
+    @param outer Outer passes per workload; each pass runs the loop body 65536 times
+*/
+inline std::vector<workload> make_workloads(unsigned outer) {
+    std::vector<workload> w;
+    auto no_data = [](e20_assembler &) {};
+
+    //Sequential streaming: loads every cell of memory in order and copies some of it
+    w.push_back({"stream", make_workload(outer, no_data,
+        [](e20_assembler &p) { p.addi(1, 0, 0); },
+        [](e20_assembler &p) {
+            p.lw(2, 1, 0);
+            p.lw(3, 1, 1);
+            p.lw(4, 1, 2);
+            p.lw(7, 1, 3);
+            p.addi(1, 1, 4);
+        })});
+
+    //Strided: four loads 37 cells apart per iteration, so every load touches a new block
+    w.push_back({"strided", make_workload(outer, no_data,
+        [](e20_assembler &p) { p.addi(1, 0, 0); },
+        [](e20_assembler &p) {
+            p.lw(2, 1, 0);
+            p.addi(1, 1, 37);
+            p.lw(3, 1, 0);
+            p.addi(1, 1, 37);
+            p.lw(4, 1, 0);
+            p.addi(1, 1, 37);
+            p.lw(7, 1, 0);
+            p.addi(1, 1, 37);
+        })});
+
+    //Pointer chasing: a single cycle through the upper half of memory in a scrambled order, so
+    //each load's address comes from the previous one
+    {
+        const size_t base = MEM_SIZE / 2, n = MEM_SIZE / 2;
+        std::vector<uint16_t> memory = make_workload(outer,
+            [](e20_assembler &p) { p.word(static_cast<uint16_t>(MEM_SIZE / 2)); },
+            [](e20_assembler &p) { p.lw(1, 0, 1); },
+            [](e20_assembler &p) {
+                p.lw(1, 1, 0);
+                p.lw(1, 1, 0);
+                p.lw(1, 1, 0);
+                p.lw(1, 1, 0);
+            });
+        std::vector<uint16_t> order(n);
+        for (size_t i = 0; i < n; i++)
+            order[i] = static_cast<uint16_t>(i);
+        uint32_t x = 12345;
+        for (size_t i = n - 1; i > 0; i--) {
+            x = x * 1103515245u + 12345u;
+            std::swap(order[i], order[(x >> 8) % (i + 1)]);
+        }
+        //The list starts at ram[base], wherever it falls in the shuffled order
+        for (size_t i = 0; i < n; i++)
+            memory[base + order[i]] = static_cast<uint16_t>(base + order[(i + 1) % n]);
+        w.push_back({"pointer_chase", memory});
+    }
+
+    //Tight loop: register arithmetic only, no memory traffic
+    w.push_back({"alu_loop", make_workload(outer, no_data,
+        [](e20_assembler &p) { p.addi(1, 0, 1); p.addi(2, 0, 3); },
+        [](e20_assembler &p) {
+            p.add(3, 1, 2);
+            p.sub(4, 3, 1);
+            p.or_(7, 4, 2);
+            p.and_(3, 7, 1);
+            p.slt(4, 1, 3);
+            p.slti(7, 2, 9);
+            p.addi(1, 1, 1);
+        })});
+
+    //Self-modifying: every iteration rewrites an instruction in the loop body just before running it,
+    //then rewrites it again and stores over a data cell, so every sw has to re-decode a cell
+    w.push_back({"self_modify", make_workload(outer,
+        [](e20_assembler &p) {
+            p.word(e20_assembler::encode_addi(7, 7, 1));
+            p.word(e20_assembler::encode_addi(7, 7, -1));
+            p.address_of("patch");
+        },
+        [](e20_assembler &p) { p.lw(4, 0, 3); },
+        [](e20_assembler &p) {
+            p.lw(3, 0, 1);
+            p.sw(3, 4, 0);
+            p.label("patch");
+            p.addi(0, 0, 0);
+            p.lw(3, 0, 2);
+            p.sw(3, 4, 0);
+            p.sw(7, 4, 64);
+        })});
+    return w;
+}
+
+#endif
@@ -0,0 +1,1063 @@
+/*
+cache.h
+Flat, preallocated cache model for the E20 cache simulator
+*/
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "classify.h"
+#include "log.h"
+#include "policy.h"
+#include "prefetch.h"
+#include "simd.h"
+#include "sparse.h"
+#include "timing.h"
+
+//Counters kept by every cache level. They are always on: the hit path only bumps a counter,
+//and the histograms are only touched on a miss.
+struct level_stats
+{
+    uint64_t load_hits = 0;
+    uint64_t load_misses = 0;
+    uint64_t store_hits = 0;
+    uint64_t store_misses = 0;
+    uint64_t evictions = 0;
+
+    //Dirty blocks this level wrote to the next level, or to memory from the last one; zero unless
+    //the level is write-back. Each reaches the next level as a store of its block.
+    uint64_t writebacks = 0;
+
+    //Instruction fetches, all zero unless the cache models them (see cache_fetch). They are counted
+    //in hits() and misses() and, for misses, the histograms below, with the fetched instruction's pc.
+    uint64_t fetch_hits = 0;
+    uint64_t fetch_misses = 0;
+
+    //Misses at this level indexed by the pc of the lw/sw that caused them, and by the
+    //block (address / blocksize) that missed. pc_misses grows to the largest pc seen; blocks
+    //of a wide address space are too many for that, so block_misses only holds the pages of
+    //blocks that missed.
+    std::vector<uint64_t> pc_misses;
+    sparse_array<uint64_t> block_misses;
+
+    //Prefetching, all zero unless the level has a prefetcher (see prefetch.h). Of the blocks the
+    //prefetcher asked for, prefetch_fills were brought in (the rest were already there). A fill is
+    //useful if a demand access used it before it was evicted, late if that use came too soon (see
+    //PREFETCH_LATE_ACCESSES) and useless if it was evicted unused. A polluting prefetch evicted a
+    //block that a demand access then missed on. None of this is in the counters above, which only
+    //count demand accesses.
+    uint64_t prefetch_requests = 0;
+    uint64_t prefetch_fills = 0;
+    uint64_t prefetch_useful = 0;
+    uint64_t prefetch_late = 0;
+    uint64_t prefetch_useless = 0;
+    uint64_t prefetch_polluting = 0;
+
+    //The misses above by class (see classify.h), all zero unless the level classifies its misses:
+    //in total, and per pc as pc_classes[pc * 3 + class], which grows like pc_misses
+    uint64_t compulsory_misses = 0;
+    uint64_t capacity_misses = 0;
+    uint64_t conflict_misses = 0;
+    std::vector<uint64_t> pc_classes;
+
+    uint64_t hits() const { return load_hits + store_hits + fetch_hits; }
+    uint64_t misses() const { return load_misses + store_misses + fetch_misses; }
+    uint64_t accesses() const { return hits() + misses(); }
+
+    void miss(unsigned pc, uint32_t block) {
+        if (pc >= pc_misses.size())
+            pc_misses.resize(pc + 1, 0);
+        pc_misses[pc]++;
+        block_misses.at(block)++;
+    }
+
+    void classified(unsigned pc, miss_class c) {
+        if (c == MISS_COMPULSORY)
+            compulsory_misses++;
+        else if (c == MISS_CAPACITY)
+            capacity_misses++;
+        else
+            conflict_misses++;
+        if (pc * 3 >= pc_classes.size())
+            pc_classes.resize((pc + 1) * 3, 0);
+        pc_classes[pc * 3 + c]++;
+    }
+
+    //Passes the counters through a checkpoint archive (see checkpoint.h)
+    template <class Archive>
+    void serialize(Archive &ar) {
+        ar.io(load_hits);
+        ar.io(load_misses);
+        ar.io(store_hits);
+        ar.io(store_misses);
+        ar.io(evictions);
+        ar.io(writebacks);
+        ar.io(fetch_hits);
+        ar.io(fetch_misses);
+        ar.io(prefetch_requests);
+        ar.io(prefetch_fills);
+        ar.io(prefetch_useful);
+        ar.io(prefetch_late);
+        ar.io(prefetch_useless);
+        ar.io(prefetch_polluting);
+        ar.io(compulsory_misses);
+        ar.io(capacity_misses);
+        ar.io(conflict_misses);
+        ar.io_grow(pc_classes);
+        ar.io_grow(pc_misses);
+        block_misses.serialize(ar);
+    }
+};
+
+//The most ways a level can have, as its fill counts are 16 bits
+const int MAX_ASSOC = UINT16_MAX;
+
+//A struct that represents a cache level. It stores the size of the cache, the associativity, and block size.
+//Every row of the level lives in one contiguous array: row r owns the slots [r*stride, r*stride + associativity)
+//of tags, and fill[r] says how many of those slots hold a block. A row fills its slots in order and a block
+//stays in its slot until it is evicted; which one goes is up to the replacement policy. Rows of 8 or more ways
+//are padded out to whole SIMD groups (see simd.h) and matched with vector compares; the fill count masks off
+//the slots that don't hold a block.
+struct level
+{
+    int cache_size = 0;
+    int associativity = 0;
+    int block_size = 0;
+    uint32_t num_rows = 0;
+
+    //Precomputed shifts and mask used instead of / and % when both the block size and row count are powers of two
+    bool pow2 = false;
+    unsigned block_shift = 0;
+    unsigned row_shift = 0;
+    uint32_t row_mask = 0;
+
+    //Distance between rows in tags, and the instruction set used to search them
+    unsigned stride = 0;
+    simd_level simd = SIMD_SCALAR;
+
+    //True if the level has a prefetcher, classifies its misses or is write-back (see below), which
+    //access_level then handles out of line
+    bool extras = false;
+
+    //Tags are 32 bits, which covers every block of the wide address space in any geometry; fill
+    //counts up to MAX_ASSOC
+    std::vector<uint32_t> tags;
+    std::vector<uint16_t> fill;
+
+    level_stats stats;
+
+    //The prefetcher, off unless set_prefetcher gave the level one. With it, each slot of tags has
+    //a flag in prefetched that is set while it holds a prefetched block no demand access has used
+    //yet, and the prefetcher's clock when that block came in; polluted flags the blocks a prefetch
+    //evicted, until they are next brought in.
+    prefetcher prefetch;
+    std::vector<uint8_t> prefetched;
+    std::vector<uint64_t> prefetched_at;
+    sparse_array<uint8_t> polluted;
+
+    //Sorts the level's misses into the three Cs, when set_miss_classification turns it on
+    miss_classifier classifier;
+
+    //How the level handles stores, write-through with allocate unless set_write_policy says otherwise.
+    //A write-back level has a flag in dirty for each slot of tags, set while the block there has been
+    //stored to since it came in; evicting it queues its address in pending, for cache_load or
+    //cache_store to write back to the next level.
+    write_config write;
+    std::vector<uint8_t> dirty;
+    std::vector<uint32_t> pending;
+};
+
+//A cache level specialised on its replacement policy (see policy.h)
+template <class Policy>
+struct basic_level : level
+{
+    Policy policy;
+
+    //Passes the contents, statistics and replacement state through a checkpoint archive. The
+    //geometry isn't saved: the level must already be initialized with the same configuration.
+    template <class Archive>
+    void serialize(Archive &ar) {
+        ar.io(tags);
+        ar.io(fill);
+        stats.serialize(ar);
+        policy.serialize(ar);
+        prefetch.serialize(ar);
+        ar.io(prefetched);
+        ar.io(prefetched_at);
+        polluted.serialize(ar);
+        classifier.serialize(ar);
+        ar.io(dirty);
+    }
+};
+
+//The shape of a cache's L1, fixed at compile time: with the associativity known, the compiler
+//unrolls the way scan of narrow rows and the row offset becomes a shift. The block size and row
+//count stay run time values; they are already applied with precomputed shifts and masks when they
+//are powers of two.
+template <unsigned Assoc>
+struct fixed_shape
+{
+    static constexpr bool fixed = true;
+    static constexpr unsigned assoc = Assoc;
+};
+
+//Any shape: everything is read from the level at run time
+struct generic_shape
+{
+    static constexpr bool fixed = false;
+    static constexpr unsigned assoc = 0;
+};
+
+//Where instruction fetches go (see cache_fetch):
+//  off      nowhere; only lw and sw reach the cache
+//  unified  through L1 like a load, so code and data share it
+//  split    through an L1 instruction cache of their own, whose misses go on to L2
+enum fetch_mode { FETCH_OFF, FETCH_UNIFIED, FETCH_SPLIT };
+
+//No block: the fetch fast path has nothing to remember
+const uint32_t NO_FETCH_BLOCK = UINT32_MAX;
+
+//A struct that contains a vector of cache levels. Shape describes the L1; deeper levels only
+//see L1's misses and the stores, and always take the generic path.
+template <class Policy, class Shape = generic_shape>
+struct basic_cache
+{
+    typedef Shape shape;
+
+    std::vector<basic_level<Policy>> My_levels;
+
+    //Instruction fetches, and the L1 instruction cache they go through if split (unused otherwise)
+    fetch_mode fetch = FETCH_OFF;
+    basic_level<Policy> icache;
+
+    //The block of the last fetch that hit, while nothing else has touched the level it hit in
+    uint32_t last_fetch = NO_FETCH_BLOCK;
+
+    //True if a level isn't write-through with allocate, or the cache has latencies: loads and stores
+    //then take the out of line path of cache_access
+    bool detailed = false;
+
+    //False for the original simulator's stores, which stop bringing their block in below the first
+    //level they hit; true for the corrected model, where every write-allocate level that misses does
+    bool corrected_stores = false;
+    cache_timing timing;
+};
+
+//The cache the simulator models by default: LRU, write-through with allocate at every level
+typedef basic_cache<lru_policy> cache;
+
+/*
+    Returns log2 of x if x is a power of two, or -1 otherwise.
+*/
+inline int exact_log2(uint32_t x) {
+    if (x == 0 || (x & (x - 1)) != 0)
+        return -1;
+    int n = 0;
+    while ((1u << n) != x)
+        n++;
+    return n;
+}
+
+/*
+    Sets up a cache level and allocates all of its storage. Nothing is
+    allocated for the level after this call.
+
+    @param lvl The level to initialize
+
+    @param size The total size of the cache, measured in memory cells.
+
+    @param assoc The associativity of the cache.
+
+    @param blocksize The blocksize of the cache.
+*/
+template <class Policy>
+inline void init_level(basic_level<Policy> &lvl, int size, int assoc, int blocksize) {
+    lvl.cache_size = size;
+    lvl.associativity = assoc;
+    lvl.block_size = blocksize;
+    lvl.num_rows = static_cast<uint32_t>(size / (static_cast<int64_t>(blocksize) * assoc));
+
+    int bshift = exact_log2(blocksize);
+    int rshift = exact_log2(lvl.num_rows);
+    lvl.pow2 = bshift >= 0 && rshift >= 0;
+    if (lvl.pow2) {
+        lvl.block_shift = bshift;
+        lvl.row_shift = rshift;
+        lvl.row_mask = lvl.num_rows - 1;
+    }
+
+    lvl.stride = tag_stride(assoc);
+    lvl.simd = simd_for_ways(assoc);
+
+    size_t slots = static_cast<size_t>(lvl.num_rows) * lvl.stride;
+    lvl.tags.assign(slots, static_cast<uint32_t>(-1));
+    lvl.fill.assign(lvl.num_rows, 0);
+    lvl.policy.init(lvl.num_rows, assoc);
+}
+
+/*
+    Splits a memory address into the row and tag it maps to in a level.
+
+    @param lvl The level being accessed
+
+    @param addr The memory address being accessed
+
+    @param row Receives the row (set) number
+
+    @param tag Receives the tag stored for the block
+*/
+inline void locate(const level &lvl, uint32_t addr, uint32_t &row, uint32_t &tag) {
+    if (lvl.pow2) {
+        uint32_t blockID = addr >> lvl.block_shift;
+        row = blockID & lvl.row_mask;
+        tag = blockID >> lvl.row_shift;
+    } else {
+        uint32_t blockID = addr / lvl.block_size;
+        row = blockID % lvl.num_rows;
+        tag = blockID / lvl.num_rows;
+    }
+}
+
+/*
+    Looks up a block in one row of a level, without telling the replacement
+    policy.
+
+    @param lvl The level being accessed, which must have the given Shape
+
+    @param row The row returned by locate
+
+    @param tag The tag returned by locate
+
+    @return The way holding the block, or -1
+*/
+template <class Shape = generic_shape, class Policy>
+inline int find_way(basic_level<Policy> &lvl, uint32_t row, uint32_t tag) {
+    unsigned stride = Shape::fixed ? tag_stride(Shape::assoc) : lvl.stride;
+    const uint32_t *tags = lvl.tags.data() + static_cast<size_t>(row) * stride;
+    unsigned n = lvl.fill[row];
+
+    if constexpr (Shape::fixed && Shape::assoc < SIMD_MIN_WAYS) {
+        //Scans with a constant trip count, so the loop unrolls
+        for (unsigned i = 0; i < Shape::assoc && i < n; i++) {
+            if (tags[i] == tag)
+                return i;
+        }
+        return -1;
+    } else {
+        return match_tags(tags, n, tag, lvl.simd);
+    }
+}
+
+/*
+    Picks the way a new block goes in: the next free slot of the row or,
+    if the row is full, the block the replacement policy evicts. A way
+    below the row's fill count holds a block that will be evicted.
+*/
+template <class Shape = generic_shape, class Policy>
+inline unsigned choose_way(basic_level<Policy> &lvl, uint32_t row) {
+    unsigned assoc = Shape::fixed ? Shape::assoc : lvl.associativity;
+    unsigned n = lvl.fill[row];
+    return n == assoc ? lvl.policy.victim(row) : n;
+}
+
+/*
+    Brings a block into the way choose_way picked, counting an eviction if
+    it replaces one.
+*/
+template <class Shape = generic_shape, class Policy>
+inline void install_block(basic_level<Policy> &lvl, uint32_t row, unsigned way, uint32_t tag) {
+    unsigned stride = Shape::fixed ? tag_stride(Shape::assoc) : lvl.stride;
+    if (way == lvl.fill[row])
+        lvl.fill[row] = way + 1;
+    else
+        lvl.stats.evictions++;
+    lvl.tags[static_cast<size_t>(row) * stride + way] = tag;
+    lvl.policy.fill(row, way);
+}
+
+/*
+    Looks up a block in one row of a level and tells the replacement policy
+    about the access. On a miss the block is brought in, into the next free
+    slot or, if the row is full, in place of the block the policy evicts.
+
+    @param lvl The level being accessed, which must have the given Shape
+
+    @param row The row returned by locate
+
+    @param tag The tag returned by locate
+
+    @return true on a hit, false on a miss
+*/
+template <class Shape = generic_shape, class Policy>
+inline bool access_row(basic_level<Policy> &lvl, uint32_t row, uint32_t tag) {
+    int found = find_way<Shape>(lvl, row, tag);
+    if (found >= 0) {
+        lvl.policy.hit(row, found);
+        return true;
+    }
+    unsigned way = choose_way<Shape>(lvl, row);
+    install_block<Shape>(lvl, row, way, tag);
+    return false;
+}
+
+//Keeps the prefetching and classifying path out of access_level, so a plain level pays one test
+#if defined(__GNUC__)
+#define CACHE_NOINLINE __attribute__((noinline))
+#else
+#define CACHE_NOINLINE
+#endif
+
+//Whether access_level has to take a level out of line
+inline bool has_extras(const level &lvl) {
+    return lvl.prefetch.on() || lvl.classifier.on() || lvl.write.back;
+}
+
+/*
+    Gives a level a prefetcher, or takes it away, and clears the level's
+    prefetch accounting. Call after init_level.
+*/
+inline void set_prefetcher(level &lvl, const prefetch_config &config) {
+    lvl.prefetch.init(config);
+    size_t slots = lvl.prefetch.on() ? lvl.tags.size() : 0;
+    lvl.prefetched.assign(slots, 0);
+    lvl.prefetched_at.assign(slots, 0);
+    lvl.polluted.clear();
+    lvl.extras = has_extras(lvl);
+}
+
+/*
+    Turns the classification of a level's misses (see classify.h) on or
+    off, forgetting every block it has seen. Call after init_level.
+*/
+inline void set_miss_classification(level &lvl, bool on) {
+    lvl.classifier.init(on, lvl.num_rows * static_cast<uint32_t>(lvl.associativity));
+    lvl.extras = has_extras(lvl);
+}
+
+/*
+    Sets how a level handles stores (see write_config), with every block
+    clean. Call after init_level; a cache with a level that isn't
+    write-through with allocate must also be detailed.
+*/
+inline void set_write_policy(level &lvl, const write_config &config) {
+    lvl.write = config;
+    lvl.dirty.assign(config.back ? lvl.tags.size() : 0, 0);
+    lvl.pending.clear();
+    lvl.pending.reserve(config.back ? 1 + MAX_PREFETCH_DEGREE : 0);
+    lvl.extras = has_extras(lvl);
+}
+
+/*
+    Called before the block in a slot of a write-back level is evicted:
+    if it is dirty, queues it to be written back.
+*/
+inline void evict_slot(level &lvl, uint32_t row, size_t slot) {
+    if (lvl.dirty.empty() || !lvl.dirty[slot])
+        return;
+    lvl.dirty[slot] = 0;
+    lvl.pending.push_back(static_cast<uint32_t>((static_cast<uint64_t>(lvl.tags[slot]) * lvl.num_rows + row) *
+        lvl.block_size));
+}
+
+/*
+    Brings a block the prefetcher asked for into a level, unless it is
+    already there or lies past the end of the 32-bit address space, and
+    keeps the accounting of level_stats.
+
+    @param block The block number, address / blocksize
+*/
+template <class Policy>
+inline void prefetch_block(basic_level<Policy> &lvl, uint64_t block) {
+    lvl.stats.prefetch_requests++;
+    if (block * lvl.block_size > UINT32_MAX)
+        return;
+    uint32_t row, tag;
+    locate(lvl, static_cast<uint32_t>(block * lvl.block_size), row, tag);
+    if (find_way(lvl, row, tag) >= 0)
+        return;
+
+    unsigned way = choose_way(lvl, row);
+    size_t slot = static_cast<size_t>(row) * lvl.stride + way;
+    if (way < lvl.fill[row]) {
+        if (lvl.prefetched[slot])
+            lvl.stats.prefetch_useless++;
+        else
+            lvl.polluted.at(static_cast<uint32_t>(static_cast<uint64_t>(lvl.tags[slot]) * lvl.num_rows + row)) = 1;
+        evict_slot(lvl, row, slot);
+    }
+    install_block(lvl, row, way, tag);
+    lvl.prefetched[slot] = 1;
+    lvl.prefetched_at[slot] = lvl.prefetch.now;
+    lvl.stats.prefetch_fills++;
+    if (lvl.polluted.get(static_cast<uint32_t>(block)))
+        lvl.polluted.at(static_cast<uint32_t>(block)) = 0;
+}
+
+/*
+    As access_row, for a level with a prefetcher: also keeps the prefetch
+    accounting, then lets the prefetcher see the access and brings in the
+    blocks it asks for.
+
+    @param pc, addr The demand access
+*/
+template <class Shape = generic_shape, class Policy>
+inline bool prefetching_access_row(basic_level<Policy> &lvl, uint32_t row, uint32_t tag, unsigned pc,
+    uint32_t addr) {
+    unsigned stride = Shape::fixed ? tag_stride(Shape::assoc) : lvl.stride;
+    int found = find_way<Shape>(lvl, row, tag);
+    bool hit = found >= 0;
+    bool trigger = !hit;
+    if (hit) {
+        lvl.policy.hit(row, found);
+        size_t slot = static_cast<size_t>(row) * stride + found;
+        if (lvl.prefetched[slot]) {
+            lvl.prefetched[slot] = 0;
+            lvl.stats.prefetch_useful++;
+            if (lvl.prefetch.now - lvl.prefetched_at[slot] < PREFETCH_LATE_ACCESSES)
+                lvl.stats.prefetch_late++;
+            trigger = true;
+        }
+    } else {
+        uint32_t block = addr / lvl.block_size;
+        if (lvl.polluted.get(block)) {
+            lvl.stats.prefetch_polluting++;
+            lvl.polluted.at(block) = 0;
+        }
+        unsigned way = choose_way<Shape>(lvl, row);
+        size_t slot = static_cast<size_t>(row) * stride + way;
+        if (way < lvl.fill[row]) {
+            if (lvl.prefetched[slot])
+                lvl.stats.prefetch_useless++;
+            evict_slot(lvl, row, slot);
+        }
+        install_block<Shape>(lvl, row, way, tag);
+        lvl.prefetched[slot] = 0;
+    }
+    lvl.prefetch.observe(pc, addr, lvl.block_size, trigger, [&](uint64_t block) { prefetch_block(lvl, block); });
+    return hit;
+}
+
+/*
+    As access_row, for a write-back level: queues the block a miss evicts
+    to be written back if it is dirty.
+*/
+template <class Shape = generic_shape, class Policy>
+inline bool write_back_access_row(basic_level<Policy> &lvl, uint32_t row, uint32_t tag) {
+    int found = find_way<Shape>(lvl, row, tag);
+    if (found >= 0) {
+        lvl.policy.hit(row, found);
+        return true;
+    }
+    unsigned way = choose_way<Shape>(lvl, row);
+    if (way < lvl.fill[row])
+        evict_slot(lvl, row, static_cast<size_t>(row) * (Shape::fixed ? tag_stride(Shape::assoc) : lvl.stride) + way);
+    install_block<Shape>(lvl, row, way, tag);
+    return false;
+}
+
+/*
+    As access_row, for a level with extras: prefetches, classifies the
+    miss and keeps the dirty blocks as the level is set up to.
+
+    @param pc, addr The demand access
+*/
+template <class Shape = generic_shape, class Policy>
+CACHE_NOINLINE bool extra_access_row(basic_level<Policy> &lvl, uint32_t row, uint32_t tag, unsigned pc, uint32_t addr) {
+    bool hit = lvl.prefetch.on() ? prefetching_access_row<Shape>(lvl, row, tag, pc, addr) :
+        lvl.write.back ? write_back_access_row<Shape>(lvl, row, tag) : access_row<Shape>(lvl, row, tag);
+    if (lvl.classifier.on()) {
+        miss_class c = lvl.classifier.access(addr / lvl.block_size, hit);
+        if (!hit)
+            lvl.stats.classified(pc, c);
+    }
+    return hit;
+}
+
+/*
+    Parses and checks a cache configuration string.
+
+    @param cache_config size,associativity,blocksize (for one cache) or
+        size,associativity,blocksize,size,associativity,blocksize (for two caches),
+        and so on with one more triple for every further level
+
+    @param parts Receives the numbers, three per level
+
+    @return false if the configuration can't be parsed, or a level has no
+        rows or more than MAX_ASSOC ways
+*/
+inline bool parse_cache_config(const std::string &cache_config, std::vector<int> &parts) {
+    size_t pos;
+    size_t lastpos = 0;
+    try {
+        while ((pos = cache_config.find(",", lastpos)) != std::string::npos)
+        {
+            parts.push_back(std::stoi(cache_config.substr(lastpos, pos - lastpos)));
+            lastpos = pos + 1;
+        }
+        parts.push_back(std::stoi(cache_config.substr(lastpos)));
+    } catch (const std::exception &) {
+        return false;
+    }
+    if (parts.empty() || parts.size() % 3 != 0)
+        return false;
+    for (size_t p = 0; p < parts.size(); p += 3)
+    {
+        //Every level needs at least one row, or addresses can't be mapped to it
+        if (parts[p+1] <= 0 || parts[p+1] > MAX_ASSOC || parts[p+2] <= 0 ||
+            parts[p] / (static_cast<int64_t>(parts[p+1]) * parts[p+2]) <= 0)
+            return false;
+    }
+    return true;
+}
+
+/*
+    Parses where instruction fetches go, the argument of --ifetch.
+
+    @param spec "" for nowhere, "unified" for through L1, or
+        size,associativity,blocksize for a split L1 instruction cache
+
+    @param mode Receives the mode
+
+    @param parts Receives the instruction cache's size, associativity and
+        blocksize if split
+
+    @return false if spec can't be parsed
+*/
+inline bool parse_fetch_config(const std::string &spec, fetch_mode &mode, std::vector<int> &parts) {
+    parts.clear();
+    if (spec.empty())
+        mode = FETCH_OFF;
+    else if (spec == "unified")
+        mode = FETCH_UNIFIED;
+    else if (parse_cache_config(spec, parts) && parts.size() == 3)
+        mode = FETCH_SPLIT;
+    else
+        return false;
+    return true;
+}
+
+/*
+    Builds the levels of a cache from a configuration string.
+
+    @param My_cache The cache to fill in; must have no levels yet
+
+    @param cache_config See parse_cache_config
+
+    @return false if the configuration can't be parsed, or its L1 doesn't
+        have the cache's Shape
+*/
+template <class Policy, class Shape>
+inline bool init_cache(basic_cache<Policy, Shape> &My_cache, const std::string &cache_config) {
+    std::vector<int> parts;
+    if (!parse_cache_config(cache_config, parts))
+        return false;
+    if constexpr (Shape::fixed) {
+        if (parts[1] != static_cast<int>(Shape::assoc))
+            return false;
+    }
+
+    //Creates one level per size,associativity,blocksize triple. init_level allocates all of the
+    //level's rows up front, so nothing is allocated while the program runs
+    for (size_t p = 0; p < parts.size(); p += 3)
+    {
+        My_cache.My_levels.emplace_back();
+        init_level(My_cache.My_levels.back(), parts[p], parts[p+1], parts[p+2]);
+    }
+    return true;
+}
+
+//Whether a level holds the block of an address, without telling the replacement policy
+template <class Policy>
+inline bool holds_block(basic_level<Policy> &lvl, uint32_t addr) {
+    uint32_t row, tag;
+    locate(lvl, addr, row, tag);
+    return find_way(lvl, row, tag) >= 0;
+}
+
+/*
+    Sends a store through one level, as access_level does, except that a
+    miss only brings the block in if allocate is set; otherwise it is just
+    counted and logged.
+
+    @return true if the store hit
+*/
+template <class Shape = generic_shape, class Policy, class Log>
+inline bool store_level(basic_level<Policy> &lvl, unsigned index, unsigned pc, unsigned addr, bool allocate, Log &log) {
+    uint32_t row, tag;
+    locate(lvl, addr, row, tag);
+    bool hit = allocate || find_way<Shape>(lvl, row, tag) >= 0;
+    if (hit)
+        hit = lvl.extras ? extra_access_row<Shape>(lvl, row, tag, pc, addr) : access_row<Shape>(lvl, row, tag);
+    if (hit) {
+        lvl.stats.store_hits++;
+    } else {
+        lvl.stats.store_misses++;
+        lvl.stats.miss(pc, addr / lvl.block_size);
+    }
+    log.entry(index, LOG_SW, pc, addr, row);
+    return hit;
+}
+
+/*
+    Sends a load or store through one level of a cache: looks the block up,
+    bringing it in on a miss, counts the access and reports it to the log.
+
+    @param lvl The level being accessed, which must have the given Shape
+
+    @param index The position of the level in its cache, 0 for L1
+
+    @param pc The program counter of the lw or sw instruction
+
+    @param addr The memory address being accessed
+
+    @param is_store true for a sw
+
+    @param log Receives entry(index, status, pc, addr, row)
+
+    @return true if the access goes on to the next level: a load that
+        missed, or any store, as the level is write-through (cache_access
+        handles the other write policies)
+*/
+template <class Shape = generic_shape, class Policy, class Log>
+inline bool access_level(basic_level<Policy> &lvl, unsigned index, unsigned pc, unsigned addr, bool is_store, Log &log) {
+    if (is_store) {
+        store_level<Shape>(lvl, index, pc, addr, true, log);
+        return true;
+    }
+    uint32_t row, tag;
+    locate(lvl, addr, row, tag);
+    bool hit = lvl.extras ? extra_access_row<Shape>(lvl, row, tag, pc, addr) : access_row<Shape>(lvl, row, tag);
+    if (hit) {
+        lvl.stats.load_hits++;
+        log.entry(index, LOG_HIT, pc, addr, row);
+        return false;
+    }
+    lvl.stats.load_misses++;
+    lvl.stats.miss(pc, addr / lvl.block_size);
+    log.entry(index, LOG_MISS, pc, addr, row);
+    return true;
+}
+
+//What reaches a level in a detailed cache (see cache_access). A writeback is a store of a whole dirty block,
+//which a write-allocate level can take in without bringing the block in first.
+enum access_kind { ACCESS_NONE, ACCESS_LOAD, ACCESS_STORE, ACCESS_WRITEBACK };
+
+/*
+    As access_level, following the level's write policy.
+
+    @param kind What reaches the level; not ACCESS_NONE
+
+    @param allocate false to keep a store that misses from bringing the
+        block in, whatever the write policy
+
+    @return What goes on to the next level: a load that missed; a store or
+        writeback, unless a write-back level took it; or, for a store that
+        missed in a write-back level with allocate, the load that brings
+        the block in
+*/
+template <class Shape = generic_shape, class Policy, class Log>
+inline access_kind policy_access(basic_level<Policy> &lvl, unsigned index, unsigned pc, unsigned addr, access_kind kind,
+    Log &log, bool allocate = true) {
+    if (kind == ACCESS_LOAD)
+        return access_level<Shape>(lvl, index, pc, addr, false, log) ? ACCESS_LOAD : ACCESS_NONE;
+    uint32_t row, tag;
+    locate(lvl, addr, row, tag);
+    bool hit = find_way<Shape>(lvl, row, tag) >= 0;
+    if (!hit && (!lvl.write.allocate || !allocate)) {
+        lvl.stats.store_misses++;
+        lvl.stats.miss(pc, addr / lvl.block_size);
+        log.entry(index, LOG_SW, pc, addr, row);
+        return kind;
+    }
+    access_level<Shape>(lvl, index, pc, addr, true, log);
+    if (!lvl.write.back)
+        return kind;
+    //The prefetches the store set off can have evicted its block already, which then goes straight back
+    int way = find_way<Shape>(lvl, row, tag);
+    unsigned stride = Shape::fixed ? tag_stride(Shape::assoc) : lvl.stride;
+    if (way >= 0)
+        lvl.dirty[static_cast<size_t>(row) * stride + way] = 1;
+    else
+        lvl.pending.push_back(addr / lvl.block_size * lvl.block_size);
+    return !hit && kind == ACCESS_STORE ? ACCESS_LOAD : ACCESS_NONE;
+}
+
+/*
+    Writes back the dirty blocks a level of a detailed cache has evicted,
+    each as a writeback through the levels below it, and the blocks those
+    evict in turn.
+
+    @param index The level, 0 for L1
+
+    @param pc The instruction whose access evicted the blocks
+*/
+template <class Policy, class Shape, class Log>
+inline void write_back_pending(basic_cache<Policy, Shape> &My_cache, size_t index, unsigned pc, Log &log) {
+    basic_level<Policy> &lvl = My_cache.My_levels[index];
+    for (size_t i = 0; i < lvl.pending.size(); i++)
+    {
+        lvl.stats.writebacks++;
+        access_kind kind = ACCESS_WRITEBACK;
+        for (size_t curr_level = index + 1; curr_level < My_cache.My_levels.size() && kind != ACCESS_NONE; curr_level++)
+        {
+            kind = policy_access(My_cache.My_levels[curr_level], curr_level, pc, lvl.pending[i], kind, log);
+            write_back_pending(My_cache, curr_level, pc, log);
+        }
+    }
+    lvl.pending.clear();
+}
+
+/*
+    Sends a load or store through a detailed cache: as cache_load and
+    cache_store do, but following each level's write policy, writing back
+    the dirty blocks that are evicted and timing the access if the cache
+    has latencies (see cache_timing).
+
+    @param kind ACCESS_LOAD or ACCESS_STORE
+*/
+template <class Policy, class Shape, class Log>
+CACHE_NOINLINE void cache_access(basic_cache<Policy, Shape> &My_cache, unsigned pc, unsigned addr, access_kind kind,
+    Log &log) {
+    cache_timing &timing = My_cache.timing;
+    uint64_t cycles = 0;
+
+    //Set once a store of the original model has hit, after which it brings its block in nowhere
+    bool found = false;
+    for (size_t curr_level = 0; curr_level < My_cache.My_levels.size() && kind != ACCESS_NONE; curr_level++)
+    {
+        if (timing.on)
+            cycles += timing.hit[curr_level];
+        bool allocate = !found;
+        if (kind == ACCESS_STORE && !My_cache.corrected_stores && !found)
+            found = holds_block(My_cache.My_levels[curr_level], addr);
+        kind = curr_level == 0 ? policy_access<Shape>(My_cache.My_levels[0], 0, pc, addr, kind, log, allocate) :
+            policy_access(My_cache.My_levels[curr_level], curr_level, pc, addr, kind, log, allocate);
+        write_back_pending(My_cache, curr_level, pc, log);
+    }
+    if (timing.on)
+        timing.record(kind == ACCESS_NONE ? cycles : cycles + timing.memory);
+}
+
+/*
+    Sends a load through the cache. Walks down the levels until one of
+    them hits; every level that misses brings the block in.
+
+    L1 is taken to have the shape L1Shape, whatever the cache's Shape; the
+    caller must have checked that it does (see with_shape). cache_load
+    below uses the cache's own.
+
+    @param My_cache The cache being accessed
+
+    @param pc The program counter of the lw instruction
+
+    @param addr The memory address being loaded
+
+    @param log Receives one entry(level, status, pc, addr, row) per level visited
+*/
+template <class L1Shape, class Policy, class Shape, class Log>
+inline void cache_load_as(basic_cache<Policy, Shape> &My_cache, unsigned pc, unsigned addr, Log &log) {
+    if (My_cache.detailed) {
+        cache_access(My_cache, pc, addr, ACCESS_LOAD, log);
+        return;
+    }
+    if (!access_level<L1Shape>(My_cache.My_levels[0], 0, pc, addr, false, log))
+        return;
+    for (size_t curr_level = 1; curr_level < My_cache.My_levels.size(); curr_level++)
+    {
+        if (!access_level(My_cache.My_levels[curr_level], curr_level, pc, addr, false, log))
+            return;
+    }
+}
+
+//cache_load_as with the cache's own Shape
+template <class Policy, class Shape, class Log>
+inline void cache_load(basic_cache<Policy, Shape> &My_cache, unsigned pc, unsigned addr, Log &log) {
+    cache_load_as<Shape>(My_cache, pc, addr, log);
+}
+
+/*
+    Sends a store through the cache. Unless the cache is detailed, every
+    level is write-through, so every level is written, and a level that
+    misses brings the block in; in the original model (see
+    corrected_stores) only until the store has hit somewhere. L1 has the
+    shape L1Shape, as for cache_load_as.
+
+    @param My_cache The cache being accessed
+
+    @param pc The program counter of the sw instruction
+
+    @param addr The memory address being stored to
+
+    @param log Receives one entry(level, LOG_SW, pc, addr, row) per level
+*/
+template <class L1Shape, class Policy, class Shape, class Log>
+inline void cache_store_as(basic_cache<Policy, Shape> &My_cache, unsigned pc, unsigned addr, Log &log) {
+    if (My_cache.detailed) {
+        cache_access(My_cache, pc, addr, ACCESS_STORE, log);
+        return;
+    }
+    bool found = store_level<L1Shape>(My_cache.My_levels[0], 0, pc, addr, true, log) && !My_cache.corrected_stores;
+    for (size_t curr_level = 1; curr_level < My_cache.My_levels.size(); curr_level++)
+    {
+        if (store_level(My_cache.My_levels[curr_level], curr_level, pc, addr, !found, log))
+            found = !My_cache.corrected_stores;
+    }
+}
+
+//cache_store_as with the cache's own Shape
+template <class Policy, class Shape, class Log>
+inline void cache_store(basic_cache<Policy, Shape> &My_cache, unsigned pc, unsigned addr, Log &log) {
+    cache_store_as<Shape>(My_cache, pc, addr, log);
+}
+
+/*
+    Sends an instruction fetch through one level: as access_level does for
+    a load, but counted as a fetch and never logged.
+
+    @param pc The address of the instruction
+
+    @return true if the fetch goes on to the next level
+*/
+template <class Shape = generic_shape, class Policy>
+inline bool fetch_level(basic_level<Policy> &lvl, unsigned pc) {
+    uint32_t row, tag;
+    locate(lvl, pc, row, tag);
+    bool hit = lvl.extras ? extra_access_row<Shape>(lvl, row, tag, pc, pc) : access_row<Shape>(lvl, row, tag);
+    if (hit) {
+        lvl.stats.fetch_hits++;
+        return false;
+    }
+    lvl.stats.fetch_misses++;
+    lvl.stats.miss(pc, pc / lvl.block_size);
+    return true;
+}
+
+/*
+    Sends an instruction fetch through the cache, as its fetch mode says:
+    into L1 or the instruction cache, and on down the levels below L1 until
+    one hits. Does nothing if the cache doesn't model fetches.
+
+    Most fetches are of the instruction after the last one, in the same
+    block, so the block of a fetch that hit is remembered: the next fetch
+    from it is counted as a hit without a lookup. That is exact, since
+    hitting the block again would leave every replacement policy as it was,
+    as long as no other access has reached the level since; fetch_cache_hook
+    forgets the block whenever a load or store goes through a unified L1.
+    A level with a prefetcher sees every fetch, as its prefetcher learns
+    from hits too.
+
+    @param My_cache The cache being accessed
+
+    @param pc The address of the instruction being fetched
+*/
+template <class Policy, class Shape>
+inline void cache_fetch(basic_cache<Policy, Shape> &My_cache, unsigned pc) {
+    if (My_cache.fetch == FETCH_OFF)
+        return;
+    bool split = My_cache.fetch == FETCH_SPLIT;
+    basic_level<Policy> &first = split ? My_cache.icache : My_cache.My_levels[0];
+    uint32_t block = first.pow2 ? pc >> first.block_shift : pc / first.block_size;
+    if (block == My_cache.last_fetch) {
+        first.stats.fetch_hits++;
+        return;
+    }
+    bool missed = split ? fetch_level(first, pc) : fetch_level<Shape>(first, pc);
+    if (missed) {
+        My_cache.last_fetch = NO_FETCH_BLOCK;
+        for (size_t curr_level = 1; curr_level < My_cache.My_levels.size(); curr_level++)
+        {
+            if (!fetch_level(My_cache.My_levels[curr_level], pc))
+                break;
+        }
+    } else if (!first.prefetch.on()) {
+        My_cache.last_fetch = block;
+    }
+
+    //The blocks the fetch evicted from write-back levels are written back, unlogged like the fetch
+    if (My_cache.detailed) {
+        null_log quiet;
+        for (size_t curr_level = 0; curr_level < My_cache.My_levels.size(); curr_level++)
+            write_back_pending(My_cache, curr_level, pc, quiet);
+    }
+}
+
+//Connects the interpreter in e20.h to a cache (any basic_cache), reporting every event to a log.
+//L1Shape is the cache's Shape unless the caller has checked L1 against another (see cache_load_as).
+template <class Cache, class Log, class L1Shape = typename Cache::shape>
+struct cache_hook
+{
+    Cache &My_cache;
+    Log &log;
+
+    void load(unsigned pc, unsigned addr, uint64_t) {
+        cache_load_as<L1Shape>(My_cache, pc, addr, log);
+    }
+
+    void store(unsigned pc, unsigned addr, uint64_t) {
+        cache_store_as<L1Shape>(My_cache, pc, addr, log);
+    }
+};
+
+//As cache_hook, for a cache that models instruction fetches: takes them too (see cache_fetch)
+template <class Cache, class Log>
+struct fetch_cache_hook
+{
+    Cache &My_cache;
+    Log &log;
+
+    void load(unsigned pc, unsigned addr, uint64_t) {
+        if (My_cache.fetch == FETCH_UNIFIED)
+            My_cache.last_fetch = NO_FETCH_BLOCK;
+        cache_load(My_cache, pc, addr, log);
+    }
+
+    void store(unsigned pc, unsigned addr, uint64_t) {
+        if (My_cache.fetch == FETCH_UNIFIED)
+            My_cache.last_fetch = NO_FETCH_BLOCK;
+        cache_store(My_cache, pc, addr, log);
+    }
+
+    void fetch(unsigned pc, uint64_t) {
+        cache_fetch(My_cache, pc);
+    }
+};
+
+/*
+    Calls fn with a default-constructed shape object for an L1 of the given
+    associativity: a fixed_shape if it is one of 1, 2, 4, 8 or 16, or
+    generic_shape otherwise.
+
+    @return Whatever fn returns
+*/
+template <class Fn>
+auto with_shape(int assoc, Fn &&fn) -> decltype(fn(generic_shape())) {
+    switch (assoc) {
+        case 1: return fn(fixed_shape<1>());
+        case 2: return fn(fixed_shape<2>());
+        case 4: return fn(fixed_shape<4>());
+        case 8: return fn(fixed_shape<8>());
+        case 16: return fn(fixed_shape<16>());
+    }
+    return fn(generic_shape());
+}
+
+/*
+    As above, for the L1 of a configuration. A configuration that doesn't
+    parse gets generic_shape.
+*/
+template <class Fn>
+auto with_shape(const std::string &cache_config, Fn &&fn) -> decltype(fn(generic_shape())) {
+    std::vector<int> parts;
+    if (!parse_cache_config(cache_config, parts))
+        return fn(generic_shape());
+    return with_shape(parts[1], fn);
+}
+
+#endif
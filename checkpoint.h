@@ -0,0 +1,300 @@
+/*
+checkpoint.h
+Saves a machine, and optionally its cache hierarchy, to a checkpoint file
+and restores them, so a long run can be resumed or fast-forwarded once and
+simulated from the same point many times
+*/
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "policy.h"
+#include "simulator.h"
+
+//Checkpoint file layout, all fixed-width fields little-endian:
+//
+//  char[8]  magic "E20CKP7\n"
+//  machine: the loaded program and memory (each a uint64 count, then that many uint16 words), the
+//      pc (uint16), the registers (NUM_REGS uint16), the bank (uint16), the clock cycle (uint64), the
+//      halted flag (uint8), the wide flag (uint8), the corrected lw flag (uint8) and the wide
+//      memory's pages
+//  uint8    1 if a cache hierarchy follows, otherwise 0
+//  cache:   its configuration string, policy name, prefetch spec, ifetch spec, write spec and
+//      latency spec (each a uint64 length, then the characters), 1 if it classifies misses (uint8),
+//      1 if its stores are corrected (uint8), then every level from L1 down, then the L1
+//      instruction cache if fetches are split: tags, fill counts, statistics, replacement
+//      state, prefetch state, miss classifier and dirty flags, each
+//      vector a uint64 count then its elements; then the timing counters (uint64 instructions,
+//      accesses, access cycles and stall cycles)
+//
+//A sparse_array (see sparse.h) is its page numbers, as a vector of uint32, then each page's
+//entries as a vector. Vectors whose size follows from the configuration must have that size
+//when read back.
+static const char CHECKPOINT_MAGIC[8] = {'E', '2', '0', 'C', 'K', 'P', '7', '\n'};
+
+//Whether fields are already in checkpoint byte order, so vectors can be read and written whole
+static const bool CHECKPOINT_HOST_ORDER = __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__;
+
+//Reverses the bytes of a field, between host and checkpoint order on a big-endian host
+template <class T>
+inline T checkpoint_swap(T value) {
+    unsigned char bytes[sizeof(T)];
+    memcpy(bytes, &value, sizeof(T));
+    std::reverse(bytes, bytes + sizeof(T));
+    memcpy(&value, bytes, sizeof(T));
+    return value;
+}
+
+//The archive serialize() writes through
+class checkpoint_writer
+{
+public:
+    explicit checkpoint_writer(FILE *out) : out(out) {}
+
+    bool ok() const { return good; }
+
+    template <class T>
+    void io(T &value) {
+        static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value, "not a fixed-width field");
+        T stored = CHECKPOINT_HOST_ORDER ? value : checkpoint_swap(value);
+        good = good && fwrite(&stored, sizeof(T), 1, out) == 1;
+    }
+
+    template <class T>
+    void io(std::vector<T> &values) {
+        uint64_t n = values.size();
+        io(n);
+        if (!CHECKPOINT_HOST_ORDER) {
+            for (T &value : values)
+                io(value);
+            return;
+        }
+        good = good && fwrite(values.data(), sizeof(T), values.size(), out) == values.size();
+    }
+
+    //Vectors that grow as the program runs are written the same way
+    template <class T>
+    void io_grow(std::vector<T> &values) { io(values); }
+
+    void io(std::string &s) {
+        uint64_t n = s.size();
+        io(n);
+        good = good && fwrite(s.data(), 1, s.size(), out) == s.size();
+    }
+
+    //For a serialize() that finds its object can't be stored
+    void fail() { good = false; }
+
+private:
+    FILE *out;
+    bool good = true;
+};
+
+//The archive serialize() reads through. Once a field can't be read, or a vector has the wrong
+//size, every later read is skipped and ok() is false.
+class checkpoint_reader
+{
+public:
+    /*
+        @param in The open file
+
+        @param remaining Bytes left in the file, which no vector may claim more than
+    */
+    checkpoint_reader(FILE *in, uint64_t remaining) : in(in), remaining(remaining) {}
+
+    bool ok() const { return good; }
+
+    template <class T>
+    void io(T &value) {
+        static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value, "not a fixed-width field");
+        good = good && read(&value, sizeof(T));
+        if (!CHECKPOINT_HOST_ORDER)
+            value = checkpoint_swap(value);
+    }
+
+    template <class T>
+    void io(std::vector<T> &values) {
+        uint64_t n = 0;
+        io(n);
+        good = good && n == values.size() && read(values.data(), n * sizeof(T));
+        to_host(values);
+    }
+
+    //Reads a vector of whatever size was saved
+    template <class T>
+    void io_grow(std::vector<T> &values) {
+        uint64_t n = 0;
+        io(n);
+        good = good && n <= remaining / sizeof(T);
+        if (!good)
+            return;
+        values.resize(n);
+        good = read(values.data(), n * sizeof(T));
+        to_host(values);
+    }
+
+    void io(std::string &s) {
+        uint64_t n = 0;
+        io(n);
+        good = good && n <= remaining;
+        if (!good)
+            return;
+        s.resize(n);
+        good = read(&s[0], n);
+    }
+
+    //For a serialize() that finds what it read inconsistent
+    void fail() { good = false; }
+
+private:
+    FILE *in;
+    uint64_t remaining;
+    bool good = true;
+
+    //Swaps the elements of a vector just read, on a big-endian host
+    template <class T>
+    static void to_host(std::vector<T> &values) {
+        if (!CHECKPOINT_HOST_ORDER) {
+            for (T &value : values)
+                value = checkpoint_swap(value);
+        }
+    }
+
+    bool read(void *p, uint64_t bytes) {
+        if (bytes > remaining)
+            return false;
+        remaining -= bytes;
+        return bytes == 0 || fread(p, 1, bytes, in) == bytes;
+    }
+};
+
+/*
+    Writes a checkpoint of a machine and, if given, its cache hierarchy.
+
+    @param path The file to create
+
+    @param machine The machine, which may be mid-run
+
+    @param caches The hierarchy the machine has been running through, or
+        nullptr to save the machine alone
+
+    @return false if the file can't be written
+*/
+inline bool save_checkpoint(const char *path, E20Machine &machine, CacheHierarchy *caches) {
+    FILE *out = fopen(path, "wb");
+    if (out == nullptr)
+        return false;
+    checkpoint_writer ar(out);
+    bool ok = fwrite(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC), 1, out) == 1;
+    machine.serialize(ar);
+    uint8_t has_cache = caches != nullptr && caches->configured();
+    ar.io(has_cache);
+    if (has_cache) {
+        std::string config = caches->cache_config();
+        std::string policy = caches->visit([](auto &My_cache) {
+            return std::string(My_cache.My_levels[0].policy.name());
+        });
+        std::string prefetch = caches->prefetch_spec();
+        std::string ifetch = caches->ifetch_spec();
+        std::string write = caches->write_spec();
+        std::string latency = caches->latency_spec();
+        uint8_t classify = caches->classify_misses();
+        uint8_t corrected = caches->corrected_stores();
+        ar.io(config);
+        ar.io(policy);
+        ar.io(prefetch);
+        ar.io(ifetch);
+        ar.io(write);
+        ar.io(latency);
+        ar.io(classify);
+        ar.io(corrected);
+        caches->serialize(ar);
+    }
+    ok = ok && ar.ok();
+    return fclose(out) == 0 && ok;
+}
+
+/*
+    Reads a checkpoint written by save_checkpoint.
+
+    @param path The checkpoint file
+
+    @param machine Receives the machine
+
+    @param caches Receives the cache hierarchy, reconfigured as it was saved,
+        if the checkpoint has one; left unconfigured if not. nullptr to only
+        restore the machine.
+
+    @param error Receives a message if the checkpoint can't be used
+
+    @return false if the file can't be read or isn't a valid checkpoint, in
+        which case machine and caches are unchanged
+*/
+inline bool load_checkpoint(const char *path, E20Machine &machine, CacheHierarchy *caches, std::string &error) {
+    FILE *in = fopen(path, "rb");
+    if (in == nullptr) {
+        error = std::string("Can't open file ") + path;
+        return false;
+    }
+    struct stat st;
+    char magic[sizeof(CHECKPOINT_MAGIC)];
+    if (fstat(fileno(in), &st) != 0 || static_cast<uint64_t>(st.st_size) < sizeof(magic) ||
+        fread(magic, sizeof(magic), 1, in) != 1 || memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) != 0) {
+        fclose(in);
+        error = std::string("Not a checkpoint file: ") + path;
+        return false;
+    }
+    checkpoint_reader ar(in, st.st_size - sizeof(magic));
+
+    E20Machine saved;
+    saved.serialize(ar);
+    uint8_t has_cache = 0;
+    ar.io(has_cache);
+    CacheHierarchy saved_caches;
+    bool ok = ar.ok();
+    if (ok && has_cache != 0) {
+        std::string config, policy_name, prefetch, ifetch, write, latency;
+        replacement_policy policy;
+        ar.io(config);
+        ar.io(policy_name);
+        uint8_t classify = 0, corrected = 0;
+        ar.io(prefetch);
+        ar.io(ifetch);
+        ar.io(write);
+        ar.io(latency);
+        ar.io(classify);
+        ar.io(corrected);
+        saved_caches.set_classify_misses(classify != 0);
+        saved_caches.set_corrected(corrected != 0);
+        ok = ar.ok() && parse_policy(policy_name, policy) && saved_caches.set_prefetch(prefetch) &&
+            saved_caches.set_ifetch(ifetch) && saved_caches.set_write(write) && saved_caches.set_latency(latency) &&
+            saved_caches.configure(config, policy);
+        if (ok) {
+            saved_caches.serialize(ar);
+            ok = ar.ok();
+        }
+    }
+    fclose(in);
+    if (!ok) {
+        error = std::string("Not a checkpoint file: ") + path;
+        return false;
+    }
+
+    machine = std::move(saved);
+    if (caches != nullptr)
+        *caches = std::move(saved_caches);
+    return true;
+}
+
+#endif
@@ -0,0 +1,198 @@
+/*
+classify.h
+Sorts the misses of a cache level into compulsory, capacity and conflict
+misses (the three Cs) with a first-touch bitmap and a shadow fully
+associative LRU cache of the same capacity
+*/
+
+#ifndef CLASSIFY_H
+#define CLASSIFY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "sparse.h"
+
+//What kind of miss a miss was:
+//  compulsory  the level had never seen the block
+//  capacity    a fully associative LRU cache of the same size would have missed too
+//  conflict    it would have hit: the block was lost to the mapping of blocks to rows
+enum miss_class : uint8_t { MISS_COMPULSORY = 0, MISS_CAPACITY = 1, MISS_CONFLICT = 2 };
+
+//A fully associative LRU cache of blocks in which every operation takes constant time. The blocks
+//live in a fixed array of nodes, threaded into a doubly linked list from the most to the least
+//recently used, and an open-addressing hash table with linear probing maps a block to its node.
+//The table is kept at most half full, and an evicted block's entry is removed by shifting the
+//entries after it back, so lookups never wade through deleted markers.
+class shadow_lru
+{
+public:
+    /*
+        Empties the cache and sizes it.
+
+        @param capacity The number of blocks it holds, at least 1
+    */
+    void init(uint32_t capacity) {
+        size_t size = 2;
+        while (size < 2 * static_cast<size_t>(capacity))
+            size *= 2;
+        table.assign(size, 0);
+        mask = size - 1;
+        blocks.assign(capacity, 0);
+        prev.assign(capacity, NONE);
+        next.assign(capacity, NONE);
+        head = tail = NONE;
+        used = 0;
+    }
+
+    /*
+        Accesses a block: makes it the most recently used, bringing it in in
+        place of the least recently used one on a miss.
+
+        @return true if the cache held the block
+    */
+    bool access(uint32_t block) {
+        size_t pos = find(block);
+        if (table[pos] != 0) {
+            uint32_t node = table[pos] - 1;
+            if (node != head) {
+                unlink(node);
+                push_front(node);
+            }
+            return true;
+        }
+        uint32_t node;
+        if (used < blocks.size()) {
+            node = used++;
+        } else {
+            node = tail;
+            unlink(node);
+            erase(find(blocks[node]));
+            pos = find(block);
+        }
+        blocks[node] = block;
+        table[pos] = node + 1;
+        push_front(node);
+        return false;
+    }
+
+    //Passes the contents through a checkpoint archive (see checkpoint.h). The cache must already
+    //have the capacity that was saved.
+    template <class Archive>
+    void serialize(Archive &ar) {
+        ar.io(table);
+        ar.io(blocks);
+        ar.io(prev);
+        ar.io(next);
+        ar.io(head);
+        ar.io(tail);
+        ar.io(used);
+    }
+
+private:
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    //Node + 1 for each slot, 0 if the slot is empty
+    std::vector<uint32_t> table;
+    size_t mask = 0;
+
+    std::vector<uint32_t> blocks, prev, next;
+    uint32_t head = NONE, tail = NONE, used = 0;
+
+    size_t home(uint32_t block) const { return (block * 0x9E3779B1u) & mask; }
+
+    //The slot holding block, or the empty slot where it would go
+    size_t find(uint32_t block) const {
+        size_t pos = home(block);
+        while (table[pos] != 0 && blocks[table[pos] - 1] != block)
+            pos = (pos + 1) & mask;
+        return pos;
+    }
+
+    //Empties a slot, moving later entries of the same probe run back so every entry stays
+    //reachable from its home slot
+    void erase(size_t pos) {
+        size_t gap = pos;
+        for (size_t p = (pos + 1) & mask; table[p] != 0; p = (p + 1) & mask) {
+            size_t h = home(blocks[table[p] - 1]);
+            //The entry can fill the gap unless its home lies after the gap, up to where it sits
+            if (((p - h) & mask) >= ((p - gap) & mask)) {
+                table[gap] = table[p];
+                gap = p;
+            }
+        }
+        table[gap] = 0;
+    }
+
+    void unlink(uint32_t node) {
+        if (prev[node] != NONE)
+            next[prev[node]] = next[node];
+        else
+            head = next[node];
+        if (next[node] != NONE)
+            prev[next[node]] = prev[node];
+        else
+            tail = prev[node];
+    }
+
+    void push_front(uint32_t node) {
+        prev[node] = NONE;
+        next[node] = head;
+        if (head != NONE)
+            prev[head] = node;
+        head = node;
+        if (tail == NONE)
+            tail = node;
+    }
+};
+
+//Classifies the misses of one cache level. It must see every demand access to the level, hits
+//included, so the shadow cache's LRU order follows the real one's accesses.
+struct miss_classifier
+{
+    bool enabled = false;
+
+    //One bit per block the level has been asked for, 64 blocks to an entry
+    sparse_array<uint64_t> touched;
+    shadow_lru shadow;
+
+    bool on() const { return enabled; }
+
+    /*
+        Turns classification on, for a level of the given number of blocks,
+        or off, and forgets every block seen so far.
+    */
+    void init(bool on, uint32_t capacity) {
+        enabled = on;
+        touched.clear();
+        shadow.init(on ? capacity : 1);
+    }
+
+    /*
+        Records a demand access to a block.
+
+        @param hit Whether the real level held the block
+
+        @return The class of the miss if it missed; meaningless for a hit
+    */
+    miss_class access(uint32_t block, bool hit) {
+        uint64_t &word = touched.at(block >> 6);
+        uint64_t bit = uint64_t(1) << (block & 63);
+        bool first = (word & bit) == 0;
+        word |= bit;
+        bool shadow_hit = shadow.access(block);
+        if (hit)
+            return MISS_CONFLICT;
+        return first ? MISS_COMPULSORY : shadow_hit ? MISS_CONFLICT : MISS_CAPACITY;
+    }
+
+    //Passes the bitmap and shadow cache through a checkpoint archive (see checkpoint.h)
+    template <class Archive>
+    void serialize(Archive &ar) {
+        touched.serialize(ar);
+        shadow.serialize(ar);
+    }
+};
+
+#endif
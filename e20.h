@@ -0,0 +1,403 @@
+/*
+e20.h
+The E20 processor: machine constants and the instruction interpreter
+*/
+
+#ifndef E20_H
+#define E20_H
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "sparse.h"
+
+//Some helpful constant values that we'll be using.
+size_t const static NUM_REGS = 8;
+size_t const static MEM_SIZE = 1<<13;
+
+//Every distinct behavior an E20 instruction word can have. Words that don't
+//encode a valid instruction (an unknown 3-register function code, or a jr
+//or bank with bits 9 to 4 set) decode to OP_NOP, which only advances the pc.
+enum e20_op : uint8_t {
+    OP_ADD, OP_SUB, OP_OR, OP_AND, OP_SLT, OP_JR, OP_BANK, OP_NOP,
+    OP_J, OP_JAL,
+    OP_ADDI, OP_LW, OP_SW, OP_JEQ, OP_SLTI,
+    NUM_E20_OPS
+};
+
+//One predecoded instruction. Register fields are register numbers; imm is
+//already sign extended for the 7-bit forms.
+struct decoded_instr
+{
+    e20_op op;
+    uint8_t regA;
+    uint8_t regB;
+    uint8_t regDst;
+    uint16_t imm;
+};
+
+/*
+    Decodes one E20 instruction word.
+
+    @param word The 16-bit instruction
+
+    @return The decoded instruction
+*/
+inline decoded_instr decode_e20(uint16_t word) {
+    decoded_instr in;
+    uint16_t opcode = word >> 13;
+    in.regA = (word & 0b0001110000000000) >> 10;
+    in.regB = (word & 0b0000001110000000) >> 7;
+    in.regDst = (word & 0b0000000001110000) >> 4;
+    in.imm = 0;
+
+    //Instructions With Three Register Arguments, differentiated by their last four bits
+    if (opcode == 0b000) {
+        switch (word & 0b1111) {
+            case 0b0000: in.op = OP_ADD; break;
+            case 0b0001: in.op = OP_SUB; break;
+            case 0b0010: in.op = OP_OR; break;
+            case 0b0011: in.op = OP_AND; break;
+            case 0b0100: in.op = OP_SLT; break;
+            //jr only counts if bits 9 to 4 are 0, in case an invalid instruction was created using store word
+            case 0b1000: in.op = (word & 0b0000001111110000) == 0 ? OP_JR : OP_NOP; break;
+            //bank is an extension for the wide address mode, encoded like jr
+            case 0b1001: in.op = (word & 0b0000001111110000) == 0 ? OP_BANK : OP_NOP; break;
+            default: in.op = OP_NOP; break;
+        }
+        return in;
+    }
+
+    //Instructions With No Register Arguments take a 13-bit immediate
+    if (opcode == 0b010 || opcode == 0b011) {
+        in.op = opcode == 0b010 ? OP_J : OP_JAL;
+        in.imm = word & 0b0001111111111111;
+        return in;
+    }
+
+    //Instructions With Two Register Arguments take a sign extended 7-bit immediate
+    in.imm = word & 0b0000000001111111;
+    if ((in.imm & 0b1000000) == 0b1000000)
+        in.imm = in.imm ^ 0b1111111110000000;
+    switch (opcode) {
+        case 0b001: in.op = OP_ADDI; break;
+        case 0b100: in.op = OP_LW; break;
+        case 0b101: in.op = OP_SW; break;
+        case 0b110: in.op = OP_JEQ; break;
+        default: in.op = OP_SLTI; break;
+    }
+    return in;
+}
+
+//GCC and Clang dispatch with computed goto (one indirect jump per instruction, from the
+//end of each handler); other compilers fall back to a switch
+#if defined(__GNUC__) && !defined(E20_NO_COMPUTED_GOTO)
+#define E20_COMPUTED_GOTO 1
+#endif
+
+//The processor state that lasts between calls to resume_e20: everything but memory.
+//Everything is uint16_t to let overflow wrap around
+struct e20_state
+{
+    uint16_t pc = 0;
+
+    //Register fields are three bits wide, so these are all the registers a program can name
+    uint16_t regs[NUM_REGS] = {};
+
+    //The high half of lw and sw addresses in the wide address mode, set by bank
+    uint16_t bank = 0;
+
+    //Instructions executed so far
+    uint64_t clock_cycle = 0;
+
+    //Set once the program executes its halt
+    bool halted = false;
+
+    //How a lw whose address register is also its destination reaches the hook. The original
+    //simulator formed the address again after the load, from the loaded value; the corrected model
+    //reports the cell the lw read. Kept by start_e20.
+    bool corrected_lw = false;
+
+    //One predecoded instruction per memory cell. A sw re-decodes the cell it writes, so
+    //self-modifying programs see their new instructions.
+    std::vector<decoded_instr> code;
+};
+
+//An interpreter hook that ignores memory accesses
+struct no_hook
+{
+    void load(unsigned, unsigned, uint64_t) {}
+    void store(unsigned, unsigned, uint64_t) {}
+};
+
+//A hook with a fetch(pc, clock_cycle) member also sees every instruction fetch: resume_e20 calls it
+//with the address of each instruction before executing it. Hooks without one (no_hook above, say)
+//compile to an interpreter that doesn't make the call at all.
+template <class Hook, class = void>
+struct hook_fetches : std::false_type {};
+
+template <class Hook>
+struct hook_fetches<Hook, std::void_t<decltype(std::declval<Hook &>().fetch(0u, uint64_t()))>> : std::true_type {};
+
+//The memory the E20 specifies: MEM_SIZE cells, with lw and sw addresses wrapping around it.
+//bank has no effect.
+struct flat_memory
+{
+    uint16_t *cells;
+
+    uint32_t address(uint16_t, uint16_t offset) const { return offset % MEM_SIZE; }
+    uint16_t read(uint32_t addr) const { return cells[addr]; }
+    void write(uint32_t addr, uint16_t value) { cells[addr] = value; }
+    static bool holds_code(uint32_t) { return true; }
+};
+
+//The wide address mode: lw and sw reach bank << 16 | (register A + immediate), a 32-bit word
+//address. The first MEM_SIZE cells are the flat memory the program is loaded into and runs
+//from; the cells above them are kept in a sparse_array (see sparse.h) and read 0 until written.
+struct wide_memory
+{
+    uint16_t *cells;
+    sparse_array<uint16_t> *pages;
+
+    uint32_t address(uint16_t bank, uint16_t offset) const { return static_cast<uint32_t>(bank) << 16 | offset; }
+    uint16_t read(uint32_t addr) const { return addr < MEM_SIZE ? cells[addr] : pages->get(addr); }
+    void write(uint32_t addr, uint16_t value) {
+        if (addr < MEM_SIZE)
+            cells[addr] = value;
+        else
+            pages->at(addr) = value;
+    }
+    static bool holds_code(uint32_t addr) { return addr < MEM_SIZE; }
+};
+
+//resume_e20 takes a plain array of MEM_SIZE cells as flat memory, or one of the structs above
+inline flat_memory e20_memory(uint16_t *cells) { return flat_memory{cells}; }
+
+template <class Memory>
+Memory e20_memory(Memory memory) { return memory; }
+
+/*
+    Resets the processor to power-on and predecodes all of memory.
+
+    @param memory The E20 memory, already holding the program
+
+    @param state The processor state to reset
+*/
+inline void start_e20(const uint16_t memory[], e20_state &state) {
+    bool corrected_lw = state.corrected_lw;
+    state = e20_state();
+    state.corrected_lw = corrected_lw;
+    state.code.resize(MEM_SIZE);
+    for (size_t i = 0; i < MEM_SIZE; i++)
+        state.code[i] = decode_e20(memory[i]);
+}
+
+/*
+    Runs an E20 program from where state left off until it halts (a j
+    instruction that jumps to itself) or, if Bounded, until it has executed
+    max_cycles more instructions.
+
+    Every lw and sw is reported to the hook after memory has been read or
+    written, through hook.load(pc, addr, clock_cycle) and
+    hook.store(pc, addr, clock_cycle), and every instruction fetch, if the
+    hook has a fetch (see hook_fetches), through hook.fetch(pc, clock_cycle)
+    before the instruction executes. The hook is a template parameter so
+    the calls are inlined into the loop. Unbounded runs don't check a budget
+    between instructions.
+
+    @param memory The E20 memory the state was started on: its MEM_SIZE
+        cells, or a flat_memory or wide_memory over them
+
+    @param state The processor state, updated when the call returns
+
+    @param hook Receives the program's memory accesses
+
+    @param max_cycles The most instructions to execute, if Bounded
+
+    @return The number of clock cycles (instructions) executed by this call
+*/
+template <bool Bounded, class Memory, class Hook>
+uint64_t resume_e20(Memory memory, e20_state &state, Hook &hook, uint64_t max_cycles = 0) {
+    if (state.halted || (Bounded && max_cycles == 0))
+        return 0;
+    auto mem = e20_memory(memory);
+
+    //Works on local copies of the registers, so the compiler knows a store to memory can't change them
+    uint16_t pc = state.pc;
+    uint16_t regs[NUM_REGS];
+    for (size_t i = 0; i < NUM_REGS; i++)
+        regs[i] = state.regs[i];
+    uint16_t bank = state.bank;
+    const bool corrected_lw = state.corrected_lw;
+    decoded_instr *code = state.code.data();
+
+    //A variable that keeps track of the clock cycle. Is useful for knowing which block is the least recently used.
+    uint64_t clock_cycle = state.clock_cycle;
+    const uint64_t start_cycle = clock_cycle;
+    const uint64_t stop_cycle = start_cycle + max_cycles;
+
+    const decoded_instr *in;
+
+    //Reports the fetch of the instruction at pc to a hook that wants it
+#define E20_FETCH() do { if constexpr (hook_fetches<Hook>::value) hook.fetch(pc % MEM_SIZE, clock_cycle); } while (0)
+
+#ifdef E20_COMPUTED_GOTO
+    //Indexed by e20_op
+    static void *const handlers[NUM_E20_OPS] = {
+        &&op_add, &&op_sub, &&op_or, &&op_and, &&op_slt, &&op_jr, &&op_bank, &&op_nop,
+        &&op_j, &&op_jal,
+        &&op_addi, &&op_lw, &&op_sw, &&op_jeq, &&op_slti
+    };
+#define E20_CASE(label, op) label:
+#define E20_NEXT() do { clock_cycle++; regs[0] = 0; if (Bounded && clock_cycle == stop_cycle) goto stop; \
+    in = &code[pc % MEM_SIZE]; E20_FETCH(); goto *handlers[in->op]; } while (0)
+    in = &code[pc % MEM_SIZE];
+    E20_FETCH();
+    goto *handlers[in->op];
+#else
+#define E20_CASE(label, op) case op:
+#define E20_NEXT() goto next_instr
+    for (;;) {
+    in = &code[pc % MEM_SIZE];
+    E20_FETCH();
+    switch (in->op) {
+#endif
+
+    //add, sub, or, and: result goes in the destination register
+    E20_CASE(op_add, OP_ADD)
+        regs[in->regDst] = regs[in->regA] + regs[in->regB];
+        pc += 1;
+        E20_NEXT();
+    E20_CASE(op_sub, OP_SUB)
+        regs[in->regDst] = regs[in->regA] - regs[in->regB];
+        pc += 1;
+        E20_NEXT();
+    E20_CASE(op_or, OP_OR)
+        regs[in->regDst] = regs[in->regA] | regs[in->regB];
+        pc += 1;
+        E20_NEXT();
+    E20_CASE(op_and, OP_AND)
+        regs[in->regDst] = regs[in->regA] & regs[in->regB];
+        pc += 1;
+        E20_NEXT();
+    //slt: the operands are unsigned 16-bit
+    E20_CASE(op_slt, OP_SLT)
+        regs[in->regDst] = (regs[in->regA] < regs[in->regB]);
+        pc += 1;
+        E20_NEXT();
+    //jr: jumps to the memory address in register A
+    E20_CASE(op_jr, OP_JR)
+        pc = regs[in->regA];
+        E20_NEXT();
+    //bank: sets the high half of wide lw and sw addresses to register A
+    E20_CASE(op_bank, OP_BANK)
+        bank = regs[in->regA];
+        pc += 1;
+        E20_NEXT();
+    E20_CASE(op_nop, OP_NOP)
+        pc += 1;
+        E20_NEXT();
+    //j: a jump to itself is a halt
+    E20_CASE(op_j, OP_J)
+        if (in->imm == pc) {
+            clock_cycle++;
+            state.halted = true;
+            goto stop;
+        }
+        pc = in->imm;
+        E20_NEXT();
+    //jal: stores the next memory address in register 7, then jumps
+    E20_CASE(op_jal, OP_JAL)
+        regs[7] = pc + 1;
+        pc = in->imm;
+        E20_NEXT();
+    E20_CASE(op_addi, OP_ADDI)
+        regs[in->regB] = regs[in->regA] + in->imm;
+        pc += 1;
+        E20_NEXT();
+    //lw: loads the memory cell at register A plus the immediate into register B. Unless the model
+    //is corrected, the hook sees the address formed again after the load (see e20_state)
+    E20_CASE(op_lw, OP_LW)
+    {
+        uint32_t addr = mem.address(bank, regs[in->regA] + in->imm);
+        regs[in->regB] = mem.read(addr);
+        if (in->regA == in->regB && !corrected_lw)
+            addr = mem.address(bank, regs[in->regA] + in->imm);
+
+        //Lets the memory system see the load
+        hook.load(pc, addr, clock_cycle);
+        pc += 1;
+        E20_NEXT();
+    }
+    //sw: stores register B at register A plus the immediate, and re-decodes that cell in case it holds code
+    E20_CASE(op_sw, OP_SW)
+    {
+        uint32_t addr = mem.address(bank, regs[in->regA] + in->imm);
+        mem.write(addr, regs[in->regB]);
+        if (mem.holds_code(addr))
+            code[addr] = decode_e20(regs[in->regB]);
+
+        //Lets the memory system see the store
+        hook.store(pc, addr, clock_cycle);
+        pc += 1;
+        E20_NEXT();
+    }
+    //jeq: if registers A and B are equal, jumps to pc + 1 + the immediate
+    E20_CASE(op_jeq, OP_JEQ)
+        if (regs[in->regA] == regs[in->regB])
+            pc = pc + 1 + in->imm;
+        else
+            pc += 1;
+        E20_NEXT();
+    //slti: the comparison is unsigned, against the sign extended immediate
+    E20_CASE(op_slti, OP_SLTI)
+        regs[in->regB] = (regs[in->regA] < in->imm);
+        pc += 1;
+        E20_NEXT();
+
+#ifndef E20_COMPUTED_GOTO
+    default:
+        pc += 1;
+        E20_NEXT();
+    }
+next_instr:
+    //increments clock cycle and resets register 0 to 0
+    clock_cycle++;
+    regs[0] = 0;
+    if (Bounded && clock_cycle == stop_cycle)
+        goto stop;
+    }
+#endif
+#undef E20_CASE
+#undef E20_NEXT
+#undef E20_FETCH
+
+stop:
+    state.pc = pc;
+    for (size_t i = 0; i < NUM_REGS; i++)
+        state.regs[i] = regs[i];
+    state.bank = bank;
+    state.clock_cycle = clock_cycle;
+    return clock_cycle - start_cycle;
+}
+
+/*
+    Runs an E20 program from power-on until it halts.
+
+    @param memory The E20 memory, already holding the program
+
+    @param hook Receives the program's memory accesses, as for resume_e20
+
+    @return The number of clock cycles (instructions) executed
+*/
+template <class Hook>
+uint64_t run_e20(uint16_t memory[], Hook &hook) {
+    e20_state state;
+    start_e20(memory, state);
+    return resume_e20<false>(memory, state, hook);
+}
+
+#endif
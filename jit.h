@@ -0,0 +1,808 @@
+/*
+jit.h
+Translates E20 basic blocks to x86-64 machine code and runs them in place
+of the interpreter in e20.h, with the same results and the same hook calls
+*/
+
+#ifndef JIT_H
+#define JIT_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#include "e20.h"
+
+#if defined(__GNUC__) && defined(__x86_64__) && defined(__unix__)
+#define E20_JIT 1
+#include <sys/mman.h>
+#endif
+
+//What translated code sees of a run, through rbx. The code addresses fields by their offsets.
+struct jit_context
+{
+    uint16_t *regs;
+    uint16_t *memory;
+    decoded_instr *code;
+
+    //Translated code by start address, nullptr where there is none
+    uint8_t *const *entries;
+
+    void *hook;
+    void *engine;
+    void (*load)(jit_context *, unsigned pc, unsigned addr, unsigned back);
+    int (*store)(jit_context *, unsigned pc, unsigned addr, unsigned value, unsigned back);
+    unsigned (*step)(jit_context *, unsigned pc, unsigned back);
+    e20_state *state;
+
+    //Instructions the run may still execute. Every block takes its whole length off as it starts,
+    //and gives back what it didn't execute if it leaves early. Translated code keeps it in r8 and
+    //only stores it here for the helpers and on the way out.
+    uint64_t left;
+
+    //The clock cycle at which left would reach 0, so instruction k of a block of n runs at
+    //clock cycle cycle_base - left - (n - k)
+    uint64_t cycle_base;
+
+    //Where the program continues once translated code returns, and whether it has halted
+    uint32_t pc;
+    uint8_t halted;
+};
+
+//Translated code reaches every field with an 8-bit displacement
+static_assert(sizeof(jit_context) <= 128, "jit_context too large");
+
+//Runs E20 programs by translating each basic block (the instructions up to a j, jal, jeq or jr)
+//to x86-64 the first time it is reached. Blocks whose next block is known jump straight to its
+//translation, and a jr looks its target up, so a loop runs without returning here. A sw that
+//lands on translated code drops the blocks it overlaps.
+//
+//E20 registers 1 to 7, and the budget, live in host registers while translated code runs. Loads
+//are done inline; the hook and stores go through small helpers. Anything a block can't do whole
+//(a pc past the end of memory, the last few instructions of a bounded run) is left to resume_e20,
+//and so are instructions the program keeps rewriting: once a cell has dropped translations a few
+//times, blocks call resume_e20 for that one cell instead of translating it, and stop being dropped.
+class e20_jit
+{
+public:
+    e20_jit() = default;
+    ~e20_jit() { release(); }
+
+    //A copy starts with nothing translated, since translations belong to one machine's memory
+    e20_jit(const e20_jit &other) {
+        if (other.enabled())
+            enable();
+    }
+
+    e20_jit &operator=(const e20_jit &other) {
+        if (this != &other) {
+            release();
+            if (other.enabled())
+                enable();
+        }
+        return *this;
+    }
+
+    //Whether this build can translate to native code
+    static bool supported() {
+#if defined(E20_JIT)
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    /*
+        Allocates the buffer translations go into. It is never writable and
+        executable at once: it is executable, and only made writable (and
+        not executable) while translations are emitted or patched.
+
+        @return false if the JIT isn't supported or the buffer can't be mapped
+    */
+    bool enable() {
+#if defined(E20_JIT)
+        if (buffer != nullptr)
+            return true;
+        void *p = mmap(nullptr, BUFFER_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            return false;
+        buffer = static_cast<uint8_t *>(p);
+        entries.assign(MEM_SIZE, nullptr);
+        lengths.assign(MEM_SIZE, 0);
+        covered.assign(MEM_SIZE, 0);
+        rewrites.assign(MEM_SIZE, 0);
+        hot.assign(MEM_SIZE, 0);
+        incoming.assign(MEM_SIZE, std::vector<uint32_t>());
+        at = buffer;
+        emit_trampoline();
+        code_start = at;
+        if (mprotect(buffer, BUFFER_BYTES, PROT_READ | PROT_EXEC) != 0) {
+            release();
+            return false;
+        }
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    bool enabled() const { return buffer != nullptr; }
+
+    //Drops every translation, for when memory is replaced wholesale
+    void flush() {
+        if (buffer == nullptr)
+            return;
+        std::fill(entries.begin(), entries.end(), nullptr);
+        std::fill(covered.begin(), covered.end(), 0);
+        std::fill(rewrites.begin(), rewrites.end(), 0);
+        std::fill(hot.begin(), hot.end(), 0);
+        for (std::vector<uint32_t> &links_in : incoming)
+            links_in.clear();
+        links.clear();
+        at = code_start;
+    }
+
+    /*
+        Drops the translations of every block holding an address, after the
+        program or its host has written it.
+
+        @return true if any block was dropped
+    */
+    bool invalidate(unsigned addr) {
+        if (buffer == nullptr || covered[addr] == 0)
+            return false;
+        write_access writing(*this);
+        unsigned first = addr >= MAX_BLOCK ? addr - MAX_BLOCK + 1 : 0;
+        for (unsigned s = first; s <= addr; s++) {
+            if (entries[s] != nullptr && s + lengths[s] > addr)
+                drop(s);
+        }
+        //No block holds the cell now, so it can become hot without any covered count going stale
+        if (++rewrites[addr] == HOT_REWRITES)
+            hot[addr] = 1;
+        return true;
+    }
+
+    /*
+        Runs a program as resume_e20 would, with the same results and hook
+        calls. The JIT must be enabled.
+    */
+    template <bool Bounded, class Hook>
+    uint64_t run(uint16_t memory[], e20_state &state, Hook &hook, uint64_t max_cycles = 0) {
+#if defined(E20_JIT)
+        if (state.halted || (Bounded && max_cycles == 0))
+            return 0;
+        const uint64_t start_cycle = state.clock_cycle;
+
+        //Loads are only worth a call when the hook looks at them. Translations also depend on which
+        //address a lw reports (see e20_state), so either change drops them.
+        const bool calls = !std::is_same<Hook, no_hook>::value;
+        if (calls != load_calls || state.corrected_lw != corrected_lw) {
+            flush();
+            load_calls = calls;
+            corrected_lw = state.corrected_lw;
+        }
+
+        block_code = state.code.data();
+        jit_context ctx;
+        ctx.regs = state.regs;
+        ctx.memory = memory;
+        ctx.code = state.code.data();
+        ctx.entries = entries.data();
+        ctx.hook = &hook;
+        ctx.engine = this;
+        ctx.load = &call_load<Hook>;
+        ctx.store = &call_store<Hook>;
+        ctx.step = &call_step<Hook>;
+        ctx.state = &state;
+
+        uint64_t left = Bounded ? max_cycles : UNBOUNDED;
+        while (!state.halted && left > 0) {
+            uint8_t *entry = state.pc < MEM_SIZE ? find(state.pc) : nullptr;
+            if (entry == nullptr || left < lengths[state.pc]) {
+                watched_hook<Hook> watched{*this, hook};
+                left -= resume_e20<true>(memory, state, watched, entry == nullptr ? 1 : left);
+                continue;
+            }
+            ctx.left = left;
+            ctx.cycle_base = state.clock_cycle + left;
+            ctx.pc = state.pc;
+            ctx.halted = 0;
+            reinterpret_cast<void (*)(jit_context *, const uint8_t *)>(buffer)(&ctx, entry);
+            //Hot cells run through state, so it is only brought up to date here
+            state.clock_cycle = ctx.cycle_base - ctx.left;
+            left = ctx.left;
+            state.pc = static_cast<uint16_t>(ctx.pc);
+            state.halted = ctx.halted != 0;
+        }
+        return state.clock_cycle - start_cycle;
+#else
+        return resume_e20<Bounded>(memory, state, hook, max_cycles);
+#endif
+    }
+
+private:
+    //Longest block, in instructions; a longer run of straight-line code is split
+    static const unsigned MAX_BLOCK = 64;
+
+    //Room one block's code and exits can take: a sw, the longest instruction, is under 80 bytes
+    static const size_t MAX_BLOCK_BYTES = 8192;
+
+    //Size of the executable buffer; when it fills up, every translation is dropped
+    static const size_t BUFFER_BYTES = 4 << 20;
+
+    //Translations a cell may drop before it is run through resume_e20 instead
+    static const uint8_t HOT_REWRITES = 4;
+
+    //The budget of an unbounded run, which it never uses up
+    static const uint64_t UNBOUNDED = uint64_t(1) << 62;
+
+    //x86-64 register numbers
+    enum { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+
+    //Condition codes for jcc
+    enum { CC_B = 2, CC_AE = 3, CC_E = 4, CC_NE = 5 };
+
+    //Host registers of E20 registers 1 to 7; register 0 reads as zero and is never written.
+    //rbp and r12-r15 survive calls, r10 and r11 are saved around them.
+    static constexpr uint8_t HOST[NUM_REGS] = {0, RBP, R12, R13, R14, R15, R10, R11};
+
+    //A jump from a block to another's start, pointed at its exit stub until that block is translated
+    struct link
+    {
+        uint8_t *site;
+        uint8_t *stub;
+    };
+
+    //A way out of the block being translated, emitted after its body. A dynamic exit goes to the
+    //pc in eax rather than target.
+    struct block_exit
+    {
+        uint8_t *site;
+        uint32_t target;
+        uint32_t refund;
+        bool chain;
+        bool dynamic;
+    };
+
+    uint8_t *buffer = nullptr;
+    uint8_t *code_start = nullptr;
+    uint8_t *at = nullptr;
+    uint8_t *epilogue = nullptr;
+    bool load_calls = false;
+    bool corrected_lw = false;
+
+    //The predecoded memory of the run being translated
+    const decoded_instr *block_code = nullptr;
+
+    std::vector<uint8_t *> entries;
+    std::vector<uint16_t> lengths;
+
+    //How many translated blocks hold each address. Hot cells aren't counted, since blocks don't
+    //depend on what they hold.
+    std::vector<uint8_t> covered;
+
+    //Translations each cell has dropped, and whether it has dropped HOT_REWRITES
+    std::vector<uint8_t> rewrites;
+    std::vector<uint8_t> hot;
+
+    //Blocks dropped so far, so a helper can tell whether the block that called it still stands
+    uint64_t drops = 0;
+
+    //Links into each start address, as indices into links
+    std::vector<std::vector<uint32_t>> incoming;
+    std::vector<link> links;
+    std::vector<block_exit> exits;
+
+    //Blocks being emitted or patched, for write_access
+    unsigned writers = 0;
+
+    //Makes the buffer writable, and not executable, for as long as any write_access lives. A helper
+    //that patches code returns into translated code, so the buffer is executable again by then.
+    struct write_access
+    {
+        e20_jit &jit;
+
+        explicit write_access(e20_jit &j) : jit(j) {
+            if (jit.writers++ == 0)
+                jit.protect(true);
+        }
+
+        ~write_access() {
+            if (--jit.writers == 0)
+                jit.protect(false);
+        }
+    };
+
+    //Makes the buffer writable or executable. Translated code can neither be written nor run
+    //without the protection it asks for, so failing to get it is fatal.
+    void protect(bool writable) {
+#if defined(E20_JIT)
+        if (mprotect(buffer, BUFFER_BYTES, writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC) != 0)
+            abort();
+#else
+        (void)writable;
+#endif
+    }
+
+    void release() {
+#if defined(E20_JIT)
+        if (buffer != nullptr)
+            munmap(buffer, BUFFER_BYTES);
+#endif
+        buffer = nullptr;
+    }
+
+    //The hook resume_e20 gets for the instructions run outside translated code, which drops
+    //whatever translations their stores overwrite
+    template <class Hook>
+    struct watched_hook
+    {
+        e20_jit &jit;
+        Hook &hook;
+
+        void load(unsigned pc, unsigned addr, uint64_t clock_cycle) { hook.load(pc, addr, clock_cycle); }
+
+        void store(unsigned pc, unsigned addr, uint64_t clock_cycle) {
+            jit.invalidate(addr);
+            hook.store(pc, addr, clock_cycle);
+        }
+    };
+
+    template <class Hook>
+    static void call_load(jit_context *ctx, unsigned pc, unsigned addr, unsigned back) {
+        static_cast<Hook *>(ctx->hook)->load(pc, addr, ctx->cycle_base - ctx->left - back);
+    }
+
+    //Does a sw's write the way resume_e20 does. Returns nonzero if it overwrote translated code,
+    //so the running block must stop.
+    template <class Hook>
+    static int call_store(jit_context *ctx, unsigned pc, unsigned addr, unsigned value, unsigned back) {
+        bool stale = false;
+        //Storing the value a cell already holds leaves its instruction as it was
+        if (ctx->memory[addr] != value) {
+            ctx->memory[addr] = static_cast<uint16_t>(value);
+            ctx->code[addr] = decode_e20(static_cast<uint16_t>(value));
+            stale = static_cast<e20_jit *>(ctx->engine)->invalidate(addr);
+        }
+        static_cast<Hook *>(ctx->hook)->store(pc, addr, ctx->cycle_base - ctx->left - back);
+        return stale;
+    }
+
+    //Runs the instruction a hot cell holds now through resume_e20, with the registers already
+    //spilled to ctx->regs. Returns the next pc, plus 0x10000 if translations were dropped, so the
+    //block only carries on when the pc is the next cell.
+    template <class Hook>
+    static unsigned call_step(jit_context *ctx, unsigned pc, unsigned back) {
+        e20_jit &jit = *static_cast<e20_jit *>(ctx->engine);
+        e20_state &state = *ctx->state;
+        uint64_t drops = jit.drops;
+        state.pc = static_cast<uint16_t>(pc);
+        state.clock_cycle = ctx->cycle_base - ctx->left - back;
+        watched_hook<Hook> watched{jit, *static_cast<Hook *>(ctx->hook)};
+        resume_e20<true>(ctx->memory, state, watched, 1);
+        ctx->halted = state.halted;
+        return state.pc | (jit.drops != drops ? 0x10000 : 0);
+    }
+
+    uint8_t *find(unsigned pc) {
+        if (entries[pc] == nullptr)
+            translate(pc);
+        return entries[pc];
+    }
+
+    void drop(unsigned start) {
+        for (unsigned a = start; a < start + lengths[start]; a++) {
+            if (!hot[a])
+                covered[a]--;
+        }
+        entries[start] = nullptr;
+        drops++;
+        for (uint32_t l : incoming[start])
+            patch(links[l].site, links[l].stub);
+    }
+
+    static bool ends_block(e20_op op) { return op == OP_J || op == OP_JAL || op == OP_JEQ || op == OP_JR; }
+
+    //Emitting
+
+    void byte(uint8_t b) { *at++ = b; }
+
+    void imm32(uint32_t v) {
+        memcpy(at, &v, 4);
+        at += 4;
+    }
+
+    //A REX prefix, if the operands need one
+    void rex(bool w, unsigned reg, unsigned rm) {
+        uint8_t r = 0x40 | (w << 3) | ((reg >> 3) << 2) | (rm >> 3);
+        if (r != 0x40)
+            byte(r);
+    }
+
+    void modrm_reg(unsigned reg, unsigned rm) { byte(0xc0 | ((reg & 7) << 3) | (rm & 7)); }
+
+    //A ModRM for [rbx + offset], a field of the jit_context
+    void modrm_ctx(unsigned reg, size_t offset) {
+        byte(0x40 | ((reg & 7) << 3) | RBX);
+        byte(static_cast<uint8_t>(offset));
+    }
+
+    static void patch(uint8_t *site, const uint8_t *target) {
+        int32_t rel = static_cast<int32_t>(target - (site + 4));
+        memcpy(site, &rel, 4);
+    }
+
+    //jmp rel32 or jcc rel32, returning where the displacement goes
+    uint8_t *jump() {
+        byte(0xe9);
+        at += 4;
+        return at - 4;
+    }
+
+    uint8_t *jump_if(unsigned cc) {
+        byte(0x0f);
+        byte(0x80 | cc);
+        at += 4;
+        return at - 4;
+    }
+
+    //op dst, src on 32-bit registers, for the ALU opcodes that take r/m32, r32
+    void alu(uint8_t op, unsigned dst, unsigned src) {
+        rex(false, src, dst);
+        byte(op);
+        modrm_reg(src, dst);
+    }
+
+    //mov scratch, E20 register (xor for register 0)
+    void get(unsigned scratch, unsigned r) {
+        if (r == 0)
+            alu(0x31, scratch, scratch);
+        else
+            alu(0x89, scratch, HOST[r]);
+    }
+
+    //mov E20 register, scratch, for a value already below 0x10000. Writes to register 0 are dropped.
+    void set(unsigned r, unsigned scratch) {
+        if (r != 0)
+            alu(0x89, HOST[r], scratch);
+    }
+
+    //movzx E20 register, scratch (16-bit), wrapping a sum around
+    void set_wrapped(unsigned r, unsigned scratch) {
+        if (r == 0)
+            return;
+        rex(false, HOST[r], scratch);
+        byte(0x0f);
+        byte(0xb7);
+        modrm_reg(HOST[r], scratch);
+    }
+
+    //eax = 1 if the flags say below, else 0, for slt and slti. eax must have been cleared before the compare.
+    void set_below() {
+        byte(0x0f); byte(0x92); byte(0xc0);                 //setb al
+    }
+
+    //mov reg32, imm32
+    void mov_imm(unsigned reg, uint32_t v) {
+        rex(false, 0, reg);
+        byte(0xb8 + (reg & 7));
+        imm32(v);
+    }
+
+    //eax = (E20 register + imm) % MEM_SIZE
+    void address(unsigned r, uint16_t imm) {
+        get(RAX, r);
+        offset_address(imm);
+    }
+
+    //eax = (eax + imm) % MEM_SIZE
+    void offset_address(uint16_t imm) {
+        if (imm != 0) {
+            byte(0x05);
+            imm32(imm);
+        }
+        byte(0x25);
+        imm32(MEM_SIZE - 1);
+    }
+
+    //mov [rbx + left], r8 and back, around helper calls
+    void save_left() {
+        rex(true, R8, RBX);
+        byte(0x89);
+        modrm_ctx(R8, offsetof(jit_context, left));
+    }
+
+    void load_left() {
+        rex(true, R8, RBX);
+        byte(0x8b);
+        modrm_ctx(R8, offsetof(jit_context, left));
+    }
+
+    //add or sub r8, n
+    void adjust_left(unsigned op, uint32_t n) {
+        rex(true, 0, R8);
+        if (n < 128) {
+            byte(0x83);
+            modrm_reg(op, R8);
+            byte(static_cast<uint8_t>(n));
+        } else {
+            byte(0x81);
+            modrm_reg(op, R8);
+            imm32(n);
+        }
+    }
+
+    //Calls a jit_context helper with rdi = ctx and esi = pc, keeping r10 and r11. The budget must
+    //have been saved with save_left; it is reloaded after.
+    void call(size_t helper, unsigned pc) {
+        mov_imm(RSI, pc);
+        byte(0x48); byte(0x89); byte(0xdf);         //mov rdi, rbx
+        byte(0x41); byte(0x52);                     //push r10
+        byte(0x41); byte(0x53);                     //push r11
+        byte(0xff); modrm_ctx(2, helper);           //call [rbx + helper]
+        byte(0x41); byte(0x5b);                     //pop r11
+        byte(0x41); byte(0x5a);                     //pop r10
+        load_left();
+    }
+
+    void add_exit(uint8_t *site, uint32_t target, uint32_t refund, bool chain) {
+        exits.push_back({site, target, refund, chain && target < MEM_SIZE, false});
+    }
+
+    void add_dynamic_exit(uint8_t *site, uint32_t refund) { exits.push_back({site, 0, refund, false, true}); }
+
+    //Copies E20 registers 1 to 7 between the host registers and the array base points to
+    void spill(unsigned base) {
+        for (unsigned r = 1; r < NUM_REGS; r++) {
+            byte(0x66);                                   //mov word [base + 2r], host
+            rex(false, HOST[r], base);
+            byte(0x89);
+            byte(0x40 | ((HOST[r] & 7) << 3) | base);
+            byte(2 * r);
+        }
+    }
+
+    void reload(unsigned base) {
+        for (unsigned r = 1; r < NUM_REGS; r++) {
+            rex(false, HOST[r], base);                    //movzx host, word [base + 2r]
+            byte(0x0f);
+            byte(0xb7);
+            byte(0x40 | ((HOST[r] & 7) << 3) | base);
+            byte(2 * r);
+        }
+    }
+
+    //The code translated blocks run inside: enter(ctx, entry) saves the host's registers, loads the
+    //E20 ones and jumps to entry; blocks leave through the epilogue, which undoes it
+    void emit_trampoline() {
+        static const uint8_t saves[] = {RBX, RBP, R12, R13, R14, R15};
+        for (uint8_t r : saves) {
+            rex(false, 0, r);
+            byte(0x50 + (r & 7));
+        }
+        byte(0x48); byte(0x83); byte(0xec); byte(0x08);   //sub rsp, 8, to keep calls 16-byte aligned
+        byte(0x48); byte(0x89); byte(0xfb);               //mov rbx, rdi
+        load_left();
+        byte(0x48); byte(0x8b); modrm_ctx(RAX, offsetof(jit_context, regs));
+        reload(RAX);
+        byte(0xff); byte(0xe6);                           //jmp rsi
+
+        epilogue = at;
+        save_left();
+        byte(0x48); byte(0x8b); modrm_ctx(RAX, offsetof(jit_context, regs));
+        spill(RAX);
+        byte(0x48); byte(0x83); byte(0xc4); byte(0x08);   //add rsp, 8
+        for (int i = 5; i >= 0; i--) {
+            rex(false, 0, saves[i]);
+            byte(0x58 + (saves[i] & 7));
+        }
+        byte(0xc3);
+    }
+
+    //Translates the block starting at start and links it to the blocks around it
+    void translate(unsigned start) {
+        write_access writing(*this);
+        if (static_cast<size_t>(buffer + BUFFER_BYTES - at) < MAX_BLOCK_BYTES)
+            flush();
+        unsigned n = 0;
+        while (true) {
+            n++;
+            unsigned pc = start + n - 1;
+            if ((ends_block(block_code[pc].op) && !hot[pc]) || n == MAX_BLOCK || start + n == MEM_SIZE)
+                break;
+        }
+        uint8_t *entry = at;
+        exits.clear();
+
+        //sub r8, n, bailing out to the caller if the budget can't cover the block
+        adjust_left(5, n);
+        add_exit(jump_if(CC_B), start, n, false);
+
+        bool falls_through = true;
+        for (unsigned k = 0; k < n; k++) {
+            const unsigned pc = start + k;
+            const unsigned back = n - k;
+            const decoded_instr &in = block_code[pc];
+            if (hot[pc] || in.op == OP_BANK) {
+                //Whatever the cell holds when the block gets there. bank runs here too: the bank
+                //lives in the e20_state, which only the interpreter updates
+                save_left();
+                byte(0x48); byte(0x8b); modrm_ctx(RAX, offsetof(jit_context, regs));
+                spill(RAX);
+                mov_imm(RDX, back);
+                mov_imm(RSI, pc);
+                byte(0x48); byte(0x89); byte(0xdf);         //mov rdi, rbx
+                byte(0xff); modrm_ctx(2, offsetof(jit_context, step));
+                byte(0x48); byte(0x8b); modrm_ctx(RCX, offsetof(jit_context, regs));
+                reload(RCX);
+                load_left();
+                byte(0x3d); imm32(pc + 1);                  //cmp eax, pc + 1
+                add_dynamic_exit(jump_if(CC_NE), back - 1);
+                continue;
+            }
+            switch (in.op) {
+                //Host registers hold E20 registers zero-extended, so only add, sub and addi have to
+                //wrap their results; or, and and the comparisons can work on all 32 bits
+                case OP_ADD: case OP_SUB:
+                    if (in.regDst == 0)
+                        break;
+                    get(RAX, in.regA);
+                    if (in.regB != 0) {
+                        alu(in.op == OP_ADD ? 0x01 : 0x29, RAX, HOST[in.regB]);
+                        set_wrapped(in.regDst, RAX);
+                    } else {
+                        set(in.regDst, RAX);
+                    }
+                    break;
+                case OP_OR: case OP_AND:
+                    if (in.regDst == 0)
+                        break;
+                    get(RAX, in.regA);
+                    get(RCX, in.regB);
+                    alu(in.op == OP_OR ? 0x09 : 0x21, RAX, RCX);
+                    set(in.regDst, RAX);
+                    break;
+                case OP_SLT:
+                    if (in.regDst == 0)
+                        break;
+                    get(RCX, in.regA);
+                    get(RDX, in.regB);
+                    alu(0x31, RAX, RAX);
+                    alu(0x39, RCX, RDX);                            //cmp ecx, edx
+                    set_below();
+                    set(in.regDst, RAX);
+                    break;
+                case OP_ADDI:
+                    if (in.regB == 0)
+                        break;
+                    get(RAX, in.regA);
+                    byte(0x05);
+                    imm32(in.imm);
+                    set_wrapped(in.regB, RAX);
+                    break;
+                case OP_SLTI:
+                    if (in.regB == 0)
+                        break;
+                    get(RCX, in.regA);
+                    alu(0x31, RAX, RAX);
+                    byte(0x81); modrm_reg(7, RCX); imm32(in.imm);  //cmp ecx, imm
+                    set_below();
+                    set(in.regB, RAX);
+                    break;
+                case OP_NOP:
+                    break;
+                case OP_LW:
+                    address(in.regA, in.imm);
+                    byte(0x48); byte(0x8b); modrm_ctx(RDX, offsetof(jit_context, memory));
+                    byte(0x0f); byte(0xb7); byte(0x0c); byte(0x42);   //movzx ecx, word [rdx + rax*2]
+                    set(in.regB, RCX);
+                    if (load_calls) {
+                        if (in.regA == in.regB && !corrected_lw) {
+                            //The address formed again from the loaded value (see e20_state)
+                            alu(0x89, RAX, RCX);                    //mov eax, ecx
+                            offset_address(in.imm);
+                        }
+                        save_left();
+                        byte(0x89); byte(0xc2);                     //mov edx, eax
+                        mov_imm(RCX, back);
+                        call(offsetof(jit_context, load), pc);
+                    }
+                    break;
+                case OP_SW:
+                    address(in.regA, in.imm);
+                    get(RCX, in.regB);
+                    byte(0x89); byte(0xc2);                         //mov edx, eax
+                    save_left();
+                    mov_imm(R8, back);
+                    call(offsetof(jit_context, store), pc);
+                    byte(0x85); byte(0xc0);                         //test eax, eax
+                    add_exit(jump_if(CC_NE), pc + 1, back - 1, false);
+                    break;
+                case OP_J:
+                    falls_through = false;
+                    if (in.imm == pc) {
+                        byte(0xc6); modrm_ctx(0, offsetof(jit_context, halted)); byte(1);
+                        byte(0xc7); modrm_ctx(0, offsetof(jit_context, pc)); imm32(pc);
+                        patch(jump(), epilogue);
+                    } else {
+                        add_exit(jump(), in.imm, 0, true);
+                    }
+                    break;
+                case OP_JAL:
+                    falls_through = false;
+                    mov_imm(HOST[7], pc + 1);
+                    add_exit(jump(), in.imm, 0, true);
+                    break;
+                case OP_JEQ:
+                    falls_through = false;
+                    get(RAX, in.regA);
+                    get(RCX, in.regB);
+                    alu(0x39, RAX, RCX);                            //cmp eax, ecx
+                    add_exit(jump_if(CC_E), static_cast<uint16_t>(pc + 1 + in.imm), 0, true);
+                    add_exit(jump(), pc + 1, 0, true);
+                    break;
+                case OP_JR:
+                {
+                    falls_through = false;
+                    //Jumps straight to the target's translation if it has one
+                    get(RAX, in.regA);
+                    byte(0x3d); imm32(MEM_SIZE);                    //cmp eax, MEM_SIZE
+                    uint8_t *outside = jump_if(CC_AE);
+                    byte(0x48); byte(0x8b); modrm_ctx(RCX, offsetof(jit_context, entries));
+                    byte(0x48); byte(0x8b); byte(0x0c); byte(0xc1); //mov rcx, [rcx + rax*8]
+                    byte(0x48); byte(0x85); byte(0xc9);             //test rcx, rcx
+                    uint8_t *untranslated = jump_if(CC_E);
+                    byte(0xff); byte(0xe1);                         //jmp rcx
+                    add_dynamic_exit(outside, 0);
+                    add_dynamic_exit(untranslated, 0);
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+        if (falls_through)
+            add_exit(jump(), start + n, 0, true);
+
+        //Exit stubs: give back the unexecuted part of the budget, set the pc and leave
+        for (const block_exit &e : exits) {
+            uint8_t *stub = at;
+            if (e.refund != 0)
+                adjust_left(0, e.refund);
+            if (e.dynamic) {
+                byte(0x89); modrm_ctx(RAX, offsetof(jit_context, pc));
+            } else {
+                byte(0xc7); modrm_ctx(0, offsetof(jit_context, pc)); imm32(e.target);
+            }
+            patch(jump(), epilogue);
+            patch(e.site, stub);
+            if (e.chain) {
+                incoming[e.target].push_back(static_cast<uint32_t>(links.size()));
+                links.push_back({e.site, stub});
+            }
+        }
+
+        entries[start] = entry;
+        lengths[start] = n;
+        for (unsigned a = start; a < start + n; a++) {
+            if (!hot[a])
+                covered[a]++;
+        }
+
+        //Chains every jump to this block, including its own, then this block's jumps to blocks
+        //already translated
+        for (uint32_t l : incoming[start])
+            patch(links[l].site, entry);
+        for (const block_exit &e : exits) {
+            if (e.chain && entries[e.target] != nullptr)
+                patch(e.site, entries[e.target]);
+        }
+    }
+};
+
+#endif
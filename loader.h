@@ -0,0 +1,243 @@
+/*
+loader.h
+Loads E20 programs: the ram[N] = 16'b...; text format and the raw
+.e20img binary image
+*/
+
+#ifndef LOADER_H
+#define LOADER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "e20.h"
+
+//Binary image layout, all fields little-endian:
+//  char[8] magic "E20IMG1\n", uint32 number of words, then that many uint16 words for ram[0], ram[1], ...
+static const char IMAGE_MAGIC[8] = {'E', '2', '0', 'I', 'M', 'G', '1', '\n'};
+
+//Whether memory words are already in image byte order, so they can be read and written as they are
+static const bool IMAGE_HOST_ORDER = __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__;
+
+/*
+    Parses one line of the text format, ram[ADDR] = 16'bBITS; followed by
+    anything. Accepts exactly the lines the old ^ram\[(\d+)\] = 16'b(\d+);.*$
+    regex accepted, and reads BITS the way stoi(..., 2) did: the leading 0s
+    and 1s, which must not be empty.
+
+    @param p The first character of the line
+
+    @param end One past its last character, excluding the newline
+
+    @param addr Receives ADDR
+
+    @param instr Receives the instruction word
+
+    @return false if the line doesn't match
+*/
+inline bool parse_machine_code_line(const char *p, const char *end, size_t &addr, uint16_t &instr) {
+    static const char prefix[] = "ram[";
+    static const char middle[] = "] = 16'b";
+    if (end - p < 4 || memcmp(p, prefix, 4) != 0)
+        return false;
+    p += 4;
+
+    const char *digits = p;
+    uint64_t a = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+        a = a * 10 + (*p - '0');
+        //Anything this large can't be a valid address, and stoi would have thrown on it
+        if (a > INT32_MAX)
+            return false;
+        p++;
+    }
+    if (p == digits || end - p < 8 || memcmp(p, middle, 8) != 0)
+        return false;
+    p += 8;
+
+    digits = p;
+    const char *binary_end = nullptr;
+    uint64_t v = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+        if (binary_end == nullptr) {
+            if (*p == '0' || *p == '1') {
+                v = (v << 1) | (*p - '0');
+                if (v > INT32_MAX)
+                    return false;
+            } else {
+                binary_end = p;
+            }
+        }
+        p++;
+    }
+    if (p == digits || binary_end == digits || p == end || *p != ';')
+        return false;
+
+    //The regex's .* doesn't match line terminators
+    for (p++; p < end; p++) {
+        if (*p == '\r')
+            return false;
+    }
+    addr = a;
+    instr = static_cast<uint16_t>(v);
+    return true;
+}
+
+/*
+    Loads an E20 machine code file in text form into mem. The file is
+    mapped into memory and scanned in place.
+
+    @param path The file to read
+
+    @param mem Array representing memory into which to read program
+
+    @param error Receives the error message if loading fails
+
+    @return false if the file can't be read or isn't a valid program
+*/
+inline bool load_machine_code(const char *path, uint16_t mem[], std::string &error) {
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        error = std::string("Can't open file ") + path;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        error = std::string("Can't open file ") + path;
+        return false;
+    }
+    size_t size = st.st_size;
+    if (size == 0) {
+        ::close(fd);
+        return true;
+    }
+    void *map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        error = std::string("Can't open file ") + path;
+        return false;
+    }
+
+    const char *p = static_cast<const char *>(map);
+    const char *end = p + size;
+    size_t expectedaddr = 0;
+    bool ok = true;
+    while (p < end) {
+        const char *eol = static_cast<const char *>(memchr(p, '\n', end - p));
+        if (eol == nullptr)
+            eol = end;
+        size_t addr;
+        uint16_t instr;
+        if (!parse_machine_code_line(p, eol, addr, instr)) {
+            error = "Can't parse line: " + std::string(p, eol);
+            ok = false;
+            break;
+        }
+        if (addr != expectedaddr) {
+            error = "Memory addresses encountered out of sequence: " + std::to_string(addr);
+            ok = false;
+            break;
+        }
+        if (addr >= MEM_SIZE) {
+            error = "Program too big for memory";
+            ok = false;
+            break;
+        }
+        expectedaddr ++;
+        mem[addr] = instr;
+        p = eol + 1;
+    }
+    munmap(map, size);
+    return ok;
+}
+
+/*
+    Loads an E20 program from either format. Files that start with the
+    .e20img magic are read as a binary image with a single read into mem
+    (byte-swapped after on a big-endian host); anything else goes through
+    load_machine_code.
+
+    @param path The file to read
+
+    @param mem Array representing memory into which to read program
+
+    @param error Receives the error message if loading fails
+
+    @return false if the file can't be read or isn't a valid program
+*/
+inline bool load_program(const char *path, uint16_t mem[], std::string &error) {
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        error = std::string("Can't open file ") + path;
+        return false;
+    }
+    char header[12];
+    ssize_t n = read(fd, header, sizeof(header));
+    if (n != static_cast<ssize_t>(sizeof(header)) || memcmp(header, IMAGE_MAGIC, sizeof(IMAGE_MAGIC)) != 0) {
+        ::close(fd);
+        return load_machine_code(path, mem, error);
+    }
+
+    const unsigned char *count = reinterpret_cast<const unsigned char *>(header + 8);
+    uint32_t words = count[0] | count[1] << 8 | count[2] << 16 | static_cast<uint32_t>(count[3]) << 24;
+    if (words > MEM_SIZE) {
+        ::close(fd);
+        error = "Program too big for memory";
+        return false;
+    }
+    ssize_t want = static_cast<ssize_t>(words) * sizeof(uint16_t);
+    n = read(fd, mem, want);
+    ::close(fd);
+    if (n != want) {
+        error = std::string("Truncated image file ") + path;
+        return false;
+    }
+    if (!IMAGE_HOST_ORDER) {
+        for (uint32_t i = 0; i < words; i++)
+            mem[i] = static_cast<uint16_t>(mem[i] >> 8 | mem[i] << 8);
+    }
+    return true;
+}
+
+/*
+    Writes memory as an .e20img binary image. Trailing zero words are left
+    out, since memory starts zeroed when the image is loaded.
+
+    @param path The file to create
+
+    @param mem The memory to save, MEM_SIZE words
+
+    @return false if the file can't be written
+*/
+inline bool write_image(const char *path, const uint16_t mem[]) {
+    uint32_t words = MEM_SIZE;
+    while (words > 0 && mem[words - 1] == 0)
+        words--;
+    unsigned char count[4] = {static_cast<unsigned char>(words), static_cast<unsigned char>(words >> 8),
+        static_cast<unsigned char>(words >> 16), static_cast<unsigned char>(words >> 24)};
+    std::vector<uint16_t> swapped;
+    if (!IMAGE_HOST_ORDER) {
+        for (uint32_t i = 0; i < words; i++)
+            swapped.push_back(static_cast<uint16_t>(mem[i] >> 8 | mem[i] << 8));
+        mem = swapped.data();
+    }
+    FILE *out = fopen(path, "wb");
+    if (out == nullptr)
+        return false;
+    bool ok = fwrite(IMAGE_MAGIC, sizeof(IMAGE_MAGIC), 1, out) == 1 &&
+        fwrite(count, sizeof(count), 1, out) == 1 &&
+        fwrite(mem, sizeof(uint16_t), words, out) == words;
+    return fclose(out) == 0 && ok;
+}
+
+#endif
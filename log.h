@@ -0,0 +1,280 @@
+/*
+log.h
+Buffered event log for the E20 cache simulator
+*/
+
+#ifndef LOG_H
+#define LOG_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+//How cache events are reported.
+//  none     no per-event output, only the cache configuration
+//  summary  the cache configuration followed by per-level totals at the end of the run
+//  text     the cache configuration and one line per event (the default)
+//  binary   a small header followed by one fixed-size record per event
+enum log_mode { LOG_NONE, LOG_SUMMARY, LOG_TEXT, LOG_BINARY };
+
+//The kind of cache event
+enum log_status : uint8_t { LOG_HIT = 0, LOG_MISS = 1, LOG_SW = 2 };
+
+//Binary log layout, all fields little-endian:
+//  header: "E20LOG2\n", uint32 number of levels, then per level uint32 size, associativity, blocksize, rows
+//  record: uint8 level (0 for L1), uint8 status (log_status), uint16 pc, uint32 addr, uint32 row
+static const char LOG_BINARY_MAGIC[8] = {'E', '2', '0', 'L', 'O', 'G', '2', '\n'};
+
+//One record as a struct, for readers on little-endian hosts
+struct log_record
+{
+    uint8_t level;
+    uint8_t status;
+    uint16_t pc;
+    uint32_t addr;
+    uint32_t row;
+};
+
+/*
+    Parses the argument of --log.
+
+    @param name One of "none", "summary", "text" or "binary"
+
+    @param mode Receives the parsed mode
+
+    @return false if name is not a known mode
+*/
+inline bool parse_log_mode(const std::string &name, log_mode &mode) {
+    if (name == "none") mode = LOG_NONE;
+    else if (name == "summary") mode = LOG_SUMMARY;
+    else if (name == "text") mode = LOG_TEXT;
+    else if (name == "binary") mode = LOG_BINARY;
+    else return false;
+    return true;
+}
+
+//Collects cache events into one large reusable buffer and writes it out in big chunks.
+//The text format is byte-for-byte what the original simulator printed; --corrected changes
+//which events there are (see corrected_stores in cache.h), not how they are printed.
+struct event_log
+{
+    log_mode mode;
+    FILE *out;
+    std::vector<char> buf;
+    size_t used = 0;
+
+    //Per-level totals for summary mode, indexed by level then log_status
+    std::vector<uint64_t> counts;
+
+    explicit event_log(log_mode m = LOG_TEXT, FILE *o = stdout, size_t capacity = 1 << 20)
+        : mode(m), out(o), buf(capacity) {}
+
+    ~event_log() { flush(); }
+
+    event_log(const event_log &) = delete;
+    event_log &operator=(const event_log &) = delete;
+
+    //Writes whatever is buffered to the output
+    void flush() {
+        if (used > 0) {
+            fwrite(buf.data(), 1, used, out);
+            used = 0;
+        }
+        fflush(out);
+    }
+
+    //Makes room for at least n more bytes in the buffer
+    char *reserve(size_t n) {
+        if (used + n > buf.size()) {
+            fwrite(buf.data(), 1, used, out);
+            used = 0;
+            if (n > buf.size())
+                buf.resize(n);
+        }
+        return buf.data() + used;
+    }
+
+    void put(const char *s, size_t n) {
+        memcpy(reserve(n), s, n);
+        used += n;
+    }
+
+    void put(const std::string &s) { put(s.data(), s.size()); }
+
+    /*
+        Reports the configuration of one cache level. Must be called for
+        every level, in order, before the first entry.
+
+        @param index The level number, 0 for L1
+
+        @param size The total size of the cache, measured in memory cells.
+            Excludes metadata
+
+        @param assoc The associativity of the cache. One of [1,2,4,8,16]
+
+        @param blocksize The blocksize of the cache. One of [1,2,4,8,16,32,64])
+
+        @param num_rows The number of rows in the given cache.
+    */
+    void config(unsigned index, int size, int assoc, int blocksize, int num_rows) {
+        if (counts.size() < (index + 1) * 3)
+            counts.resize((index + 1) * 3, 0);
+        if (mode == LOG_BINARY) {
+            config_binary.push_back({static_cast<uint32_t>(size), static_cast<uint32_t>(assoc),
+                static_cast<uint32_t>(blocksize), static_cast<uint32_t>(num_rows)});
+            return;
+        }
+        put("Cache L" + std::to_string(index + 1) + " has size " + std::to_string(size) +
+            ", associativity " + std::to_string(assoc) + ", blocksize " + std::to_string(blocksize) +
+            ", rows " + std::to_string(num_rows) + "\n");
+    }
+
+    /*
+        Records one cache event.
+
+        @param index The level where the event occurred, 0 for L1
+
+        @param status The kind of cache event
+
+        @param pc The program counter of the memory
+            access instruction
+
+        @param addr The memory address being accessed.
+
+        @param row The cache row or set number where the data
+            is stored.
+    */
+    inline void entry(unsigned index, log_status status, unsigned pc, unsigned addr, unsigned row) {
+        switch (mode) {
+            case LOG_NONE:
+                break;
+            case LOG_SUMMARY:
+                counts[index * 3 + status]++;
+                break;
+            case LOG_TEXT:
+                entry_text(index, status, pc, addr, row);
+                break;
+            case LOG_BINARY:
+                entry_binary(index, status, pc, addr, row);
+                break;
+        }
+    }
+
+    //Ends the run: writes the summary totals in summary mode and flushes
+    void finish() {
+        if (mode == LOG_BINARY && !header_written)
+            write_binary_header();
+        if (mode == LOG_SUMMARY) {
+            for (size_t i = 0; i * 3 < counts.size(); i++) {
+                put("Cache L" + std::to_string(i + 1) + " hits " + std::to_string(counts[i * 3 + LOG_HIT]) +
+                    ", misses " + std::to_string(counts[i * 3 + LOG_MISS]) +
+                    ", stores " + std::to_string(counts[i * 3 + LOG_SW]) + "\n");
+            }
+        }
+        flush();
+    }
+
+private:
+    struct level_header
+    {
+        uint32_t size, assoc, blocksize, rows;
+    };
+    std::vector<level_header> config_binary;
+    bool header_written = false;
+
+    //Writes the decimal digits of v right-aligned in a field of the given width.
+    //Like setw, a number wider than the field is written in full.
+    static char *put_uint(char *p, unsigned v, int width) {
+        char digits[10];
+        int n = 0;
+        do {
+            digits[n++] = '0' + v % 10;
+            v /= 10;
+        } while (v != 0);
+        for (int i = n; i < width; i++)
+            *p++ = ' ';
+        while (n > 0)
+            *p++ = digits[--n];
+        return p;
+    }
+
+    //Formats "L1 HIT   pc:   12\taddr:   34\trow:   5\n"
+    void entry_text(unsigned index, log_status status, unsigned pc, unsigned addr, unsigned row) {
+        static const char *const names[] = {"HIT", "MISS", "SW"};
+        char *start = reserve(64);
+        char *p = start;
+        *p++ = 'L';
+        p = put_uint(p, index + 1, 0);
+        *p++ = ' ';
+        size_t len = strlen(names[status]);
+        memcpy(p, names[status], len);
+        p += len;
+        while (p - start < 8)
+            *p++ = ' ';
+        memcpy(p, " pc:", 4);
+        p = put_uint(p + 4, pc, 5);
+        memcpy(p, "\taddr:", 6);
+        p = put_uint(p + 6, addr, 5);
+        memcpy(p, "\trow:", 5);
+        p = put_uint(p + 5, row, 4);
+        *p++ = '\n';
+        used += p - start;
+    }
+
+    //Writes the low bytes of v, least significant first, whatever the host's byte order
+    static char *put_le(char *p, uint32_t v, unsigned bytes) {
+        for (unsigned i = 0; i < bytes; i++)
+            *p++ = static_cast<char>(v >> (8 * i));
+        return p;
+    }
+
+    void write_binary_header() {
+        put(LOG_BINARY_MAGIC, sizeof(LOG_BINARY_MAGIC));
+        char *start = reserve(4 + config_binary.size() * 16);
+        char *p = put_le(start, static_cast<uint32_t>(config_binary.size()), 4);
+        for (const level_header &h : config_binary) {
+            p = put_le(p, h.size, 4);
+            p = put_le(p, h.assoc, 4);
+            p = put_le(p, h.blocksize, 4);
+            p = put_le(p, h.rows, 4);
+        }
+        used += p - start;
+        header_written = true;
+    }
+
+    void entry_binary(unsigned index, log_status status, unsigned pc, unsigned addr, unsigned row) {
+        if (!header_written)
+            write_binary_header();
+        char *start = reserve(12);
+        char *p = put_le(start, index, 1);
+        p = put_le(p, status, 1);
+        p = put_le(p, pc, 2);
+        p = put_le(p, addr, 4);
+        p = put_le(p, row, 4);
+        used += p - start;
+    }
+};
+
+//A log that only counts events per level and status. Used where only the totals are needed.
+struct count_log
+{
+    //Indexed by level then log_status
+    std::vector<uint64_t> counts;
+
+    explicit count_log(size_t num_levels = 0) : counts(num_levels * 3, 0) {}
+
+    inline void entry(unsigned index, log_status status, unsigned, unsigned, unsigned) {
+        counts[index * 3 + status]++;
+    }
+};
+
+//A log that drops every event, for runs that only want the per-level statistics
+struct null_log
+{
+    inline void entry(unsigned, log_status, unsigned, unsigned, unsigned) {}
+};
+
+#endif
@@ -0,0 +1,482 @@
+/*
+multicore.h
+Several E20 cores sharing one memory, each with a private L1, all in front
+of shared lower levels, with the L1s kept coherent by MESI and a directory
+of which cores hold each block
+*/
+
+#ifndef MULTICORE_H
+#define MULTICORE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "cache.h"
+#include "e20.h"
+#include "log.h"
+#include "policy.h"
+#include "pool.h"
+#include "sparse.h"
+
+//The most cores a system can have: the directory keeps one bit per core
+const unsigned MAX_CORES = 64;
+
+//The MESI state of a block in an L1. A slot that was invalidated stays in the row, with a tag
+//nothing matches, until it is filled again.
+enum mesi_state : uint8_t { MESI_I = 0, MESI_S = 1, MESI_E = 2, MESI_M = 3 };
+
+//A tag no address has, for invalidated slots
+const uint32_t INVALID_TAG = UINT32_MAX;
+
+//The coherence traffic one core caused:
+//  bus_reads             load misses, which ask the other L1s for a shared copy
+//  bus_read_exclusives   store misses, which take the block away from every other L1
+//  upgrades              stores that hit a shared copy, and invalidate the others
+//  invalidations         copies in other L1s those three removed
+//  interventions         modified copies in other L1s that had to supply the block
+//  writebacks            modified blocks written to the shared levels: this core's own on eviction,
+//                        and other cores' when an intervention made them give the block up
+//  false_sharing         invalidations of a copy whose core had used none of the words being written:
+//                        the cores only share the block, not the data (see core_l1::used)
+struct coherence_stats
+{
+    uint64_t bus_reads = 0;
+    uint64_t bus_read_exclusives = 0;
+    uint64_t upgrades = 0;
+    uint64_t invalidations = 0;
+    uint64_t interventions = 0;
+    uint64_t writebacks = 0;
+    uint64_t false_sharing = 0;
+};
+
+//One memory access of a core, recorded while its quantum runs and simulated afterwards
+struct core_access
+{
+    //Instructions into the quantum when it happened
+    uint32_t offset;
+    uint16_t pc;
+    uint16_t addr;
+    bool is_store;
+
+    //What a store wrote
+    uint16_t value;
+};
+
+//A core's private L1: a level of cache.h, plus the MESI state of every slot and a mask of the words of
+//each block the core has used since it brought the block in (word w of a block is bit w % 64)
+template <class Policy>
+struct core_l1
+{
+    basic_level<Policy> lvl;
+    std::vector<uint8_t> state;
+    std::vector<uint64_t> used;
+};
+
+//One core: its processor state, its view of memory while a quantum runs, and its L1
+template <class Policy>
+struct e20_core
+{
+    e20_state state;
+
+    //Shared memory as of the start of the quantum, plus the core's own stores since
+    std::vector<uint16_t> mem;
+
+    std::vector<core_access> accesses;
+    core_l1<Policy> l1;
+    coherence_stats coherence;
+};
+
+//Records a core's accesses while it runs a quantum (see basic_multicore::run)
+template <class Policy>
+struct core_recorder
+{
+    e20_core<Policy> &core;
+    uint64_t start;
+
+    void load(unsigned pc, unsigned addr, uint64_t clock_cycle) {
+        core.accesses.push_back({static_cast<uint32_t>(clock_cycle - start), static_cast<uint16_t>(pc),
+            static_cast<uint16_t>(addr), false, 0});
+    }
+
+    //The interpreter has already written the cell
+    void store(unsigned pc, unsigned addr, uint64_t clock_cycle) {
+        core.accesses.push_back({static_cast<uint32_t>(clock_cycle - start), static_cast<uint16_t>(pc),
+            static_cast<uint16_t>(addr), true, core.mem[addr]});
+    }
+};
+
+/*
+    Several E20 cores running one program in one shared memory. Core i
+    powers on with i in $1, where a single machine has 0, so the program
+    can divide the work between the cores.
+
+    The cores take turns in rounds of quanta, in core order: every core
+    runs up to quantum instructions, and then every core's memory accesses
+    of the round go through the caches. Within a quantum a core sees memory
+    as it was when the round began plus its own stores; the stores of the
+    round land in shared memory when it ends, core by core, so a later
+    core's store to a cell wins. The cores of a round can therefore run on
+    host threads and the results don't depend on how many there are.
+
+    The caches see a round's accesses interleaved as if the cores ran in
+    lockstep: ordered by how far into the quantum they came, ties in core
+    order. Each core has a private L1 of the first level of the
+    configuration; the other levels are shared, and see the L1s' misses
+    (as loads) and writebacks (as stores). The L1s are write-back and kept
+    coherent by MESI, with a directory of which L1s hold each block.
+*/
+template <class Policy>
+class basic_multicore
+{
+public:
+    /*
+        Builds the cores, powered on with the program, and the caches.
+
+        @param memory The program: MEM_SIZE cells
+
+        @param num_cores At least 1, at most MAX_CORES
+
+        @param cache_config See parse_cache_config; at least two levels
+
+        @param corrected_lw Which address a lw into its own address register
+            reports (see e20_state in e20.h)
+
+        @return false if the configuration can't be parsed, has one level,
+            or the core count is out of range
+    */
+    bool init(const uint16_t *memory, unsigned num_cores, const std::string &cache_config, bool corrected_lw = false) {
+        std::vector<int> parts;
+        if (num_cores == 0 || num_cores > MAX_CORES || !parse_cache_config(cache_config, parts) || parts.size() < 6)
+            return false;
+        cores.assign(num_cores, e20_core<Policy>());
+        for (unsigned i = 0; i < num_cores; i++) {
+            e20_core<Policy> &c = cores[i];
+            c.mem.assign(memory, memory + MEM_SIZE);
+            c.state.corrected_lw = corrected_lw;
+            start_e20(c.mem.data(), c.state);
+            c.state.regs[1] = static_cast<uint16_t>(i);
+            init_level(c.l1.lvl, parts[0], parts[1], parts[2]);
+            c.l1.state.assign(c.l1.lvl.tags.size(), MESI_I);
+            c.l1.used.assign(c.l1.lvl.tags.size(), 0);
+        }
+        shared.My_levels.clear();
+        for (size_t p = 3; p < parts.size(); p += 3)
+        {
+            shared.My_levels.emplace_back();
+            init_level(shared.My_levels.back(), parts[p], parts[p+1], parts[p+2]);
+        }
+        sharers.clear();
+        false_sharing_sites.clear();
+        return true;
+    }
+
+    /*
+        Runs every core until it halts.
+
+        @param quantum Instructions per core per round, at least 1 and at
+            most UINT32_MAX, since an access records its offset into the
+            quantum in 32 bits
+
+        @param num_threads Host threads that run a round's cores, 0 for one
+            per hardware thread; 1 runs them on the calling thread
+
+        @return The number of rounds
+    */
+    uint64_t run(uint64_t quantum, unsigned num_threads = 1) {
+        work_stealing_pool pool(num_threads);
+        uint64_t rounds = 0;
+        while (!halted()) {
+            auto run_core = [&](size_t i) {
+                e20_core<Policy> &c = cores[i];
+                c.accesses.clear();
+                core_recorder<Policy> recorder{c, c.state.clock_cycle};
+                resume_e20<true>(c.mem.data(), c.state, recorder, quantum);
+            };
+            if (num_threads == 1) {
+                for (size_t i = 0; i < cores.size(); i++)
+                    run_core(i);
+            } else {
+                pool.run(cores.size(), run_core);
+            }
+            commit_stores();
+            simulate_round();
+            rounds++;
+        }
+        return rounds;
+    }
+
+    bool halted() const {
+        for (const e20_core<Policy> &c : cores) {
+            if (!c.state.halted)
+                return false;
+        }
+        return true;
+    }
+
+    size_t num_cores() const { return cores.size(); }
+    const e20_core<Policy> &core(size_t i) const { return cores[i]; }
+
+    //The levels below the L1s, L2 first
+    const basic_cache<Policy> &shared_levels() const { return shared; }
+
+    /*
+        Writes the results: a line per core (instructions, L1 counters and
+        coherence traffic), a line per shared level, then the pcs whose
+        stores falsely shared blocks the most, with the block, most
+        invalidations first.
+
+        @param max_sites The most false-sharing sites to list
+    */
+    void report(FILE *out, size_t max_sites = 20) const {
+        fprintf(out, "core\tinstructions\tL1_hits\tL1_misses\tbus_reads\tbus_read_exclusives\tupgrades"
+            "\tinvalidations\tinterventions\twritebacks\tfalse_sharing\n");
+        for (size_t i = 0; i < cores.size(); i++) {
+            const e20_core<Policy> &c = cores[i];
+            const coherence_stats &s = c.coherence;
+            fprintf(out, "%zu\t%llu\t%llu\t%llu\t%llu\t%llu\t%llu\t%llu\t%llu\t%llu\t%llu\n", i, ull(c.state.clock_cycle),
+                ull(c.l1.lvl.stats.hits()), ull(c.l1.lvl.stats.misses()), ull(s.bus_reads), ull(s.bus_read_exclusives),
+                ull(s.upgrades), ull(s.invalidations), ull(s.interventions), ull(s.writebacks), ull(s.false_sharing));
+        }
+        fprintf(out, "\nlevel\thits\tmisses\tstores\n");
+        for (size_t l = 0; l < shared.My_levels.size(); l++) {
+            const level_stats &s = shared.My_levels[l].stats;
+            fprintf(out, "L%zu\t%llu\t%llu\t%llu\n", l + 2, ull(s.load_hits), ull(s.load_misses),
+                ull(s.store_hits + s.store_misses));
+        }
+
+        std::vector<std::pair<uint64_t, uint64_t>> sites(false_sharing_sites.begin(), false_sharing_sites.end());
+        std::sort(sites.begin(), sites.end(), [](const std::pair<uint64_t, uint64_t> &a,
+            const std::pair<uint64_t, uint64_t> &b) { return a.second != b.second ? a.second > b.second : a.first < b.first; });
+        fprintf(out, "\npc\tblock\tfalse_sharing\n");
+        for (size_t i = 0; i < sites.size() && i < max_sites; i++)
+            fprintf(out, "%llu\t%llu\t%llu\n", ull(sites[i].first >> 32), ull(sites[i].first & UINT32_MAX),
+                ull(sites[i].second));
+    }
+
+private:
+    std::vector<e20_core<Policy>> cores;
+    basic_cache<Policy> shared;
+
+    //For each block, a bit per core whose L1 holds it
+    sparse_array<uint64_t> sharers;
+
+    //False-sharing invalidations by the pc of the store and the block, as pc << 32 | block
+    std::unordered_map<uint64_t, uint64_t> false_sharing_sites;
+
+    static unsigned long long ull(uint64_t v) { return static_cast<unsigned long long>(v); }
+
+    //Applies every core's stores of the round, in core order, to every core's view of memory and code
+    void commit_stores() {
+        for (const e20_core<Policy> &from : cores) {
+            for (const core_access &a : from.accesses) {
+                if (!a.is_store)
+                    continue;
+                decoded_instr in = decode_e20(a.value);
+                for (e20_core<Policy> &to : cores) {
+                    to.mem[a.addr] = a.value;
+                    to.state.code[a.addr] = in;
+                }
+            }
+        }
+    }
+
+    //Sends the round's accesses through the caches, in lockstep order
+    void simulate_round() {
+        std::vector<size_t> next(cores.size(), 0);
+        for (;;) {
+            size_t best = cores.size();
+            uint32_t best_offset = UINT32_MAX;
+            for (size_t i = 0; i < cores.size(); i++) {
+                if (next[i] < cores[i].accesses.size() && cores[i].accesses[next[i]].offset < best_offset) {
+                    best = i;
+                    best_offset = cores[i].accesses[next[i]].offset;
+                }
+            }
+            if (best == cores.size())
+                return;
+            const core_access &a = cores[best].accesses[next[best]++];
+            access(static_cast<unsigned>(best), a.pc, a.addr, a.is_store);
+        }
+    }
+
+    //The slot of a block in a core's L1, or -1
+    static long find_slot(core_l1<Policy> &l1, uint32_t addr) {
+        uint32_t row, tag;
+        locate(l1.lvl, addr, row, tag);
+        int way = find_way(l1.lvl, row, tag);
+        return way < 0 ? -1 : static_cast<long>(row) * l1.lvl.stride + way;
+    }
+
+    static uint64_t word_bit(const level &lvl, uint32_t addr) { return uint64_t(1) << (addr % lvl.block_size % 64); }
+
+    //Sends a load that missed every L1 down the shared levels
+    void shared_load(unsigned pc, uint32_t addr) {
+        null_log log;
+        for (size_t l = 0; l < shared.My_levels.size(); l++) {
+            if (!access_level(shared.My_levels[l], l + 1, pc, addr, false, log))
+                return;
+        }
+    }
+
+    //Writes a modified block back to the shared levels
+    void write_back(unsigned pc, uint32_t addr) {
+        null_log log;
+        for (size_t l = 0; l < shared.My_levels.size(); l++)
+            access_level(shared.My_levels[l], l + 1, pc, addr, true, log);
+    }
+
+    /*
+        Removes a block from the L1 of core o, for a store by core c.
+
+        @param addr The address core c is writing
+    */
+    void invalidate(unsigned c, unsigned o, unsigned pc, uint32_t addr, uint32_t block) {
+        core_l1<Policy> &l1 = cores[o].l1;
+        long slot = find_slot(l1, addr);
+        coherence_stats &s = cores[c].coherence;
+        if (slot >= 0) {
+            s.invalidations++;
+            if (l1.state[slot] == MESI_M) {
+                s.interventions++;
+                s.writebacks++;
+                write_back(pc, addr);
+            }
+            if ((l1.used[slot] & word_bit(l1.lvl, addr)) == 0) {
+                s.false_sharing++;
+                false_sharing_sites[static_cast<uint64_t>(pc) << 32 | block]++;
+            }
+            l1.state[slot] = MESI_I;
+            l1.used[slot] = 0;
+            l1.lvl.tags[slot] = INVALID_TAG;
+        }
+        sharers.at(block) &= ~(uint64_t(1) << o);
+    }
+
+    //Invalidates every other L1's copy of a block
+    void invalidate_others(unsigned c, unsigned pc, uint32_t addr, uint32_t block) {
+        uint64_t others = sharers.get(block) & ~(uint64_t(1) << c);
+        for (unsigned o = 0; others != 0; o++, others >>= 1) {
+            if (others & 1)
+                invalidate(c, o, pc, addr, block);
+        }
+    }
+
+    //Picks the slot a new block goes in: an invalidated slot of the row if there is one, otherwise
+    //what choose_way picks, writing back and forgetting the block it evicts
+    unsigned make_room(unsigned c, unsigned pc, uint32_t row) {
+        core_l1<Policy> &l1 = cores[c].l1;
+        basic_level<Policy> &lvl = l1.lvl;
+        size_t base = static_cast<size_t>(row) * lvl.stride;
+        for (unsigned w = 0; w < lvl.fill[row]; w++) {
+            if (l1.state[base + w] == MESI_I)
+                return w;
+        }
+        unsigned way = choose_way(lvl, row);
+        if (way < lvl.fill[row]) {
+            size_t slot = base + way;
+            uint32_t old_block = lvl.tags[slot] * lvl.num_rows + row;
+            if (l1.state[slot] == MESI_M) {
+                cores[c].coherence.writebacks++;
+                write_back(pc, old_block * lvl.block_size);
+            }
+            sharers.at(old_block) &= ~(uint64_t(1) << c);
+        }
+        return way;
+    }
+
+    //One load or store of core c, through its L1 and, if need be, the directory and the shared levels
+    void access(unsigned c, unsigned pc, uint32_t addr, bool is_store) {
+        core_l1<Policy> &l1 = cores[c].l1;
+        basic_level<Policy> &lvl = l1.lvl;
+        coherence_stats &s = cores[c].coherence;
+        uint32_t row, tag;
+        locate(lvl, addr, row, tag);
+        uint32_t block = addr / lvl.block_size;
+        int way = find_way(lvl, row, tag);
+
+        if (way >= 0) {
+            size_t slot = static_cast<size_t>(row) * lvl.stride + way;
+            lvl.policy.hit(row, way);
+            l1.used[slot] |= word_bit(lvl, addr);
+            if (!is_store) {
+                lvl.stats.load_hits++;
+                return;
+            }
+            lvl.stats.store_hits++;
+            if (l1.state[slot] == MESI_S) {
+                s.upgrades++;
+                invalidate_others(c, pc, addr, block);
+            }
+            l1.state[slot] = MESI_M;
+            return;
+        }
+
+        if (is_store)
+            lvl.stats.store_misses++;
+        else
+            lvl.stats.load_misses++;
+        lvl.stats.miss(pc, block);
+
+        unsigned fill_way = make_room(c, pc, row);
+        if (fill_way == lvl.fill[row])
+            lvl.fill[row] = fill_way + 1;
+        else if (lvl.tags[static_cast<size_t>(row) * lvl.stride + fill_way] != INVALID_TAG)
+            lvl.stats.evictions++;
+        size_t slot = static_cast<size_t>(row) * lvl.stride + fill_way;
+        lvl.tags[slot] = tag;
+        lvl.policy.fill(row, fill_way);
+        l1.used[slot] = word_bit(lvl, addr);
+
+        uint64_t others = sharers.get(block) & ~(uint64_t(1) << c);
+        if (is_store) {
+            s.bus_read_exclusives++;
+            invalidate_others(c, pc, addr, block);
+            l1.state[slot] = MESI_M;
+        } else {
+            s.bus_reads++;
+            uint64_t holders = others;
+            for (unsigned o = 0; holders != 0; o++, holders >>= 1) {
+                if ((holders & 1) == 0)
+                    continue;
+                core_l1<Policy> &other = cores[o].l1;
+                long other_slot = find_slot(other, addr);
+                if (other_slot >= 0 && other.state[other_slot] == MESI_M) {
+                    s.interventions++;
+                    s.writebacks++;
+                    write_back(pc, addr);
+                }
+                if (other_slot >= 0)
+                    other.state[other_slot] = MESI_S;
+            }
+            l1.state[slot] = others != 0 ? MESI_S : MESI_E;
+        }
+        sharers.at(block) |= uint64_t(1) << c;
+        shared_load(pc, addr);
+    }
+};
+
+/*
+    Runs a program on a multi-core system and writes its report (see
+    basic_multicore), for the replacement policy chosen at run time.
+
+    @return false if the configuration or core count isn't valid for one
+*/
+inline bool run_multicore(const uint16_t *memory, unsigned num_cores, const std::string &cache_config,
+    replacement_policy policy, uint64_t quantum, unsigned num_threads, bool corrected_lw, FILE *out) {
+    return with_policy(policy, [&](auto tag) {
+        basic_multicore<decltype(tag)> system;
+        if (!system.init(memory, num_cores, cache_config, corrected_lw))
+            return false;
+        system.run(quantum, num_threads);
+        system.report(out);
+        return true;
+    });
+}
+
+#endif
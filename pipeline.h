@@ -0,0 +1,340 @@
+/*
+pipeline.h
+Runs the levels of a cache on threads of their own. L1 stays with the
+interpreter (or trace reader) that feeds it; what L1 passes on, its load
+misses and every store, goes through a ring to a thread for L2, whose own
+traffic goes through another ring to L3, and so on. The statistics and the
+log come out exactly as from cache_load and cache_store.
+*/
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "cache.h"
+#include "log.h"
+
+//A bounded queue between exactly one producer thread and one consumer thread. Each side keeps its
+//own position to itself and publishes it to the other side only every PUBLISH_EVERY items, or when
+//it has to wait, so the shared cache lines move between cores once a batch rather than once an item.
+//A side that has to wait spins briefly and then yields, since the other side may be sharing its core.
+//A thread that feeds or drains more than one ring must publish all of them before it waits on any
+//(see on_producer_wait), or two threads can each wait for what the other has yet to publish.
+template <class T>
+class spsc_ring
+{
+public:
+    static const size_t PUBLISH_EVERY = 256;
+
+    /*
+        @param capacity Number of items the ring holds, rounded up to a power
+            of two no smaller than 2 * PUBLISH_EVERY
+    */
+    explicit spsc_ring(size_t capacity = 1 << 14) {
+        size_t size = 2 * PUBLISH_EVERY;
+        while (size < capacity)
+            size *= 2;
+        slots.resize(size);
+        mask = size - 1;
+    }
+
+    //Sets what the producer calls before it waits for room, after publishing this ring
+    void on_producer_wait(std::function<void()> fn) { producer_waiting = std::move(fn); }
+
+    //Sets what the consumer calls before it waits for items, after releasing this ring
+    void on_consumer_wait(std::function<void()> fn) { consumer_waiting = std::move(fn); }
+
+    //Producer: adds an item, waiting for room if the ring is full
+    void push(const T &item) {
+        if (write - tail_seen == slots.size())
+            wait_for_room();
+        slots[write & mask] = item;
+        write++;
+        if (write - published >= PUBLISH_EVERY)
+            publish();
+    }
+
+    //Producer: publishes the last items and marks the end of the stream. Nothing may be pushed after.
+    void close() {
+        publish();
+        closed.store(true, std::memory_order_release);
+    }
+
+    //Consumer: takes the next item, waiting for one if need be. Returns false once the ring has been
+    //closed and emptied.
+    bool pop(T &item) {
+        if (read == head_seen && !wait_for_items())
+            return false;
+        item = slots[read & mask];
+        read++;
+        if (read - released >= PUBLISH_EVERY)
+            release();
+        return true;
+    }
+
+    //Producer: makes everything pushed so far visible to the consumer
+    void publish() {
+        published = write;
+        head.store(write, std::memory_order_release);
+    }
+
+    //Consumer: hands the slots of everything popped so far back to the producer
+    void release() {
+        released = read;
+        tail.store(read, std::memory_order_release);
+    }
+
+private:
+    std::vector<T> slots;
+    size_t mask = 0;
+
+    //Written by the producer, read by the consumer
+    alignas(64) std::atomic<size_t> head{0};
+    std::atomic<bool> closed{false};
+
+    //Written by the consumer, read by the producer
+    alignas(64) std::atomic<size_t> tail{0};
+
+    //The producer's own: its next slot, what it last published, and the last tail it saw
+    alignas(64) size_t write = 0;
+    size_t published = 0;
+    size_t tail_seen = 0;
+
+    //The consumer's own: its next slot, what it last released, and the last head it saw
+    alignas(64) size_t read = 0;
+    size_t released = 0;
+    size_t head_seen = 0;
+
+    std::function<void()> producer_waiting;
+    std::function<void()> consumer_waiting;
+
+    static void back_off(unsigned spins) {
+        if (spins >= 64)
+            std::this_thread::yield();
+    }
+
+    //Publishes what's been pushed, since the consumer may be waiting for it, until there's room
+    void wait_for_room() {
+        publish();
+        if (producer_waiting)
+            producer_waiting();
+        for (unsigned spins = 0;; spins++) {
+            tail_seen = tail.load(std::memory_order_acquire);
+            if (write - tail_seen < slots.size())
+                return;
+            back_off(spins);
+        }
+    }
+
+    //Releases what's been popped, since the producer may be waiting for room, until there are items
+    //or the ring is closed. The head is read again after seeing closed, as close() publishes first.
+    bool wait_for_items() {
+        release();
+        if (consumer_waiting)
+            consumer_waiting();
+        for (unsigned spins = 0;; spins++) {
+            head_seen = head.load(std::memory_order_acquire);
+            if (read != head_seen)
+                return true;
+            if (closed.load(std::memory_order_acquire)) {
+                head_seen = head.load(std::memory_order_acquire);
+                return read != head_seen;
+            }
+            back_off(spins);
+        }
+    }
+};
+
+//An access one level passes on to the next
+struct pipeline_access
+{
+    uint32_t addr;
+    uint16_t pc;
+    bool is_store;
+
+    //For a store, whether a level that misses brings the block in (see corrected_stores)
+    bool allocate;
+};
+
+//A log entry held back until the entries before it, from every level, have been written
+struct pipeline_event
+{
+    uint32_t addr;
+    uint32_t row;
+    uint16_t pc;
+    uint8_t status;
+};
+
+//The log of one pipeline stage: queues its entries for the thread that merges them
+struct ring_log
+{
+    spsc_ring<pipeline_event> &ring;
+
+    inline void entry(unsigned, log_status status, unsigned pc, unsigned addr, unsigned row) {
+        ring.push(pipeline_event{static_cast<uint32_t>(addr), static_cast<uint32_t>(row),
+            static_cast<uint16_t>(pc), static_cast<uint8_t>(status)});
+    }
+};
+
+//The interpreter hook of a pipeline: runs L1 on the calling thread and passes on what L1 doesn't
+//stop. Next is null if there's only one level.
+template <class Shape, class Policy, class StageLog>
+struct pipeline_front
+{
+    basic_level<Policy> &lvl;
+    spsc_ring<pipeline_access> *next;
+    StageLog &log;
+    bool corrected_stores;
+
+    void load(unsigned pc, unsigned addr, uint64_t) {
+        if (access_level<Shape>(lvl, 0, pc, addr, false, log) && next)
+            next->push(pipeline_access{static_cast<uint32_t>(addr), static_cast<uint16_t>(pc), false, true});
+    }
+
+    void store(unsigned pc, unsigned addr, uint64_t) {
+        bool hit = store_level<Shape>(lvl, 0, pc, addr, true, log);
+        if (next)
+            next->push(pipeline_access{static_cast<uint32_t>(addr), static_cast<uint16_t>(pc), true,
+                !hit || corrected_stores});
+    }
+};
+
+/*
+    Drives a cache with its levels below L1 on threads of their own, and
+    the log, unless it's a null_log, written by one more thread. The
+    result is the same as driving a cache_hook: every level sees the same
+    accesses in the same order, and the log gets the same entries in the
+    same order. All threads have finished when this returns.
+
+    @param My_cache The cache being accessed. The caller must not touch it
+        until this returns.
+
+    @param log Receives one entry(level, status, pc, addr, row) per event.
+        Only ever called from one thread at a time.
+
+    @param source Called once on this thread with the hook for L1 (which
+        has load and store like cache_hook); it sends every access through
+        that hook and returns when done, e.g. [&](auto &hook) { return
+        machine.run(hook); }
+
+    @return Whatever source returns
+*/
+template <class Policy, class Shape, class Log, class Source>
+auto run_pipelined(basic_cache<Policy, Shape> &My_cache, Log &log, Source &&source) {
+    const bool logging = !std::is_same<Log, null_log>::value;
+    const size_t n = My_cache.My_levels.size();
+
+    //accesses[i] runs from level i to level i + 1; events[i] from level i to the merger
+    std::vector<std::unique_ptr<spsc_ring<pipeline_access>>> accesses;
+    std::vector<std::unique_ptr<spsc_ring<pipeline_event>>> events;
+    for (size_t i = 0; i + 1 < n; i++)
+        accesses.emplace_back(new spsc_ring<pipeline_access>);
+    for (size_t i = 0; logging && i < n; i++)
+        events.emplace_back(new spsc_ring<pipeline_event>);
+
+    //Level i's thread (this one for L1) publishes what it passes on and releases what it has taken
+    //before waiting on any of its rings; the merger releases every log ring
+    for (size_t i = 0; i < n; i++) {
+        auto waiting = [&, i] {
+            if (i > 0)
+                accesses[i - 1]->release();
+            if (i + 1 < n)
+                accesses[i]->publish();
+            if (logging)
+                events[i]->publish();
+        };
+        if (i > 0)
+            accesses[i - 1]->on_consumer_wait(waiting);
+        if (i + 1 < n)
+            accesses[i]->on_producer_wait(waiting);
+        if (logging)
+            events[i]->on_producer_wait(waiting);
+    }
+    for (size_t i = 0; logging && i < n; i++) {
+        events[i]->on_consumer_wait([&] {
+            for (auto &ring : events)
+                ring->release();
+        });
+    }
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < n; i++) {
+        threads.emplace_back([&, i] {
+            basic_level<Policy> &lvl = My_cache.My_levels[i];
+            spsc_ring<pipeline_access> &in = *accesses[i - 1];
+            spsc_ring<pipeline_access> *out = i + 1 < n ? accesses[i].get() : nullptr;
+            auto drain = [&](auto &stage_log) {
+                pipeline_access a;
+                while (in.pop(a)) {
+                    if (a.is_store) {
+                        if (store_level(lvl, i, a.pc, a.addr, a.allocate, stage_log))
+                            a.allocate = a.allocate && My_cache.corrected_stores;
+                        if (out)
+                            out->push(a);
+                    } else if (access_level(lvl, i, a.pc, a.addr, false, stage_log) && out) {
+                        out->push(a);
+                    }
+                }
+            };
+            if (logging) {
+                ring_log stage_log{*events[i]};
+                drain(stage_log);
+                events[i]->close();
+            } else {
+                null_log stage_log;
+                drain(stage_log);
+            }
+            if (out)
+                out->close();
+        });
+    }
+
+    //An access makes one entry at each level down to the first that stops it (a load hit, or the
+    //last level), so taking entries from the levels in that order rebuilds the sequential log
+    if (logging) {
+        threads.emplace_back([&] {
+            pipeline_event e;
+            while (events[0]->pop(e)) {
+                log.entry(0, static_cast<log_status>(e.status), e.pc, e.addr, e.row);
+                for (size_t i = 1; i < n && e.status != LOG_HIT; i++) {
+                    if (!events[i]->pop(e))
+                        break;
+                    log.entry(i, static_cast<log_status>(e.status), e.pc, e.addr, e.row);
+                }
+            }
+        });
+    }
+
+    auto finish = [&] {
+        if (!accesses.empty())
+            accesses[0]->close();
+        if (logging)
+            events[0]->close();
+        for (std::thread &t : threads)
+            t.join();
+    };
+    spsc_ring<pipeline_access> *next = accesses.empty() ? nullptr : accesses[0].get();
+    if constexpr (std::is_same<Log, null_log>::value) {
+        null_log stage_log;
+        pipeline_front<Shape, Policy, null_log> front{My_cache.My_levels[0], next, stage_log, My_cache.corrected_stores};
+        auto result = source(front);
+        finish();
+        return result;
+    } else {
+        ring_log stage_log{*events[0]};
+        pipeline_front<Shape, Policy, ring_log> front{My_cache.My_levels[0], next, stage_log, My_cache.corrected_stores};
+        auto result = source(front);
+        finish();
+        return result;
+    }
+}
+
+#endif
@@ -0,0 +1,287 @@
+/*
+policy.h
+Replacement policies for the cache levels in cache.h
+*/
+
+#ifndef POLICY_H
+#define POLICY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "simd.h"
+
+//Every policy keeps the replacement state for all rows of one level and has the same interface:
+//  init(rows, assoc)   allocates the state for a level with that many rows and ways
+//  hit(row, way)       the block in that way was accessed
+//  fill(row, way)      a block was just brought into that way
+//  victim(row)         picks the way to evict from a full row
+//  serialize(ar)       passes the replacement state through a checkpoint archive (see checkpoint.h)
+//  name()              the name --policy knows it by
+//cache.h instantiates the level on the policy, so none of these calls are virtual.
+
+//Which policy --policy selected
+enum replacement_policy { POLICY_LRU, POLICY_PLRU, POLICY_FIFO, POLICY_RANDOM, POLICY_SRRIP };
+
+/*
+    Parses the argument of --policy.
+
+    @param name One of "lru", "plru", "fifo", "random" or "srrip"
+
+    @param policy Receives the parsed policy
+
+    @return false if name is not a known policy
+*/
+inline bool parse_policy(const std::string &name, replacement_policy &policy) {
+    if (name == "lru") policy = POLICY_LRU;
+    else if (name == "plru") policy = POLICY_PLRU;
+    else if (name == "fifo") policy = POLICY_FIFO;
+    else if (name == "random") policy = POLICY_RANDOM;
+    else if (name == "srrip") policy = POLICY_SRRIP;
+    else return false;
+    return true;
+}
+
+//True LRU. Every access stamps the block with a per-level 64-bit access count, which never wraps,
+//and the block with the smallest stamp is evicted. Rows of 8 or more ways look for it with AVX2
+//when the processor has it.
+struct lru_policy
+{
+    static const char *name() { return "lru"; }
+
+    unsigned assoc = 0;
+    uint64_t now = 0;
+    std::vector<uint64_t> stamps;
+    simd_level simd = SIMD_SCALAR;
+
+    void init(uint32_t rows, unsigned a) {
+        assoc = a;
+        stamps.assign(static_cast<size_t>(rows) * a, 0);
+        simd = simd_for_ways(a);
+    }
+
+    void hit(uint32_t row, unsigned way) { stamps[static_cast<size_t>(row) * assoc + way] = ++now; }
+
+    void fill(uint32_t row, unsigned way) { stamps[static_cast<size_t>(row) * assoc + way] = ++now; }
+
+    template <class Archive>
+    void serialize(Archive &ar) {
+        ar.io(now);
+        ar.io(stamps);
+    }
+
+    unsigned victim(uint32_t row) const {
+        const uint64_t *s = stamps.data() + static_cast<size_t>(row) * assoc;
+#if defined(SIMCACHE_X86)
+        if (simd == SIMD_AVX2)
+            return min_stamp_avx2(s, assoc);
+#endif
+        unsigned LRU = 0;
+        for (unsigned i = 1; i < assoc; i++) {
+            if (s[i] < s[LRU])
+                LRU = i;
+        }
+        return LRU;
+    }
+};
+
+//First in, first out. A row fills its ways in order and a full row replaces them in the same
+//order, so all the policy needs is the next way to replace in each row.
+struct fifo_policy
+{
+    static const char *name() { return "fifo"; }
+
+    unsigned assoc = 0;
+    std::vector<uint32_t> next;
+
+    void init(uint32_t rows, unsigned a) {
+        assoc = a;
+        next.assign(rows, 0);
+    }
+
+    void hit(uint32_t, unsigned) {}
+
+    void fill(uint32_t row, unsigned way) { next[row] = way + 1 == assoc ? 0 : way + 1; }
+
+    unsigned victim(uint32_t row) const { return next[row]; }
+
+    template <class Archive>
+    void serialize(Archive &ar) { ar.io(next); }
+};
+
+//Tree pseudo-LRU: one bit per node of a binary tree over the ways, pointing towards the half that
+//was used less recently. The tree is built over the next power of two, and a walk never enters a
+//subtree with no real ways in it, so any associativity works. With up to 64 ways a row's tree fits
+//in one word, and a hit rewrites the bits on the way's path with one precomputed mask.
+struct plru_policy
+{
+    static const char *name() { return "plru"; }
+
+    unsigned assoc = 0;
+    unsigned leaves = 1;
+    size_t words_per_row = 1;
+    std::vector<uint64_t> bits;
+
+    //For each way, the nodes on its path and the values a hit gives them (only when leaves <= 64)
+    std::vector<uint64_t> path_mask, path_bits;
+
+    void init(uint32_t rows, unsigned a) {
+        assoc = a;
+        leaves = 1;
+        while (leaves < a)
+            leaves *= 2;
+        //Nodes are numbered 1 to leaves-1, heap style
+        words_per_row = (leaves + 63) / 64;
+        bits.assign(static_cast<size_t>(rows) * words_per_row, 0);
+
+        path_mask.assign(a, 0);
+        path_bits.assign(a, 0);
+        if (leaves <= 64) {
+            for (unsigned way = 0; way < a; way++) {
+                unsigned node = 1, lo = 0;
+                for (unsigned size = leaves; size > 1; size /= 2) {
+                    unsigned half = size / 2;
+                    path_mask[way] |= uint64_t(1) << node;
+                    if (way < lo + half) {
+                        path_bits[way] |= uint64_t(1) << node;
+                        node = 2 * node;
+                    } else {
+                        node = 2 * node + 1;
+                        lo += half;
+                    }
+                }
+            }
+        }
+    }
+
+    //Points every node on the way's path at the other half
+    void hit(uint32_t row, unsigned way) {
+        uint64_t *b = bits.data() + row * words_per_row;
+        if (leaves <= 64) {
+            *b = (*b & ~path_mask[way]) | path_bits[way];
+            return;
+        }
+        unsigned node = 1, lo = 0;
+        for (unsigned size = leaves; size > 1; size /= 2) {
+            unsigned half = size / 2;
+            if (way < lo + half) {
+                b[node / 64] |= uint64_t(1) << (node % 64);
+                node = 2 * node;
+            } else {
+                b[node / 64] &= ~(uint64_t(1) << (node % 64));
+                node = 2 * node + 1;
+                lo += half;
+            }
+        }
+    }
+
+    void fill(uint32_t row, unsigned way) { hit(row, way); }
+
+    template <class Archive>
+    void serialize(Archive &ar) { ar.io(bits); }
+
+    //Follows the bits from the root; a set bit means the right half is the less recently used one
+    unsigned victim(uint32_t row) const {
+        const uint64_t *b = bits.data() + row * words_per_row;
+        unsigned node = 1, lo = 0;
+        for (unsigned size = leaves; size > 1; size /= 2) {
+            unsigned half = size / 2;
+            unsigned right = (b[node / 64] >> (node % 64) & 1) & (lo + half < assoc);
+            node = 2 * node + right;
+            lo += right * half;
+        }
+        return lo;
+    }
+};
+
+//Evicts a uniformly chosen way. Each level has its own fixed-seed generator, so runs are repeatable.
+struct random_policy
+{
+    static const char *name() { return "random"; }
+
+    unsigned assoc = 0;
+    uint64_t state = 0x9e3779b97f4a7c15ull;
+
+    void init(uint32_t, unsigned a) { assoc = a; }
+
+    void hit(uint32_t, unsigned) {}
+
+    void fill(uint32_t, unsigned) {}
+
+    template <class Archive>
+    void serialize(Archive &ar) { ar.io(state); }
+
+    //xorshift64
+    unsigned victim(uint32_t) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return static_cast<unsigned>(state % assoc);
+    }
+};
+
+//Static re-reference interval prediction with 2-bit values. New blocks are predicted to be
+//re-referenced in the distant future (2), hits reset the prediction to immediate (0), and the
+//first block predicted furthest out (3) is evicted, ageing the whole row until one is.
+struct srrip_policy
+{
+    static const char *name() { return "srrip"; }
+
+    static constexpr uint8_t MAX_RRPV = 3;
+
+    unsigned assoc = 0;
+    std::vector<uint8_t> rrpv;
+
+    void init(uint32_t rows, unsigned a) {
+        assoc = a;
+        rrpv.assign(static_cast<size_t>(rows) * a, MAX_RRPV);
+    }
+
+    void hit(uint32_t row, unsigned way) { rrpv[static_cast<size_t>(row) * assoc + way] = 0; }
+
+    void fill(uint32_t row, unsigned way) { rrpv[static_cast<size_t>(row) * assoc + way] = MAX_RRPV - 1; }
+
+    template <class Archive>
+    void serialize(Archive &ar) { ar.io(rrpv); }
+
+    unsigned victim(uint32_t row) {
+        uint8_t *r = rrpv.data() + static_cast<size_t>(row) * assoc;
+        uint8_t oldest = 0;
+        for (unsigned i = 0; i < assoc; i++)
+            oldest = r[i] > oldest ? r[i] : oldest;
+
+        //Ages every block by the amount that brings the oldest to MAX_RRPV in one step
+        if (oldest < MAX_RRPV) {
+            uint8_t age = MAX_RRPV - oldest;
+            for (unsigned i = 0; i < assoc; i++)
+                r[i] += age;
+        }
+        unsigned way = 0;
+        while (r[way] != MAX_RRPV)
+            way++;
+        return way;
+    }
+};
+
+/*
+    Calls fn with a default-constructed object of the policy class for a
+    replacement_policy, so code that works on any policy can be written
+    once as a generic lambda and instantiated for each of them.
+
+    @return Whatever fn returns
+*/
+template <class Fn>
+auto with_policy(replacement_policy policy, Fn &&fn) -> decltype(fn(lru_policy())) {
+    switch (policy) {
+        case POLICY_PLRU: return fn(plru_policy());
+        case POLICY_FIFO: return fn(fifo_policy());
+        case POLICY_RANDOM: return fn(random_policy());
+        case POLICY_SRRIP: return fn(srrip_policy());
+        case POLICY_LRU: break;
+    }
+    return fn(lru_policy());
+}
+
+#endif
@@ -0,0 +1,118 @@
+/*
+pool.h
+A work-stealing thread pool for running a fixed set of independent jobs
+*/
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//Runs jobs 0..n-1 on a set of threads. Each thread starts with its own contiguous share of the jobs
+//and takes them from the front; a thread that runs out steals the back half of the largest share
+//left. Neighbouring jobs (the configurations of one program, say) so tend to run on the same thread,
+//and the locks are only contended while stealing. Jobs are expected to take far longer than a lock.
+class work_stealing_pool
+{
+public:
+    /*
+        @param num_threads Number of threads, 0 to use one per hardware thread
+    */
+    explicit work_stealing_pool(unsigned num_threads = 0) : num_threads(num_threads) {
+        if (this->num_threads == 0)
+            this->num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    /*
+        Calls job(i) once for every i in [0, num_jobs) and returns when all
+        have finished. The calling thread is one of the workers. job is
+        called from several threads at once.
+    */
+    template <class Job>
+    void run(size_t num_jobs, Job job) {
+        unsigned n = static_cast<unsigned>(std::min<size_t>(num_threads, std::max<size_t>(1, num_jobs)));
+        std::vector<std::unique_ptr<share>> shares;
+        for (unsigned t = 0; t < n; t++) {
+            shares.emplace_back(new share);
+            shares[t]->begin = num_jobs * t / n;
+            shares[t]->end = num_jobs * (t + 1) / n;
+        }
+
+        auto worker = [&](unsigned self) {
+            for (;;) {
+                size_t i;
+                if (take(*shares[self], i))
+                    job(i);
+                else if (!steal(shares, self))
+                    break;
+            }
+        };
+        std::vector<std::thread> threads;
+        for (unsigned t = 1; t < n; t++)
+            threads.emplace_back(worker, t);
+        worker(0);
+        for (std::thread &t : threads)
+            t.join();
+    }
+
+private:
+    //The jobs [begin, end) still waiting on one thread
+    struct share
+    {
+        std::mutex lock;
+        size_t begin = 0;
+        size_t end = 0;
+    };
+
+    unsigned num_threads;
+
+    //Takes the next job of a share
+    static bool take(share &s, size_t &i) {
+        std::lock_guard<std::mutex> guard(s.lock);
+        if (s.begin == s.end)
+            return false;
+        i = s.begin++;
+        return true;
+    }
+
+    //Moves the back half of the largest other share to self's. Returns false once every share is empty.
+    static bool steal(std::vector<std::unique_ptr<share>> &shares, unsigned self) {
+        for (;;) {
+            unsigned victim = self;
+            size_t most = 0;
+            for (unsigned t = 0; t < shares.size(); t++) {
+                if (t == self)
+                    continue;
+                std::lock_guard<std::mutex> guard(shares[t]->lock);
+                if (shares[t]->end - shares[t]->begin > most) {
+                    most = shares[t]->end - shares[t]->begin;
+                    victim = t;
+                }
+            }
+            if (victim == self)
+                return false;
+
+            size_t begin, end;
+            {
+                std::lock_guard<std::mutex> guard(shares[victim]->lock);
+                size_t left = shares[victim]->end - shares[victim]->begin;
+                if (left == 0)
+                    continue;
+                end = shares[victim]->end;
+                begin = end - (left + 1) / 2;
+                shares[victim]->end = begin;
+            }
+            std::lock_guard<std::mutex> guard(shares[self]->lock);
+            shares[self]->begin = begin;
+            shares[self]->end = end;
+            return true;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,230 @@
+/*
+prefetch.h
+Hardware prefetcher models for the cache levels in cache.h: next-line,
+a per-pc stride table and stream prefetching
+*/
+
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//Which prefetcher a level has
+enum prefetch_kind { PREFETCH_NONE, PREFETCH_NEXT_LINE, PREFETCH_STRIDE, PREFETCH_STREAM };
+
+//A level's prefetcher and its one parameter: how many blocks ahead next-line and stride prefetch,
+//or how many streams the stream prefetcher follows
+struct prefetch_config
+{
+    prefetch_kind kind = PREFETCH_NONE;
+    unsigned degree = 0;
+};
+
+//The largest degree --prefetch accepts
+const unsigned MAX_PREFETCH_DEGREE = 64;
+
+//Entries in the stride table, which is indexed by the low bits of the pc
+const unsigned STRIDE_TABLE_SIZE = 256;
+
+//A stride is used once it has repeated this many times in a row
+const unsigned STRIDE_CONFIDENT = 2;
+
+//Blocks a stream keeps prefetched ahead of the last block it was used for
+const unsigned STREAM_DEPTH = 4;
+
+//The model has no timing, so a prefetched block whose first use comes within this many demand
+//accesses to its level of being brought in counts as late: a real prefetch would still be on its way
+const unsigned PREFETCH_LATE_ACCESSES = 4;
+
+/*
+    Parses the argument of --prefetch.
+
+    @param spec One prefetcher per cache level, L1 first, separated by
+        commas: none, next, stride or stream, each optionally followed by
+        :N for its degree (default 1 block ahead for next and stride, 4
+        streams for stream). Levels past the end of the list have none.
+
+    @param levels Receives one prefetch_config per item
+
+    @return false if spec can't be parsed
+*/
+inline bool parse_prefetch_config(const std::string &spec, std::vector<prefetch_config> &levels) {
+    size_t start = 0;
+    while (true) {
+        size_t end = spec.find(',', start);
+        std::string item = spec.substr(start, end == std::string::npos ? std::string::npos : end - start);
+        std::string name = item.substr(0, item.find(':'));
+        prefetch_config c;
+        if (name == "none") c = {PREFETCH_NONE, 0};
+        else if (name == "next") c = {PREFETCH_NEXT_LINE, 1};
+        else if (name == "stride") c = {PREFETCH_STRIDE, 1};
+        else if (name == "stream") c = {PREFETCH_STREAM, 4};
+        else return false;
+        if (name.size() < item.size()) {
+            std::string n = item.substr(name.size() + 1);
+            if (c.kind == PREFETCH_NONE || n.empty() || n.size() > 2 ||
+                n.find_first_not_of("0123456789") != std::string::npos)
+                return false;
+            c.degree = std::stoi(n);
+            if (c.degree == 0 || c.degree > MAX_PREFETCH_DEGREE)
+                return false;
+        }
+        levels.push_back(c);
+        if (end == std::string::npos)
+            return true;
+        start = end + 1;
+    }
+}
+
+/*
+    Returns the name of a prefetcher as --prefetch spells it, e.g. stride:2.
+*/
+inline std::string prefetch_name(const prefetch_config &c) {
+    switch (c.kind) {
+    case PREFETCH_NEXT_LINE: return "next:" + std::to_string(c.degree);
+    case PREFETCH_STRIDE: return "stride:" + std::to_string(c.degree);
+    case PREFETCH_STREAM: return "stream:" + std::to_string(c.degree);
+    default: return "none";
+    }
+}
+
+//The prefetcher of one cache level. It watches the demand accesses that reach the level and names
+//the blocks to bring in next; cache.h fills them and keeps the accounting.
+//
+//  next    on a demand miss, or the first demand use of a prefetched block, the next degree blocks
+//  stride  a table indexed by pc of the last address and stride of each lw/sw. Once a stride
+//          has repeated STRIDE_CONFIDENT times in a row, every access by that pc prefetches the
+//          blocks 1 to degree strides ahead.
+//  stream  degree streams, each the next block it will prefetch. A miss or first use within the
+//          STREAM_DEPTH blocks a stream has prefetched moves it along to keep that many ahead;
+//          anywhere else it starts a new stream in place of the least recently used one.
+struct prefetcher
+{
+    prefetch_config config;
+
+    //The stride table; pc UINT16_MAX marks an empty entry
+    std::vector<uint16_t> stride_pc;
+    std::vector<uint32_t> stride_last;
+    std::vector<int32_t> stride_delta;
+    std::vector<uint8_t> stride_count;
+
+    //The streams: the next block each will prefetch, and when it was last used
+    std::vector<uint32_t> stream_next;
+    std::vector<uint64_t> stream_used;
+
+    //Demand accesses seen so far, the clock for stream_used and for late prefetches
+    uint64_t now = 0;
+
+    bool on() const { return config.kind != PREFETCH_NONE; }
+
+    void init(const prefetch_config &c) {
+        config = c;
+        now = 0;
+        stride_pc.assign(c.kind == PREFETCH_STRIDE ? STRIDE_TABLE_SIZE : 0, UINT16_MAX);
+        stride_last.assign(stride_pc.size(), 0);
+        stride_delta.assign(stride_pc.size(), 0);
+        stride_count.assign(stride_pc.size(), 0);
+        //A stream that has never been used points nowhere any block can be
+        stream_next.assign(c.kind == PREFETCH_STREAM ? c.degree : 0, UINT32_MAX);
+        stream_used.assign(stream_next.size(), 0);
+    }
+
+    /*
+        Tells the prefetcher about a demand access to its level.
+
+        @param pc The lw or sw
+
+        @param addr The address it accessed
+
+        @param block_size The block size of the level
+
+        @param trigger true if the access missed, or was the first use of a
+            prefetched block
+
+        @param issue Called with each block (address / block_size, possibly
+            past the end of the address space) to prefetch
+    */
+    template <class Issue>
+    void observe(unsigned pc, uint32_t addr, unsigned block_size, bool trigger, Issue issue) {
+        uint64_t block = addr / block_size;
+        now++;
+        switch (config.kind) {
+        case PREFETCH_NEXT_LINE:
+            if (trigger) {
+                for (unsigned k = 1; k <= config.degree; k++)
+                    issue(block + k);
+            }
+            break;
+        case PREFETCH_STRIDE: {
+            unsigned e = pc % STRIDE_TABLE_SIZE;
+            if (stride_pc[e] != pc) {
+                stride_pc[e] = static_cast<uint16_t>(pc);
+                stride_delta[e] = 0;
+                stride_count[e] = 0;
+            } else {
+                int32_t delta = static_cast<int32_t>(addr - stride_last[e]);
+                if (delta == stride_delta[e]) {
+                    if (stride_count[e] < STRIDE_CONFIDENT)
+                        stride_count[e]++;
+                } else {
+                    stride_delta[e] = delta;
+                    stride_count[e] = 0;
+                }
+            }
+            stride_last[e] = addr;
+            if (stride_count[e] < STRIDE_CONFIDENT || stride_delta[e] == 0)
+                break;
+            uint64_t last = block;
+            for (unsigned k = 1; k <= config.degree; k++) {
+                int64_t ahead = static_cast<int64_t>(addr) + static_cast<int64_t>(k) * stride_delta[e];
+                if (ahead < 0 || ahead > UINT32_MAX)
+                    break;
+                uint64_t b = static_cast<uint64_t>(ahead) / block_size;
+                if (b != last)
+                    issue(b);
+                last = b;
+            }
+            break;
+        }
+        case PREFETCH_STREAM: {
+            if (!trigger)
+                break;
+            size_t s = 0;
+            bool found = false;
+            for (size_t i = 0; i < stream_next.size() && !found; i++) {
+                found = block < stream_next[i] && stream_next[i] - block <= STREAM_DEPTH;
+                if (found)
+                    s = i;
+                else if (stream_used[i] < stream_used[s])
+                    s = i;
+            }
+            uint64_t next = found ? stream_next[s] : block + 1;
+            for (; next <= block + STREAM_DEPTH; next++)
+                issue(next);
+            stream_next[s] = next > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(next);
+            stream_used[s] = now;
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    //Passes the tables through a checkpoint archive (see checkpoint.h). The level must already
+    //have the prefetcher that was saved.
+    template <class Archive>
+    void serialize(Archive &ar) {
+        ar.io(stride_pc);
+        ar.io(stride_last);
+        ar.io(stride_delta);
+        ar.io(stride_count);
+        ar.io(stream_next);
+        ar.io(stream_used);
+        ar.io(now);
+    }
+};
+
+#endif
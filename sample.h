@@ -0,0 +1,129 @@
+/*
+sample.h
+Sampled simulation in the style of SMARTS: the program runs in periods of
+fast-forward (the interpreter alone, no cache), warm-up (the cache sees every
+access, but nothing is counted) and detail (the cache is simulated and
+counted as usual), so a long run only pays for the cache on a fraction of
+its instructions
+*/
+
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "cache.h"
+#include "log.h"
+#include "simulator.h"
+
+//The instructions in each phase of one sampling period
+struct sample_schedule
+{
+    uint64_t fast_forward = 0;
+    uint64_t warmup = 0;
+    uint64_t detail = 0;
+};
+
+//What a sampled run covered
+struct sample_result
+{
+    //Sampling periods started, the last one possibly cut short by the halt
+    uint64_t periods = 0;
+
+    //Instructions simulated in detail, and in all
+    uint64_t detail_cycles = 0;
+    uint64_t total_cycles = 0;
+};
+
+/*
+    Parses the argument of --sample.
+
+    @param arg FF,WARM,DETAIL: instructions to fast-forward, to warm the
+        cache and to simulate in detail per period. DETAIL must not be 0.
+
+    @param schedule Receives the parsed schedule
+
+    @return false if arg isn't three counts or DETAIL is 0
+*/
+inline bool parse_sample_schedule(const std::string &arg, sample_schedule &schedule) {
+    uint64_t counts[3];
+    size_t start = 0;
+    for (int i = 0; i < 3; i++) {
+        size_t end = i < 2 ? arg.find(',', start) : arg.size();
+        if (end == std::string::npos || end == start)
+            return false;
+        counts[i] = 0;
+        for (size_t p = start; p < end; p++) {
+            if (arg[p] < '0' || arg[p] > '9' || counts[i] > (UINT64_MAX - 9) / 10)
+                return false;
+            counts[i] = counts[i] * 10 + (arg[p] - '0');
+        }
+        start = end + 1;
+    }
+    if (counts[2] == 0)
+        return false;
+    schedule.fast_forward = counts[0];
+    schedule.warmup = counts[1];
+    schedule.detail = counts[2];
+    return true;
+}
+
+/*
+    Runs a machine to its halt on the schedule, starting with a
+    fast-forward. Only the detail phases reach the log and the level
+    statistics; the warm-up phases update the cache contents and
+    replacement state but leave the statistics as they were.
+
+    @param machine The machine to run, from wherever it is
+
+    @param caches The hierarchy to simulate, configured
+
+    @param log Receives the cache events of the detail phases
+
+    @param schedule The sampling periods
+
+    @return How much of the run was simulated in detail
+*/
+template <class Log>
+sample_result run_sampled(E20Machine &machine, CacheHierarchy &caches, Log &log, const sample_schedule &schedule) {
+    sample_result result;
+    std::vector<level_stats> counted(caches.num_levels());
+    bool split = caches.ifetch_mode() == FETCH_SPLIT;
+    level_stats fetched;
+    while (!machine.halted()) {
+        result.periods++;
+        if (schedule.fast_forward > 0)
+            result.total_cycles += machine.run(schedule.fast_forward);
+
+        //Warm-up goes through the same cache code as detail, so the hot path has no extra check;
+        //the statistics it gathers, the split instruction cache's included, are thrown away afterwards
+        if (schedule.warmup > 0 && !machine.halted()) {
+            for (size_t i = 0; i < counted.size(); i++)
+                counted[i] = caches.stats(i);
+            if (split)
+                fetched = caches.icache_stats();
+            cache_timing timed = caches.timing();
+            null_log quiet;
+            result.total_cycles += caches.run(machine, quiet, schedule.warmup);
+            for (size_t i = 0; i < counted.size(); i++)
+                caches.stats(i) = std::move(counted[i]);
+            if (split)
+                caches.icache_stats() = std::move(fetched);
+            caches.timing() = timed;
+
+            //The first fetch of the detail phase looks its block up rather than taking the
+            //fast path on a hit remembered from warm-up
+            caches.visit([](auto &My_cache) { My_cache.last_fetch = NO_FETCH_BLOCK; });
+        }
+
+        uint64_t detail = caches.run(machine, log, schedule.detail);
+        result.detail_cycles += detail;
+        result.total_cycles += detail;
+    }
+    return result;
+}
+
+#endif
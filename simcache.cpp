@@ -1,605 +1,933 @@
-/*
-CS-UY 2214
-Adapted from Jeff Epstein
-Starter code for E20 cache Simulator
-simcache.cpp
-*/
-
-#include <cstddef>
-#include <iostream>
-#include <string>
-#include <vector>
-#include <fstream>
-#include <limits>
-#include <iomanip>
-#include <regex>
-#include <cstdlib>
-#include <cstdint>
-#include <math.h>
-
-using namespace std;
-
-//Some helpful constant values that we'll be using.
-size_t const static NUM_REGS = 8;
-size_t const static MEM_SIZE = 1<<13;
-size_t const static REG_SIZE = 1<<16;
-
-/*
-    Loads an E20 machine code file into the list
-    provided by mem. We assume that mem is
-    large enough to hold the values in the machine
-    code file.
-
-    @param f Open file to read from
-    @param mem Array represetnting memory into which to read program
-*/
-void load_machine_code(ifstream &f, uint16_t mem[]) {
-    regex machine_code_re("^ram\\[(\\d+)\\] = 16'b(\\d+);.*$");
-    size_t expectedaddr = 0;
-    string line;
-    while (getline(f, line)) {
-        smatch sm;
-        if (!regex_match(line, sm, machine_code_re)) {
-            cerr << "Can't parse line: " << line << endl;
-            exit(1);
-        }
-        size_t addr = stoi(sm[1], nullptr, 10);
-        uint16_t instr = stoi(sm[2], nullptr, 2);
-        if (addr != expectedaddr) {
-            cerr << "Memory addresses encountered out of sequence: " << addr << endl;
-            exit(1);
-        }
-        if (addr >= MEM_SIZE) {
-            cerr << "Program too big for memory" << endl;
-            exit(1);
-        }
-        expectedaddr ++;
-        mem[addr] = instr;
-    }
-}
-
-/*
-    Prints out the correctly-formatted configuration of a cache.
-
-    @param cache_name The name of the cache. "L1" or "L2"
-
-    @param size The total size of the cache, measured in memory cells.
-        Excludes metadata
-
-    @param assoc The associativity of the cache. One of [1,2,4,8,16]
-
-    @param blocksize The blocksize of the cache. One of [1,2,4,8,16,32,64])
-
-    @param num_rows The number of rows in the given cache.
-*/
-void print_cache_config(const string &cache_name, int size, int assoc, int blocksize, int num_rows) {
-    cout << "Cache " << cache_name << " has size " << size <<
-        ", associativity " << assoc << ", blocksize " << blocksize <<
-        ", rows " << num_rows << endl;
-}
-
-/*
-    Prints out a correctly-formatted log entry.
-
-    @param cache_name The name of the cache where the event
-        occurred. "L1" or "L2"
-
-    @param status The kind of cache event. "SW", "HIT", or
-        "MISS"
-
-    @param pc The program counter of the memory
-        access instruction
-
-    @param addr The memory address being accessed.
-
-    @param row The cache row or set number where the data
-        is stored.
-*/
-void print_log_entry(const string &cache_name, const string &status, int pc, int addr, int row) {
-    cout << left << setw(8) << cache_name + " " + status <<  right <<
-        " pc:" << setw(5) << pc <<
-        "\taddr:" << setw(5) << addr <<
-        "\trow:" << setw(4) << row << endl;
-}
-
-//A struct that represents a block. It stores a tag and the clock cycle during which it was created
-//The clock cycle stamp is used to check later if the block is the least recently used one, for eviction purposes
-struct block
-{
-    uint32_t clock_cycle_stamp = 0;
-    uint16_t tag = -1;
-};
-
-//A struct that represents a row. It contains a vector of blocks
-struct row
-{
-    vector<block> My_blocks;
-};
-
-//A struct that represents a cache level. It stores the size of the cache, the associativity, and block size.
-//It also stores a vector of rows.
-struct level
-{
-    int cache_size = 0;
-    int associativity = 0;
-    int block_size = 0;
-    vector<row> My_rows;
-};
-
-//A struct that contains a vector of cache levels.
-struct cache
-{
-    vector<level> My_levels;
-};
-
-/**
-    Main function
-    Takes command-line args as documented below
-*/
-int main(int argc, char *argv[])
-{
-    /*
-        Parse the command-line arguments
-    */
-    char *filename = nullptr;
-    bool do_help = false;
-    bool arg_error = false;
-    string cache_config;
-    for (int i=1; i<argc; i++) {
-        string arg(argv[i]);
-        if (arg.rfind("-",0)==0) {
-            if (arg== "-h" || arg == "--help")
-                do_help = true;
-            else if (arg=="--cache") {
-                i++;
-                if (i>=argc)
-                    arg_error = true;
-                else
-                    cache_config = argv[i];
-            }
-            else
-                arg_error = true;
-        } else {
-            if (filename == nullptr)
-                filename = argv[i];
-            else
-                arg_error = true;
-        }
-    }
-    /* Display error message if appropriate */
-    if (arg_error || do_help || filename == nullptr) {
-        cerr << "usage " << argv[0] << " [-h] [--cache CACHE] filename" << endl << endl;
-        cerr << "Simulate E20 cache" << endl << endl;
-        cerr << "positional arguments:" << endl;
-        cerr << "  filename    The file containing machine code, typically with .bin suffix" << endl<<endl;
-        cerr << "optional arguments:"<<endl;
-        cerr << "  -h, --help  show this help message and exit"<<endl;
-        cerr << "  --cache CACHE  Cache configuration: size,associativity,blocksize (for one"<<endl;
-        cerr << "                 cache) or"<<endl;
-        cerr << "                 size,associativity,blocksize,size,associativity,blocksize"<<endl;
-        cerr << "                 (for two caches)"<<endl;
-        return 1;
-    }
-
-    //Opens file and checks if file can be opened
-    ifstream f(filename);
-    if (!f.is_open()) {
-        cerr << "Can't open file "<<filename<<endl;
-        return 1;
-    }
-
-    //Initializes my processor state, including the program counter, the general-purpose registers, and memory
-    //Everything is uint16_t to let overflow wrap around
-    uint16_t memory[MEM_SIZE] = {};
-    uint16_t pc = 0;
-    uint16_t regs[REG_SIZE] = {};
-
-    //Loads f and parses using load_machine_code
-    load_machine_code(f,memory);
-
-    //A variable that keeps track of the clock cycle. Is useful for knowing which block is the least recently used.
-    uint16_t clock_cycle = 0; 
-
-    //A struct which represents my cache. This contains levels of cache, rows, blocks, etc.
-    cache My_cache;
-
-    /* parse cache config */
-    if (cache_config.size() > 0)
-    {
-        vector<int> parts;
-        size_t pos;
-        size_t lastpos = 0;
-        while ((pos = cache_config.find(",", lastpos)) != string::npos)
-        {
-            parts.push_back(stoi(cache_config.substr(lastpos,pos)));
-            lastpos = pos + 1;
-        }
-        parts.push_back(stoi(cache_config.substr(lastpos)));
-        if (parts.size() == 3)
-        {
-            int L1size = parts[0];
-            int L1assoc = parts[1];
-            int L1blocksize = parts[2];
-
-            //A variable that stores the number of rows for L1
-            uint16_t num_of_rows = L1size / (L1blocksize * L1assoc);
-
-            //Initializes my cache with one level
-            My_cache.My_levels.emplace_back();
-
-            //Assigns the associativity, block size, and cache size to my L1 cache
-            My_cache.My_levels[0].associativity = L1assoc;
-            My_cache.My_levels[0].block_size = L1blocksize;
-            My_cache.My_levels[0].cache_size = L1size;
-
-            //A for loop that creates empty rows in my L1 cache equal to the number of rows, which was calculated earlier
-            for(uint16_t i = 0; i < num_of_rows; i++)
-            {
-                My_cache.My_levels[0].My_rows.emplace_back();
-            }
-        }
-        else if (parts.size() == 6)
-        {
-            int L1size = parts[0];
-            int L1assoc = parts[1];
-            int L1blocksize = parts[2];
-            int L2size = parts[3];
-            int L2assoc = parts[4];
-            int L2blocksize = parts[5];
-
-            //A variable that stores the number of rows for L1
-            uint16_t num_of_rows = L1size / (L1blocksize * L1assoc);
-
-            //Initializes my cache with one level
-            My_cache.My_levels.emplace_back();
-            
-            //Assigns the associativity, block size, and cache size to my L1 cache
-            My_cache.My_levels[0].associativity = L1assoc;
-            My_cache.My_levels[0].block_size = L1blocksize;
-            My_cache.My_levels[0].cache_size = L1size;
-
-            //A for loop that creates empty rows in my L1 cache equal to the number of rows, which was calculated earlier
-            for(uint16_t i = 0; i < num_of_rows; i++)
-            {
-                My_cache.My_levels[0].My_rows.emplace_back();
-            }
-
-            //A variable that stores the number of rows for L2
-            num_of_rows = L2size / (L2blocksize * L2assoc);
-
-            //Creates an L2 cache in my levels vector
-            My_cache.My_levels.emplace_back();
-
-            //Assigns associativity, blocksize, and size to my L2 cache
-            My_cache.My_levels[1].associativity = L2assoc;
-            My_cache.My_levels[1].block_size = L2blocksize;
-            My_cache.My_levels[1].cache_size = L2size;
-
-            //A for loop that creates empty rows in my L2 cache equal to the number of rows, which was calculated earlier
-            for(uint16_t j = 0; j < num_of_rows; j++)
-            {
-                My_cache.My_levels[1].My_rows.emplace_back();
-            }
-        }
-        else
-        {
-            cerr << "Invalid cache config"  << endl;
-            return 1;
-        }
-
-        //Prints out the cache configuration for the levels in the cache
-        for(int i = 0; i < My_cache.My_levels.size(); i++)
-        {
-            print_cache_config("L" + to_string(i+1), My_cache.My_levels[i].cache_size, My_cache.My_levels[i].associativity, My_cache.My_levels[i].block_size, My_cache.My_levels[i].My_rows.size());
-        }
-
-        //Checks if a halt command exists
-        bool halt_checker = false;
-
-        //Stores the opcode
-        uint16_t opcode = 0;
-
-        //Stores the last four bits
-        uint16_t LSB_4 = 0;
-
-        //Program stops checking for instructions once a halt is detected
-        while(!halt_checker)
-        {
-            //Gets opcode and last four bits in 16_bit binary
-            opcode = memory[pc % MEM_SIZE] >> 13; 
-            LSB_4 = (memory[pc % MEM_SIZE] & 0b1111);
-
-            //Instructions With Three Register Arguments
-            //All of these instructions have an opcode of 000
-            //Each instructions is differentiated by their last four bits
-            if(opcode == 0b000)
-            {
-                //I made pointer variables that represent the three registers used
-                //I can use these variables to update the registers
-                uint16_t* regA = &regs[((memory[pc % MEM_SIZE] & 0b0001110000000000)>>10)];
-                uint16_t* regB = &regs[((memory[pc % MEM_SIZE] & 0b0000001110000000)>>7)];
-                uint16_t* regDst = &regs[((memory[pc % MEM_SIZE] & 0b0000000001110000)>>4)];
-
-                //add instruction: adds values in register A and B and stores the result in the destination register
-                if(LSB_4 == 0b0000)
-                {
-                    *regDst = *regA + *regB;
-                }
-                //sub instruction: subtracts values in register A and B and stores the result in the destination register
-                else if(LSB_4 == 0b0001)
-                {
-                    *regDst = *regA - *regB;
-                }
-                //or instruction: performs bitwise OR operation on values in register A and B and stores the result in the destination register
-                else if(LSB_4 == 0b0010)
-                {
-                    *regDst = *regA | *regB;
-                }
-                //and instruction: performs bitwise AND operation on values in register A and B and stores the result in the destination register
-                else if(LSB_4 == 0b0011)
-                {
-                    *regDst = *regA & *regB;
-                }
-                //slt instruction: checks if register A is less than register B and stores 1 in the destination register if true and 0 in the
-                //destination register if false
-                //The operands are unsigned 16-bit
-                else if(LSB_4 == 0b0100)
-                {
-                    *regDst = (*regA < *regB);
-                }
-                //jr instruction: jumps to a memory address that is the value in register A
-                //I subtract the value given by the register by 1, since I add 1 at the end
-                //Checks if bits 9 to 4 are 0, in case an invalid instruction was created using store word
-                //Any other 16 bit instruction created by store word in my program should have an associated instruction or be ignored
-                else if((LSB_4 == 0b1000) && (memory[pc % MEM_SIZE] & 0b0000001111110000) == 0)
-                {
-                    pc = *regA - 1;
-                }
-                //increments pc counter by 1
-                pc += 1;
-
-            }
-            //Instructions With No Register Arguments
-            //All of these instructions have their first two bits as 01
-            //Each instruction is differentiated by their opcode
-            else if((opcode & 0b110)  == 0b010)
-            {
-                //j imm instruction: jumps unconditionally to a memory address that is the immediate value
-                if(opcode == 0b010)
-                {
-                    //Remembers the last pc value, performs a jump, and if the jumped pc value is the same as the previous one,
-                    //The halt checker becomes true. This means a halt instruction was called
-                    uint16_t last_pc = pc;
-                    pc = (memory[pc % MEM_SIZE] & 0b0001111111111111);
-                    if(last_pc == pc)
-                    {
-                        halt_checker = true;
-                    }
-                }
-                //jal instruction: stores the next memory address in register 7 and then jumps unconditionally to a memory address
-                //that is the immediate value
-                else if(opcode == 0b011)
-                {
-                    regs[7] = pc+1;
-                    pc = (memory[pc % MEM_SIZE] & 0b0001111111111111);
-                }
-            }
-            //Instructions With Two Register Arguments
-            //Each instruction is differentiated by their opcode
-            else
-            {
-                //I made variables that represents the two registers that can represent regA, regB,
-                //regSrc, regDst, or regAddr, depending on the instrucion. Also a variable that
-                //stores the immediate
-                uint16_t* regA = &regs[((memory[pc % MEM_SIZE] & 0b0001110000000000)>>10)];
-                uint16_t* regB = &regs[((memory[pc % MEM_SIZE] & 0b0000001110000000)>>7)];
-                uint16_t imm = (memory[pc % MEM_SIZE] & 0b0000000001111111);
-
-                //Sign extends my immediate so that any immediate operations use a sign extended immediate
-                if((imm & 0b1000000) == 0b1000000)
-                {
-                    imm = imm ^ 0b1111111110000000;
-                }
-
-                //slti instruction: checks if register A is less than the immediate value and stores 1 in register B if true
-                //and 0 in register B if false
-                if(opcode == 0b111)
-                {
-                    *regB = (*regA < imm);
-                }
-                //lw instruction: stores the instruction from the memory address at register A plus the immediate value in register B
-                else if(opcode == 0b100)
-                {
-                    *regB = memory[(*regA + imm) % MEM_SIZE];
-
-                    //Variables to store blockID, row, and tag. Will be calculated later in a while loop
-                    uint16_t blockID = 0;
-                    uint16_t row = 0;
-                    uint16_t tag = 0;
-
-                    //A variable that tracks if the needed block is found or not
-                    uint16_t block_found = false;
-
-                    //A variable that is the max value of a uint64_t. This is so it is higher than the clock_cycle_stamps of all blocks which are uint32_t's
-                    //Will be used to compare block clock_cycle_stamps with each other to find the smallest one, which is the least recently used
-                    uint64_t curr_LRU = UINT64_MAX;
-
-                    //A variable that keeps track of the index of the least recently used block
-                    uint16_t LRU = 0;
-
-                    //A variable that keeps track of the current level being used
-                    uint16_t curr_level = 0;
-
-                    //A while loop that will determine if any hits were found. Ends early if block is found
-                    while(curr_level < My_cache.My_levels.size() && !block_found)
-                    {
-                        //BlockID, row, and tag are calculated here and used to determine hits
-                        //curr_LRU and LRU are reset here for when we loop through each level
-                        blockID = ((*regA + imm) % MEM_SIZE) / My_cache.My_levels[curr_level].block_size;
-                        row = blockID % My_cache.My_levels[curr_level].My_rows.size();
-                        tag = blockID / My_cache.My_levels[curr_level].My_rows.size();
-                        curr_LRU = UINT64_MAX;
-                        LRU = 0;
-
-                        //Loops through each block in the calculated row to see if any of them have the needed tag
-                        for(uint16_t i = 0; i < My_cache.My_levels[curr_level].My_rows[row].My_blocks.size(); i++)
-                        {
-                            //Everytime a block with an earlier clock_cycle_stamp is found, its index is recorded so it can
-                            //be evicted later if there is a miss and the block size is the same as associativity
-                            if(My_cache.My_levels[curr_level].My_rows[row].My_blocks[i].clock_cycle_stamp < curr_LRU)
-                            {
-                                curr_LRU = My_cache.My_levels[curr_level].My_rows[row].My_blocks[i].clock_cycle_stamp;
-                                LRU = i;
-                            }
-
-                            //A hit or miss if statement. It checks if the block we are looking at has the needed tag
-                            if(My_cache.My_levels[curr_level].My_rows[row].My_blocks[i].tag == tag)
-                            {
-                                //If a hit happens, this updates the clock_cycle_stamp of the hit block to be the current clock_cycle
-                                //and block_found is changed to true.
-                                My_cache.My_levels[curr_level].My_rows[row].My_blocks[i].clock_cycle_stamp = clock_cycle;
-                                block_found = true;
-
-                                //Prints a log entry indicating a hit at the current level, calculated row, and pc counter. Then ends the for loop early, since the block is found
-                                print_log_entry("L" + to_string(curr_level + 1), "HIT", pc, ((*regA + imm) % MEM_SIZE), row);
-                                i = My_cache.My_levels[curr_level].My_rows[row].My_blocks.size();
-                            }
-                        }
-
-                        //If the block has not been found, this will indicate any misses and create blocks and/or evict blocks
-                        if(!block_found)
-                        {
-                            //Prints a log entry indicating a miss at the current level, calculated row, and pc counter
-                            print_log_entry("L" + to_string(curr_level + 1), "MISS", pc, ((*regA + imm) % MEM_SIZE), row);
-
-                            //If the max amount of blocks is reached, the least recently used block is evicted
-                            if(My_cache.My_levels[curr_level].My_rows[row].My_blocks.size() == My_cache.My_levels[curr_level].associativity)
-                            {
-                                My_cache.My_levels[curr_level].My_rows[row].My_blocks.erase(My_cache.My_levels[curr_level].My_rows[row].My_blocks.begin() + LRU);
-                            }
-
-                            //A new block is added to the row with the calculated tag and current block cycle
-                            block new_block = {clock_cycle, tag};
-                            My_cache.My_levels[curr_level].My_rows[row].My_blocks.push_back(new_block);
-
-                            //The level counter is incremented to convey that we are moving to the next level of cache
-                            curr_level++;
-                        }
-                        //If the block has been found
-                        else
-                        {
-                            //Ends the while loop early because the block has already been found
-                            curr_level = My_cache.My_levels.size();
-                        }
-                    }
-                }
-                //sw instruction: changes the instruction at the memory address at register A plus the immediate value to the value in register B
-                else if(opcode == 0b101)
-                {
-                    memory[(*regA + imm) % MEM_SIZE] = *regB;
-
-                    //Variables to store blockID, row, and tag. Will be calculated later in a while loop
-                    uint16_t blockID = 0;
-                    uint16_t row = 0;
-                    uint16_t tag = 0;
-
-                    //A variable that tracks if the needed block is found or not
-                    uint16_t block_found = false;
-
-                    //A variable that is the max value of a uint64_t. This is so it is higher than the clock_cycle_stamps of all blocks which are uint32_t's
-                    //Will be used to compare block clock_cycle_stamps with each other to find the smallest one, which is the least recently used
-                    uint64_t curr_LRU = UINT64_MAX;
-
-                    //A variable that keeps track of the index of the least recently used block
-                    uint16_t LRU = 0;
-
-                    //A variable that keeps track of the current level being used
-                    uint16_t curr_level = 0;
-
-                    //A while loop that will determine if any hits were found. Does not end early if block is found, since write through will write to all cache levels
-                    while(curr_level < My_cache.My_levels.size())
-                    {
-                        //BlockID, row, and tag are calculated here and used to determine hits
-                        //curr_LRU and LRU are reset here for when we loop through each level
-                        blockID = ((*regA + imm) % MEM_SIZE) / My_cache.My_levels[curr_level].block_size;
-                        row = blockID % My_cache.My_levels[curr_level].My_rows.size();
-                        tag = blockID / My_cache.My_levels[curr_level].My_rows.size();
-                        curr_LRU = UINT64_MAX;
-                        LRU = 0;
-
-                        //Loops through each block in the calculated row to see if any of them have the needed tag
-                        for(uint16_t i = 0; i < My_cache.My_levels[curr_level].My_rows[row].My_blocks.size(); i++)
-                        {
-                            //Everytime a block with an earlier clock_cycle_stamp is found, its index is recorded so it can
-                            //be evicted later if there is a miss and the block size is the same as associativity
-                            if(My_cache.My_levels[curr_level].My_rows[row].My_blocks[i].clock_cycle_stamp < curr_LRU)
-                            {
-                                curr_LRU = My_cache.My_levels[curr_level].My_rows[row].My_blocks[i].clock_cycle_stamp;
-                                LRU = i;
-                            }
-
-                            //A hit or miss if statement. It checks if the block we are looking at has the needed tag
-                            if(My_cache.My_levels[curr_level].My_rows[row].My_blocks[i].tag == tag)
-                            {
-                                //If a hit happens, this updates the clock_cycle_stamp of the hit block to be the current clock_cycle
-                                //and block_found is changed to true.
-                                My_cache.My_levels[curr_level].My_rows[row].My_blocks[i].clock_cycle_stamp = clock_cycle;
-                                block_found = true;
-
-                                //Ends the for loop early, since the block is found
-                                i = My_cache.My_levels[curr_level].My_rows[row].My_blocks.size();
-                            }
-                        }
-
-                        //No matter if a hit or miss occurs, a store word instruction will occur.
-                        //Prints a log entry indicating a SW at the current level, calculated row, and pc counter
-                        print_log_entry("L" + to_string(curr_level + 1), "SW", pc, ((*regA + imm) % MEM_SIZE), row);
-                        
-                        //If the block has not been found, this will indicate any misses and create blocks and/or evict blocks
-                        if(!block_found)
-                        {
-                            //If the max amount of blocks is reached, the least recently used block is evicted
-                            if(My_cache.My_levels[curr_level].My_rows[row].My_blocks.size() == My_cache.My_levels[curr_level].associativity)
-                            {
-                                My_cache.My_levels[curr_level].My_rows[row].My_blocks.erase(My_cache.My_levels[curr_level].My_rows[row].My_blocks.begin() + LRU);
-                            }
-
-                            //A new block is added to the row with the calculated tag and current block cycle
-                            block new_block = {clock_cycle, tag};
-                            My_cache.My_levels[curr_level].My_rows[row].My_blocks.push_back(new_block);
-                        }
-                                                    
-                        //The level counter is incremented to convey that we are moving to the next level of cache
-                        curr_level++;
-                    }
-                }
-                //jeq instruction: checks if the value in registers A and B are equal. If so, jump to the immediate value + pc.
-                //It does not add one, since one is added at the end
-                else if(opcode == 0b110)
-                {
-                    if(*regA == *regB)
-                    {
-                        pc = imm + pc;
-                    }
-                }
-                //addi instruction: adds the value in register A to the immediate value and stores the result in register B
-                else if(opcode == 0b001)
-                {
-                    *regB = *regA + imm;
-                }
-                //increments pc counter by 1
-                pc += 1;
-            }
-
-            //increments clock cycle
-            clock_cycle++;
-
-            //resets register 0 to 0
-            regs[0] = 0;
-        }
-
-    }
-
-    return 0;
-}
-//ra0Eequ6ucie6Jei0koh6phishohm9
+/*
+CS-UY 2214
+Adapted from Jeff Epstein
+Starter code for E20 cache Simulator
+simcache.cpp
+*/
+
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <limits>
+#include <iomanip>
+#include <cstdlib>
+#include <cstdint>
+#include <math.h>
+
+#include "batch.h"
+#include "checkpoint.h"
+#include "loader.h"
+#include "log.h"
+#include "multicore.h"
+#include "sample.h"
+#include "simulator.h"
+#include "stackdist.h"
+#include "stats.h"
+#include "sweep.h"
+#include "timeline.h"
+#include "trace.h"
+
+using namespace std;
+
+/*
+    Reports the levels of a cache to the log.
+*/
+void log_cache_config(const CacheHierarchy &My_cache, event_log &log) {
+    //Prints out the cache configuration for the levels in the cache
+    for(size_t i = 0; i < My_cache.num_levels(); i++)
+    {
+        const level &lvl = My_cache.level_info(i);
+        log.config(i, lvl.cache_size, lvl.associativity, lvl.block_size, lvl.num_rows);
+    }
+}
+
+/*
+    Builds the cache described by --cache, with the prefetchers of --prefetch,
+    the instruction fetches of --ifetch, the write policies of --write and the
+    latencies of --latency, and reports its levels to the log.
+
+    @return false, after printing an error, if the configuration is invalid
+*/
+bool setup_cache(CacheHierarchy &My_cache, const string &cache_config, replacement_policy policy,
+    const string &prefetch, const string &ifetch, const string &write, const string &latency, event_log &log) {
+    if (!My_cache.set_ifetch(ifetch) || !My_cache.configure(cache_config, policy))
+    {
+        cerr << "Invalid cache config"  << endl;
+        return false;
+    }
+    if (!My_cache.set_prefetch(prefetch))
+    {
+        cerr << "More prefetchers than cache levels" << endl;
+        return false;
+    }
+    if (!My_cache.set_write(write))
+    {
+        cerr << "More write policies than cache levels" << endl;
+        return false;
+    }
+    if (!My_cache.set_latency(latency))
+    {
+        cerr << "--latency needs one latency per cache level, then memory's" << endl;
+        return false;
+    }
+    log_cache_config(My_cache, log);
+    return true;
+}
+
+/*
+    Prints the stall cycles, AMAT and effective CPI of a timed cache's run
+    to stderr, so they don't mix with the log. A trace replay has no
+    instruction count, so no CPI.
+*/
+void report_timing(const CacheHierarchy &My_cache) {
+    const cache_timing &t = My_cache.timing();
+    if (!t.on)
+        return;
+    cerr << "Stall cycles " << t.stall_cycles << " over " << t.accesses << " accesses, AMAT " << fixed <<
+        setprecision(3) << t.amat() << " cycles";
+    if (t.instructions > 0)
+        cerr << ", effective CPI " << t.cpi() << " over " << t.instructions << " instructions";
+    cerr << endl;
+}
+
+/*
+    Prints the phases a --timeline run found to stderr, with the interval
+    that represents each.
+*/
+void report_phases(const timeline_result &phases) {
+    cerr << "Timeline of " << phases.intervals << " intervals in " << phases.phase_intervals.size() << " phases" << endl;
+    for (size_t p = 0; p < phases.phase_intervals.size(); p++) {
+        cerr << "Phase " << p << ": " << phases.phase_intervals[p] << " intervals, represented by interval " <<
+            phases.representatives[p] << " at cycle " << phases.representative_cycles[p] << endl;
+    }
+}
+
+/*
+    Replays a trace file written by --dump-trace, either through the cache
+    given by --cache or through every configuration of a sweep.
+
+    @param stats If not null, receives the cache statistics at the end
+
+    @param num_threads Worker threads for a sweep, 0 for one per hardware thread
+
+    @param prefetch The prefetchers of --prefetch, "" for none
+
+    @param write, latency The write policies of --write and latencies of --latency, "" for the defaults
+
+    @param classify Whether to classify misses (--classify-misses)
+
+    @param pipelined Whether to run the levels of the cache on threads of their own (see pipeline.h)
+
+    @param corrected Whether stores bring their block into every level that misses (--corrected)
+
+    @return The exit status for main
+*/
+int replay_trace_file(const char *trace_path, const string &cache_config, const char *sweep_file,
+    const vector<string> &configs, replacement_policy policy, const string &prefetch, const string &write,
+    const string &latency, log_mode mode, stats_writer *stats, unsigned num_threads, bool classify, bool pipelined,
+    bool corrected) {
+    trace_file trace;
+    string error;
+    if (!trace.open(trace_path, error)) {
+        cerr << error << endl;
+        return 1;
+    }
+
+    if (sweep_file != nullptr)
+    {
+        if (!run_sweep(trace, configs, stdout, policy, stats, num_threads, classify, corrected)) {
+            cerr << "Trace file is truncated: " << trace_path << endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    event_log log(mode);
+    CacheHierarchy My_cache;
+    My_cache.set_classify_misses(classify);
+    My_cache.set_corrected(corrected);
+    if (!setup_cache(My_cache, cache_config, policy, prefetch, "", write, latency, log))
+        return 1;
+    bool ok = My_cache.visit([&](auto &caches) {
+        auto replay = [&](auto &hook) {
+            return trace.for_each([&](const mem_access &a) {
+                if (a.is_store)
+                    hook.store(a.pc, a.addr, a.clock_cycle);
+                else
+                    hook.load(a.pc, a.addr, a.clock_cycle);
+            });
+        };
+        if (pipelined)
+            return run_pipelined(caches, log, replay);
+        cache_hook<typename remove_reference<decltype(caches)>::type, event_log> hook{caches, log};
+        return replay(hook);
+    });
+    log.finish();
+    report_timing(My_cache);
+    if (stats != nullptr)
+        My_cache.report(*stats);
+    if (!ok) {
+        cerr << "Trace file is truncated: " << trace_path << endl;
+        return 1;
+    }
+    return 0;
+}
+
+/**
+    Main function
+    Takes command-line args as documented below
+*/
+int main(int argc, char *argv[])
+{
+    /*
+        Parse the command-line arguments
+    */
+    char *filename = nullptr;
+    bool do_help = false;
+    bool arg_error = false;
+    string cache_config;
+    string prefetch;
+    string ifetch;
+    string write;
+    string latency;
+    char *sweep_file = nullptr;
+    char *dump_trace_file = nullptr;
+    char *replay_trace = nullptr;
+    char *write_image_file = nullptr;
+    char *stats_file = nullptr;
+    char *batch_file = nullptr;
+    char *timeline_file = nullptr;
+    uint64_t interval = 100000;
+    bool have_interval = false;
+    phase_signature signature = SIGNATURE_PC;
+    bool have_signature = false;
+    char *save_checkpoint_file = nullptr;
+    char *restore_file = nullptr;
+    uint64_t checkpoint_at = 0;
+    bool have_checkpoint_at = false;
+    sample_schedule schedule;
+    bool sampling = false;
+    bool use_jit = false;
+    bool wide = false;
+    bool pipelined = false;
+    bool classify = false;
+    bool corrected = false;
+    int num_threads = 0;
+    int num_cores = 0;
+    uint64_t quantum = 1000;
+    bool have_quantum = false;
+    int sd_blocksize = 0;
+    vector<uint32_t> sd_rows;
+    log_mode mode = LOG_TEXT;
+    replacement_policy policy = POLICY_LRU;
+    for (int i=1; i<argc; i++) {
+        string arg(argv[i]);
+        if (arg.rfind("-",0)==0) {
+            if (arg== "-h" || arg == "--help")
+                do_help = true;
+            else if (arg=="--cache") {
+                i++;
+                if (i>=argc)
+                    arg_error = true;
+                else
+                    cache_config = argv[i];
+            }
+            else if (arg=="--sweep") {
+                i++;
+                if (i>=argc)
+                    arg_error = true;
+                else
+                    sweep_file = argv[i];
+            }
+            else if (arg=="--dump-trace") {
+                i++;
+                if (i>=argc)
+                    arg_error = true;
+                else
+                    dump_trace_file = argv[i];
+            }
+            else if (arg=="--replay-trace") {
+                i++;
+                if (i>=argc)
+                    arg_error = true;
+                else
+                    replay_trace = argv[i];
+            }
+            else if (arg=="--write-image") {
+                i++;
+                if (i>=argc)
+                    arg_error = true;
+                else
+                    write_image_file = argv[i];
+            }
+            else if (arg=="--stack-distance") {
+                i++;
+                if (i>=argc)
+                    arg_error = true;
+                else {
+                    sd_blocksize = atoi(argv[i]);
+                    if (sd_blocksize <= 0)
+                        arg_error = true;
+                }
+            }
+            else if (arg=="--rows") {
+                i++;
+                if (i>=argc || !parse_rows_list(argv[i], sd_rows))
+                    arg_error = true;
+            }
+            else if (arg=="--batch") {
+                i++;
+                if (i>=argc)
+                    arg_error = true;
+                else
+                    batch_file = argv[i];
+            }
+            else if (arg=="--threads") {
+                i++;
+                if (i>=argc)
+                    arg_error = true;
+                else {
+                    num_threads = atoi(argv[i]);
+                    if (num_threads <= 0)
+                        arg_error = true;
+                }
+            }
+            else if (arg=="--cores") {
+                i++;
+                if (i>=argc)
+                    arg_error = true;
+                else {
+                    num_cores = atoi(argv[i]);
+                    if (num_cores <= 0 || num_cores > static_cast<int>(MAX_CORES))
+                        arg_error = true;
+                }
+            }
+            else if (arg=="--quantum") {
+                i++;
+                char *end = nullptr;
+                if (i>=argc || argv[i][0] < '1' || argv[i][0] > '9')
+                    arg_error = true;
+                else {
+                    //A core's accesses record how far into the quantum they came in 32 bits
+                    quantum = strtoull(argv[i], &end, 10);
+                    if (*end != '\0' || quantum > UINT32_MAX)
+                        arg_error = true;
+                    have_quantum = true;
+                }
+            }
+            else if (arg=="--sample") {
+                i++;
+                if (i>=argc || !parse_sample_schedule(argv[i], schedule))
+                    arg_error = true;
+                else
+                    sampling = true;
+            }
+            else if (arg=="--checkpoint-at") {
+                i++;
+                char *end = nullptr;
+                if (i>=argc || argv[i][0] < '0' || argv[i][0] > '9')
+                    arg_error = true;
+                else {
+                    checkpoint_at = strtoull(argv[i], &end, 10);
+                    have_checkpoint_at = true;
+                    if (*end != '\0')
+                        arg_error = true;
+                }
+            }
+            else if (arg=="--save-checkpoint") {
+                i++;
+                if (i>=argc)
+                    arg_error = true;
+                else
+                    save_checkpoint_file = argv[i];
+            }
+            else if (arg=="--restore") {
+                i++;
+                if (i>=argc)
+                    arg_error = true;
+                else
+                    restore_file = argv[i];
+            }
+            else if (arg=="--jit")
+                use_jit = true;
+            else if (arg=="--wide")
+                wide = true;
+            else if (arg=="--pipeline")
+                pipelined = true;
+            else if (arg=="--classify-misses")
+                classify = true;
+            else if (arg=="--corrected")
+                corrected = true;
+            else if (arg=="--stats") {
+                i++;
+                if (i>=argc)
+                    arg_error = true;
+                else
+                    stats_file = argv[i];
+            }
+            else if (arg=="--policy") {
+                i++;
+                if (i>=argc || !parse_policy(argv[i], policy))
+                    arg_error = true;
+            }
+            else if (arg=="--prefetch") {
+                i++;
+                vector<prefetch_config> prefetchers;
+                if (i>=argc || !parse_prefetch_config(argv[i], prefetchers))
+                    arg_error = true;
+                else
+                    prefetch = argv[i];
+            }
+            else if (arg=="--ifetch") {
+                i++;
+                fetch_mode fetch;
+                vector<int> parts;
+                if (i>=argc || !parse_fetch_config(argv[i], fetch, parts) || fetch == FETCH_OFF)
+                    arg_error = true;
+                else
+                    ifetch = argv[i];
+            }
+            else if (arg=="--timeline") {
+                i++;
+                if (i>=argc)
+                    arg_error = true;
+                else
+                    timeline_file = argv[i];
+            }
+            else if (arg=="--interval") {
+                i++;
+                char *end = nullptr;
+                if (i>=argc || argv[i][0] < '1' || argv[i][0] > '9')
+                    arg_error = true;
+                else {
+                    interval = strtoull(argv[i], &end, 10);
+                    have_interval = true;
+                    if (*end != '\0')
+                        arg_error = true;
+                }
+            }
+            else if (arg=="--phase-signature") {
+                i++;
+                if (i>=argc || !parse_phase_signature(argv[i], signature))
+                    arg_error = true;
+                have_signature = true;
+            }
+            else if (arg=="--write") {
+                i++;
+                vector<write_config> writes;
+                if (i>=argc || !parse_write_config(argv[i], writes))
+                    arg_error = true;
+                else
+                    write = argv[i];
+            }
+            else if (arg=="--latency") {
+                i++;
+                vector<unsigned> latencies;
+                if (i>=argc || !parse_latency_config(argv[i], latencies))
+                    arg_error = true;
+                else
+                    latency = argv[i];
+            }
+            else if (arg.rfind("--log=",0)==0) {
+                if (!parse_log_mode(arg.substr(6), mode))
+                    arg_error = true;
+            }
+            else if (arg=="--log") {
+                i++;
+                if (i>=argc || !parse_log_mode(argv[i], mode))
+                    arg_error = true;
+            }
+            else
+                arg_error = true;
+        } else {
+            if (filename == nullptr)
+                filename = argv[i];
+            else
+                arg_error = true;
+        }
+    }
+    //Stack-distance analysis replaces the cache, so it can't be combined with --cache or --sweep
+    if (sd_blocksize > 0 && (sweep_file != nullptr || cache_config.size() > 0))
+        arg_error = true;
+    if (!sd_rows.empty() && sd_blocksize == 0)
+        arg_error = true;
+    //Stack distances describe LRU caches only
+    if (sd_blocksize > 0 && policy != POLICY_LRU)
+        arg_error = true;
+
+    //A batch runs its own list of programs against --cache or every --sweep configuration, and prints one table
+    if (batch_file != nullptr)
+        arg_error = arg_error || filename != nullptr || replay_trace != nullptr || dump_trace_file != nullptr ||
+            write_image_file != nullptr || stats_file != nullptr || sd_blocksize > 0 ||
+            (sweep_file == nullptr && cache_config.size() == 0);
+    //A trace replay takes the place of the program, and can't also write a trace
+    else if (replay_trace != nullptr)
+        arg_error = arg_error || filename != nullptr || dump_trace_file != nullptr ||
+            (sweep_file == nullptr && cache_config.size() == 0 && sd_blocksize == 0);
+    //A restored checkpoint takes the place of the program
+    else if (restore_file != nullptr)
+        arg_error = arg_error || filename != nullptr;
+    else if (filename == nullptr)
+        arg_error = true;
+    if (sweep_file != nullptr && cache_config.size() > 0)
+        arg_error = true;
+    if (restore_file != nullptr && (batch_file != nullptr || replay_trace != nullptr || write_image_file != nullptr))
+        arg_error = true;
+
+    //Statistics come from a simulated cache, which a checkpoint may hold
+    if (stats_file != nullptr && sweep_file == nullptr && cache_config.size() == 0 && restore_file == nullptr)
+        arg_error = true;
+
+    //A checkpoint is taken from one program run, with or without a cache, which then stops
+    if (have_checkpoint_at && save_checkpoint_file == nullptr)
+        arg_error = true;
+    if (save_checkpoint_file != nullptr && (sweep_file != nullptr || sd_blocksize > 0 || batch_file != nullptr ||
+        replay_trace != nullptr || sampling))
+        arg_error = true;
+
+    //Sampling needs a cache to sample, and the whole run of one program
+    if (sampling && ((cache_config.size() == 0 && restore_file == nullptr) || sweep_file != nullptr ||
+        sd_blocksize > 0 || batch_file != nullptr || replay_trace != nullptr || dump_trace_file != nullptr))
+        arg_error = true;
+
+    //Writing an image only converts the program, so it needs a program and nothing else to do
+    if (write_image_file != nullptr && (filename == nullptr || replay_trace != nullptr || sweep_file != nullptr ||
+        cache_config.size() > 0 || sd_blocksize > 0 || dump_trace_file != nullptr))
+        arg_error = true;
+
+    //The JIT runs the program, so there must be one
+    if (use_jit && (batch_file != nullptr || replay_trace != nullptr))
+        arg_error = true;
+
+    //The wide address mode applies to a program loaded for this run (a checkpoint records its own
+    //mode), and only the interpreter runs it
+    if (wide && (batch_file != nullptr || replay_trace != nullptr || restore_file != nullptr || use_jit))
+        arg_error = true;
+
+    //So does the memory model
+    if (corrected && restore_file != nullptr)
+        arg_error = true;
+
+    //Prefetchers belong to the levels of --cache
+    if (!prefetch.empty() && (cache_config.size() == 0 || batch_file != nullptr))
+        arg_error = true;
+
+    //Classification needs a simulated cache: --cache, --sweep or a checkpoint's, which brings its own setting
+    if (classify && (sd_blocksize > 0 || batch_file != nullptr ||
+        (cache_config.size() == 0 && sweep_file == nullptr)))
+        arg_error = true;
+
+    //Write policies and latencies belong to the levels of --cache, whose accesses then can't be
+    //split across threads
+    if ((!write.empty() || !latency.empty()) && (cache_config.size() == 0 || batch_file != nullptr ||
+        sweep_file != nullptr || pipelined))
+        arg_error = true;
+
+    //A timeline follows one program run through the one cache of --cache or the checkpoint, from
+    //wherever it starts to the halt
+    if (timeline_file != nullptr && (sweep_file != nullptr || batch_file != nullptr || replay_trace != nullptr ||
+        sd_blocksize > 0 || sampling || save_checkpoint_file != nullptr || num_cores > 0 ||
+        (cache_config.size() == 0 && restore_file == nullptr)))
+        arg_error = true;
+    if ((have_interval || have_signature) && timeline_file == nullptr)
+        arg_error = true;
+
+    //Instruction fetches come from running a program through the one cache of --cache; traces only
+    //hold loads and stores
+    if (!ifetch.empty() && (cache_config.size() == 0 || sweep_file != nullptr || batch_file != nullptr ||
+        replay_trace != nullptr || pipelined))
+        arg_error = true;
+
+    //A multi-core run is one program from the start through private L1s and the shared levels of --cache,
+    //and reports on its own
+    if (num_cores > 0 && (filename == nullptr || cache_config.size() == 0 || sweep_file != nullptr ||
+        batch_file != nullptr || replay_trace != nullptr || sd_blocksize > 0 || restore_file != nullptr ||
+        save_checkpoint_file != nullptr || sampling || dump_trace_file != nullptr || write_image_file != nullptr ||
+        stats_file != nullptr || use_jit || wide || pipelined || classify || !prefetch.empty() || !ifetch.empty() ||
+        !write.empty() || !latency.empty()))
+        arg_error = true;
+    if (have_quantum && num_cores == 0)
+        arg_error = true;
+
+    //Pipelining splits the levels of the one cache given by --cache or the checkpoint
+    if (pipelined && (sweep_file != nullptr || sd_blocksize > 0 || batch_file != nullptr ||
+        (cache_config.size() == 0 && restore_file == nullptr)))
+        arg_error = true;
+
+    /* Display error message if appropriate */
+    if (arg_error || do_help) {
+        cerr << "usage " << argv[0] << " [-h] [--cache CACHE | --sweep FILE | --stack-distance BLOCKSIZE" << endl;
+        cerr << "       [--rows ROWS]] [--policy POLICY] [--prefetch PREFETCH] [--log MODE]" << endl;
+        cerr << "       [--stats FILE] [--classify-misses] [--ifetch IFETCH] [--write WRITE]" << endl;
+        cerr << "       [--latency LATENCY] [--timeline FILE [--interval N]" << endl;
+        cerr << "       [--phase-signature SIGNATURE]]" << endl;
+        cerr << "       [--dump-trace TRACE] [--threads N] [--sample FF,WARM,DETAIL]" << endl;
+        cerr << "       [--checkpoint-at N] [--save-checkpoint FILE] [--jit | --wide]" << endl;
+        cerr << "       [--pipeline] [--corrected]" << endl;
+        cerr << "       (filename | --replay-trace TRACE | --restore FILE)" << endl;
+        cerr << "       " << argv[0] << " (--cache CACHE | --sweep FILE) [--policy POLICY] [--threads N]" << endl;
+        cerr << "       [--corrected] --batch LIST" << endl;
+        cerr << "       " << argv[0] << " --cache CACHE --cores N [--quantum Q] [--policy POLICY]" << endl;
+        cerr << "       [--threads N] [--corrected] filename" << endl;
+        cerr << "       " << argv[0] << " --write-image IMAGE filename" << endl << endl;
+        cerr << "Simulate E20 cache" << endl << endl;
+        cerr << "positional arguments:" << endl;
+        cerr << "  filename    The file containing machine code, typically with .bin suffix," << endl;
+        cerr << "              or a binary image written by --write-image" << endl<<endl;
+        cerr << "optional arguments:"<<endl;
+        cerr << "  -h, --help  show this help message and exit"<<endl;
+        cerr << "  --cache CACHE  Cache configuration: size,associativity,blocksize (for one"<<endl;
+        cerr << "                 cache) or"<<endl;
+        cerr << "                 size,associativity,blocksize,size,associativity,blocksize"<<endl;
+        cerr << "                 (for two caches), and one more triple per further level"<<endl;
+        cerr << "  --sweep FILE   Run the program once and replay its loads and stores against"<<endl;
+        cerr << "                 every cache configuration in FILE (one per line, same form"<<endl;
+        cerr << "                 as --cache), printing one table row per configuration"<<endl;
+        cerr << "  --policy POLICY  Replacement policy: lru (default), plru (tree pseudo-LRU),"<<endl;
+        cerr << "                 fifo, random or srrip"<<endl;
+        cerr << "  --prefetch PREFETCH  Prefetcher of each --cache level, L1 first, separated"<<endl;
+        cerr << "                 by commas: none, next (next-line), stride (per-pc stride"<<endl;
+        cerr << "                 table) or stream, each optionally :N for how many blocks"<<endl;
+        cerr << "                 ahead (next, stride; default 1) or streams (stream; default"<<endl;
+        cerr << "                 4). Missing levels have none. --stats reports how the"<<endl;
+        cerr << "                 prefetches fared"<<endl;
+        cerr << "  --log MODE     Event output: none, summary, text (default) or binary"<<endl;
+        cerr << "  --stats FILE   At the end of the run, write per-level counters and per-pc and"<<endl;
+        cerr << "                 per-block miss histograms to FILE: CSV if it ends in .csv,"<<endl;
+        cerr << "                 otherwise JSON (- for stdout)"<<endl;
+        cerr << "  --classify-misses  Sort the misses of every level into compulsory,"<<endl;
+        cerr << "                 capacity and conflict misses, using a fully associative LRU"<<endl;
+        cerr << "                 cache of the same size. --stats reports them per level and"<<endl;
+        cerr << "                 per pc; --sweep adds three columns per level"<<endl;
+        cerr << "  --ifetch IFETCH  Send every instruction fetch through the cache as well:"<<endl;
+        cerr << "                 unified (through L1, with the data) or size,associativity,"<<endl;
+        cerr << "                 blocksize for an L1 instruction cache of its own in front of"<<endl;
+        cerr << "                 L2. Fetches aren't logged; --stats counts them per level"<<endl;
+        cerr << "  --write WRITE  Write policy of each --cache level, L1 first, separated by"<<endl;
+        cerr << "                 commas: through or back, each optionally :noalloc for no"<<endl;
+        cerr << "                 write-allocate. Missing levels are write-through with"<<endl;
+        cerr << "                 allocate. Dirty blocks are logged as stores to the next level"<<endl;
+        cerr << "                 when written back; --stats counts the writebacks per level"<<endl;
+        cerr << "  --latency LATENCY  Hit latency in cycles of each --cache level, L1 first,"<<endl;
+        cerr << "                 then the memory latency, separated by commas. Prints the"<<endl;
+        cerr << "                 stall cycles, AMAT and effective CPI of the loads and stores"<<endl;
+        cerr << "                 to stderr, and adds them to --stats"<<endl;
+        cerr << "  --timeline FILE  Write the accesses, misses and working set (distinct blocks"<<endl;
+        cerr << "                 touched) of every level for each interval of the run to FILE:"<<endl;
+        cerr << "                 CSV if it ends in .csv, otherwise compact binary. Each interval"<<endl;
+        cerr << "                 is also given a phase, clustering the intervals online by"<<endl;
+        cerr << "                 signature; the phases and a representative interval of each"<<endl;
+        cerr << "                 are printed at the end"<<endl;
+        cerr << "  --interval N   Instructions per --timeline interval (default 100000)"<<endl;
+        cerr << "  --phase-signature SIGNATURE  What --timeline phases are told apart by: pc"<<endl;
+        cerr << "                 (the pcs of the loads and stores, the default) or block (the"<<endl;
+        cerr << "                 L1 blocks they touch)"<<endl;
+        cerr << "  --stack-distance BLOCKSIZE  Compute LRU stack distances in one pass and"<<endl;
+        cerr << "                 print exact hits and misses for every associativity of each"<<endl;
+        cerr << "                 row count in --rows, all with this block size"<<endl;
+        cerr << "  --rows ROWS    Comma-separated row counts for --stack-distance (default 1,"<<endl;
+        cerr << "                 fully associative)"<<endl;
+        cerr << "  --dump-trace TRACE  Write the program's loads and stores to a binary trace"<<endl;
+        cerr << "                 file"<<endl;
+        cerr << "  --replay-trace TRACE  Send a trace written by --dump-trace through the"<<endl;
+        cerr << "                 cache (or sweep) instead of running a program"<<endl;
+        cerr << "  --write-image IMAGE  Convert the program to a binary .e20img image, which"<<endl;
+        cerr << "                 loads faster, and exit"<<endl;
+        cerr << "  --batch LIST   Run every program listed in LIST (one path per line) against"<<endl;
+        cerr << "                 --cache or every --sweep configuration, in parallel, printing"<<endl;
+        cerr << "                 one table row per program and configuration"<<endl;
+        cerr << "  --threads N    Worker threads for --sweep and --batch (default one per"<<endl;
+        cerr << "                 hardware thread), or for --cores (default 1)"<<endl;
+        cerr << "  --cores N      Run the program on N cores (at most 64) sharing memory, core"<<endl;
+        cerr << "                 i starting with i in $1. Each core gets a private L1 of the"<<endl;
+        cerr << "                 first level of --cache, kept coherent by MESI; the other"<<endl;
+        cerr << "                 levels are shared. Prints per-core coherence traffic and the"<<endl;
+        cerr << "                 pcs and blocks with the most false sharing"<<endl;
+        cerr << "  --quantum Q    Instructions each core runs per turn with --cores (default"<<endl;
+        cerr << "                 1000, at most 4294967295). --threads runs the cores of a turn"<<endl;
+        cerr << "                 in parallel; the results are the same"<<endl;
+        cerr << "  --sample FF,WARM,DETAIL  Sample the run: repeatedly run FF instructions"<<endl;
+        cerr << "                 without the cache, WARM through it without counting, then"<<endl;
+        cerr << "                 DETAIL through it as usual. Logs and statistics cover the"<<endl;
+        cerr << "                 DETAIL instructions only"<<endl;
+        cerr << "  --save-checkpoint FILE  Save the machine, and the cache if there is one,"<<endl;
+        cerr << "                 to FILE after --checkpoint-at instructions (default 0), and"<<endl;
+        cerr << "                 stop"<<endl;
+        cerr << "  --checkpoint-at N  When to save the checkpoint"<<endl;
+        cerr << "  --jit          Run the program as native x86-64 code translated a basic block"<<endl;
+        cerr << "                 at a time, instead of interpreting it"<<endl;
+        cerr << "  --wide         Wide address mode: lw and sw addresses get 16 more bits from"<<endl;
+        cerr << "                 the bank, set by bank $reg (function code 1001 of the"<<endl;
+        cerr << "                 three-register form), for a 32-bit word address space"<<endl;
+        cerr << "  --pipeline     Simulate each cache level below L1, and write the log, on a"<<endl;
+        cerr << "                 thread of its own. The output is the same as without"<<endl;
+        cerr << "                 --pipeline"<<endl;
+        cerr << "  --corrected    Fix two quirks of the original simulator's memory model: a lw"<<endl;
+        cerr << "                 whose address register is its destination reaches the cache"<<endl;
+        cerr << "                 at the cell it read, not at one formed from the loaded value,"<<endl;
+        cerr << "                 and a store brings its block into every level it misses, even"<<endl;
+        cerr << "                 below a level it hits. A checkpoint keeps the model it was"<<endl;
+        cerr << "                 saved with"<<endl;
+        cerr << "  --restore FILE  Continue from a checkpoint instead of running a program"<<endl;
+        cerr << "                 from the start. Its cache is used unless --cache or --sweep"<<endl;
+        cerr << "                 is given"<<endl;
+        return 1;
+    }
+
+    //Opens the statistics file up front, so a bad path fails before the run. It is completed when main returns
+    stats_writer stats_report;
+    stats_writer *stats = nullptr;
+    if (stats_file != nullptr)
+    {
+        if (!stats_report.open(stats_file)) {
+            cerr << "Can't open file "<<stats_file<<endl;
+            return 1;
+        }
+        stats = &stats_report;
+    }
+
+    //Sweep mode reads all of its configurations first, so a bad line fails before any work is done
+    vector<string> configs;
+    if (sweep_file != nullptr && !read_sweep_configs(sweep_file, configs))
+        return 1;
+
+    //Batch mode: every (program, configuration) pair is a separate run, spread across the threads
+    if (batch_file != nullptr)
+    {
+        vector<string> programs;
+        if (!read_batch_programs(batch_file, programs))
+            return 1;
+        if (sweep_file == nullptr) {
+            vector<int> parts;
+            if (!parse_cache_config(cache_config, parts)) {
+                cerr << "Invalid cache config" << endl;
+                return 1;
+            }
+            configs.push_back(cache_config);
+        }
+        return run_batch(programs, configs, policy, stdout, num_threads, corrected) ? 0 : 1;
+    }
+
+    //Stack-distance analysis: one pass over the loads and stores covers every associativity
+    if (sd_blocksize > 0)
+    {
+        if (sd_rows.empty())
+            sd_rows.push_back(1);
+        stack_distance analysis(sd_blocksize, sd_rows);
+        if (replay_trace != nullptr)
+        {
+            trace_file trace;
+            string error;
+            if (!trace.open(replay_trace, error)) {
+                cerr << error << endl;
+                return 1;
+            }
+            bool ok = trace.for_each([&](const mem_access &a) {
+                if (a.is_store)
+                    analysis.store(a.pc, a.addr, a.clock_cycle);
+                else
+                    analysis.load(a.pc, a.addr, a.clock_cycle);
+            });
+            if (!ok) {
+                cerr << "Trace file is truncated: " << replay_trace << endl;
+                return 1;
+            }
+            analysis.report(stdout);
+            return 0;
+        }
+    }
+
+    if (replay_trace != nullptr)
+        return replay_trace_file(replay_trace, cache_config, sweep_file, configs, policy, prefetch, write, latency, mode,
+            stats, num_threads, classify, pipelined, corrected);
+
+    //The processor and its memory. Everything is uint16_t to let overflow wrap around
+    E20Machine machine;
+
+    //A cache saved in the checkpoint being restored, if any
+    CacheHierarchy restored_cache;
+
+    //Loads the program, either machine code text or an .e20img image, or the checkpoint to continue from
+    machine.set_corrected(corrected);
+    string load_error;
+    if (restore_file != nullptr ? !load_checkpoint(restore_file, machine, &restored_cache, load_error) :
+        !machine.load(filename, load_error)) {
+        cerr << load_error << endl;
+        return 1;
+    }
+    if (use_jit && !machine.enable_jit()) {
+        cerr << "The JIT isn't supported on this host" << endl;
+        return 1;
+    }
+    if (wide)
+        machine.set_wide(true);
+    //--cache and --sweep bring their own caches
+    if (cache_config.size() > 0 || sweep_file != nullptr)
+        restored_cache = CacheHierarchy();
+    if (stats != nullptr && sweep_file == nullptr && cache_config.size() == 0 && !restored_cache.configured()) {
+        cerr << "Checkpoint has no cache: " << restore_file << endl;
+        return 1;
+    }
+    if (sampling && cache_config.size() == 0 && !restored_cache.configured()) {
+        cerr << "Checkpoint has no cache: " << restore_file << endl;
+        return 1;
+    }
+
+    //Multi-core mode: the program on every core, deterministically, whatever the thread count
+    if (num_cores > 0)
+    {
+        if (!run_multicore(machine.memory(), num_cores, cache_config, policy, quantum,
+            num_threads > 0 ? num_threads : 1, corrected, stdout)) {
+            cerr << "Invalid cache config: --cores needs an L1 and at least one shared level" << endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    //Converting to an image doesn't run the program
+    if (write_image_file != nullptr)
+    {
+        if (!write_image(write_image_file, machine.memory())) {
+            cerr << "Can't open file "<<write_image_file<<endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    //Writes every load and store to a trace file while the program runs
+    trace_writer writer;
+    if (dump_trace_file != nullptr && !writer.open(dump_trace_file)) {
+        cerr << "Can't open file "<<dump_trace_file<<endl;
+        return 1;
+    }
+
+    //Sweep mode: runs the program once, recording its loads and stores to the --dump-trace file or a
+    //temporary one, then replays them from the mapped file against every configuration
+    if (sweep_file != nullptr)
+    {
+        string temp_path;
+        if (dump_trace_file == nullptr && !writer.open_temp(temp_path)) {
+            cerr << "Can't create a temporary trace file" << endl;
+            return 1;
+        }
+        machine.run(writer);
+        writer.close();
+        trace_file trace;
+        string error;
+        bool opened = trace.open(dump_trace_file != nullptr ? dump_trace_file : temp_path.c_str(), error);
+        if (!temp_path.empty())
+            unlink(temp_path.c_str());
+        if (!opened) {
+            cerr << error << endl;
+            return 1;
+        }
+        if (!run_sweep(trace, configs, stdout, policy, stats, num_threads, classify, machine.corrected())) {
+            cerr << "Trace file is truncated" << endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    if (sd_blocksize > 0)
+    {
+        stack_distance analysis(sd_blocksize, sd_rows);
+        if (dump_trace_file != nullptr) {
+            hook_pair<stack_distance, trace_writer> both{analysis, writer};
+            machine.run(both);
+        } else {
+            machine.run(analysis);
+        }
+        writer.close();
+        analysis.report(stdout);
+        return 0;
+    }
+
+    /* parse cache config */
+    if (cache_config.size() > 0 || restored_cache.configured())
+    {
+        //Collects cache events and writes them out in large chunks
+        event_log log(mode);
+
+        //My cache: its levels, rows and blocks, built for the chosen replacement policy and L1 shape,
+        //or carried on from the checkpoint
+        CacheHierarchy My_cache;
+        My_cache.set_classify_misses(classify);
+        My_cache.set_corrected(machine.corrected());
+        if (cache_config.size() == 0) {
+            My_cache = std::move(restored_cache);
+            log_cache_config(My_cache, log);
+        } else if (!setup_cache(My_cache, cache_config, policy, prefetch, ifetch, write, latency, log)) {
+            return 1;
+        }
+        My_cache.set_pipelined(pipelined);
+
+        //The timeline is written as the run goes, so a bad path fails before it starts
+        timeline_writer timeline;
+        if (timeline_file != nullptr && !timeline.open(timeline_file)) {
+            cerr << "Can't open file "<<timeline_file<<endl;
+            return 1;
+        }
+
+        //Runs the program, sending every lw and sw through the cache, up to the checkpoint if one is wanted
+        if (save_checkpoint_file != nullptr) {
+            if (dump_trace_file != nullptr)
+                My_cache.run(machine, log, writer, checkpoint_at);
+            else
+                My_cache.run(machine, log, checkpoint_at);
+        } else if (timeline_file != nullptr) {
+            timeline_result phases;
+            if (dump_trace_file != nullptr) {
+                phases = run_timeline(machine, My_cache, log, writer, interval, signature, timeline);
+            } else {
+                no_hook tap;
+                phases = run_timeline(machine, My_cache, log, tap, interval, signature, timeline);
+            }
+            if (!timeline.close()) {
+                cerr << "Can't write file "<<timeline_file<<endl;
+                return 1;
+            }
+            report_phases(phases);
+        } else if (sampling) {
+            sample_result sampled = run_sampled(machine, My_cache, log, schedule);
+            cerr << "Sampled " << sampled.detail_cycles << " of " << sampled.total_cycles <<
+                " instructions in detail over " << sampled.periods << " periods" << endl;
+        } else if (dump_trace_file != nullptr) {
+            My_cache.run(machine, log, writer);
+        } else {
+            My_cache.run(machine, log);
+        }
+
+        //Writes out anything still buffered, plus the totals in summary mode
+        log.finish();
+        report_timing(My_cache);
+        if (stats != nullptr)
+            My_cache.report(*stats);
+        if (save_checkpoint_file != nullptr && !save_checkpoint(save_checkpoint_file, machine, &My_cache)) {
+            cerr << "Can't open file "<<save_checkpoint_file<<endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    //With no cache, the program only runs when its trace or a checkpoint is wanted
+    if (save_checkpoint_file != nullptr)
+    {
+        if (dump_trace_file != nullptr)
+            machine.run(writer, checkpoint_at);
+        else
+            machine.run(checkpoint_at);
+        writer.close();
+        if (!save_checkpoint(save_checkpoint_file, machine, nullptr)) {
+            cerr << "Can't open file "<<save_checkpoint_file<<endl;
+            return 1;
+        }
+    }
+    else if (dump_trace_file != nullptr)
+    {
+        machine.run(writer);
+    }
+
+    return 0;
+}
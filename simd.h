@@ -0,0 +1,171 @@
+/*
+simd.h
+Vector tag matching and LRU victim search for the cache levels in cache.h,
+with a scalar fallback. The instruction set is picked at run time.
+*/
+
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMCACHE_X86 1
+#include <immintrin.h>
+#endif
+
+//The widest instruction set the tag and stamp searches may use
+enum simd_level { SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2 };
+
+//Tags are stored in groups of this many 32-bit lanes (one AVX2 register, two SSE2 ones); rows of
+//SIMD_MIN_WAYS or more ways are padded to a whole number of groups so the vector loads never leave the row
+const unsigned SIMD_TAG_LANES = 8;
+
+//Narrower rows are scanned one tag at a time: a vector compare doesn't pay for itself there
+const unsigned SIMD_MIN_WAYS = 8;
+
+/*
+    Returns the widest instruction set this processor supports, checked
+    once on the first call.
+*/
+inline simd_level detect_simd() {
+#if defined(SIMCACHE_X86)
+    static const simd_level best = __builtin_cpu_supports("avx2") ? SIMD_AVX2 :
+        __builtin_cpu_supports("sse2") ? SIMD_SSE2 : SIMD_SCALAR;
+    return best;
+#else
+    return SIMD_SCALAR;
+#endif
+}
+
+/*
+    Returns the instruction set to search a row of assoc ways with: none
+    below SIMD_MIN_WAYS, and the best available for wider rows.
+*/
+inline simd_level simd_for_ways(unsigned assoc) {
+    if (assoc < SIMD_MIN_WAYS)
+        return SIMD_SCALAR;
+    return detect_simd();
+}
+
+/*
+    Returns the distance between the rows of a level's tag array.
+
+    @param assoc The associativity of the level
+*/
+constexpr unsigned tag_stride(unsigned assoc) {
+    return assoc < SIMD_MIN_WAYS ? assoc : (assoc + SIMD_TAG_LANES - 1) / SIMD_TAG_LANES * SIMD_TAG_LANES;
+}
+
+/*
+    Finds a tag among the first n slots of a row.
+
+    @return The way holding the tag, or -1
+*/
+inline int match_tags_scalar(const uint32_t *tags, unsigned n, uint32_t tag) {
+    for (unsigned i = 0; i < n; i++) {
+        if (tags[i] == tag)
+            return i;
+    }
+    return -1;
+}
+
+//Bits of one or more _mm_movemask_ps/_mm256_movemask_ps results, side by side, that belong to the
+//first lanes 32-bit lanes
+inline uint32_t lane_mask(unsigned lanes) {
+    return lanes >= 32 ? 0xffffffffu : (1u << lanes) - 1;
+}
+
+#if defined(SIMCACHE_X86)
+//As match_tags_scalar, comparing four tags per instruction. Reads up to the next multiple of
+//four slots, so the row must be padded as tag_stride() says.
+__attribute__((target("sse2")))
+inline int match_tags_sse2(const uint32_t *tags, unsigned n, uint32_t tag) {
+    const __m128i want = _mm_set1_epi32(static_cast<int>(tag));
+    for (unsigned i = 0; i < n; i += 4) {
+        __m128i group = _mm_loadu_si128(reinterpret_cast<const __m128i *>(tags + i));
+        uint32_t found = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(group, want))) & lane_mask(n - i);
+        if (found != 0)
+            return i + __builtin_ctz(found);
+    }
+    return -1;
+}
+
+//As match_tags_sse2, sixteen tags (two groups) at a time, finishing with one group if that's all
+//the row has left
+__attribute__((target("avx2")))
+inline int match_tags_avx2(const uint32_t *tags, unsigned n, uint32_t tag) {
+    unsigned i = 0;
+    const __m256i want = _mm256_set1_epi32(static_cast<int>(tag));
+    for (; i + 8 < n; i += 16) {
+        __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(tags + i));
+        __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(tags + i + 8));
+        uint32_t found = (_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(low, want))) |
+            _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(high, want))) << 8) & lane_mask(n - i);
+        if (found != 0)
+            return i + __builtin_ctz(found);
+    }
+    if (i < n) {
+        __m256i group = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(tags + i));
+        uint32_t found = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(group, want))) & lane_mask(n - i);
+        if (found != 0)
+            return i + __builtin_ctz(found);
+    }
+    return -1;
+}
+
+//Index of the smallest of n stamps, four at a time. Stamps must be below 2^63, since AVX2 only
+//has a signed 64-bit compare, and distinct, so there's no tie to break.
+__attribute__((target("avx2")))
+inline unsigned min_stamp_avx2(const uint64_t *s, unsigned n) {
+    unsigned i = 0, best = 0;
+    if (n >= 4) {
+        __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s));
+        __m256i where = _mm256_set_epi64x(3, 2, 1, 0);
+        __m256i index = where;
+        const __m256i step = _mm256_set1_epi64x(4);
+        for (i = 4; i + 4 <= n; i += 4) {
+            index = _mm256_add_epi64(index, step);
+            __m256i group = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + i));
+            __m256i lower = _mm256_cmpgt_epi64(low, group);
+            low = _mm256_blendv_epi8(low, group, lower);
+            where = _mm256_blendv_epi8(where, index, lower);
+        }
+        alignas(32) uint64_t lows[4], wheres[4];
+        _mm256_store_si256(reinterpret_cast<__m256i *>(lows), low);
+        _mm256_store_si256(reinterpret_cast<__m256i *>(wheres), where);
+        best = static_cast<unsigned>(wheres[0]);
+        for (unsigned k = 1; k < 4; k++) {
+            if (lows[k] < s[best])
+                best = static_cast<unsigned>(wheres[k]);
+        }
+    } else {
+        i = 1;
+    }
+    for (; i < n; i++) {
+        if (s[i] < s[best])
+            best = i;
+    }
+    return best;
+}
+#endif
+
+/*
+    Finds a tag among the first n slots of a row with the given instruction
+    set. Rows narrower than SIMD_MIN_WAYS should be matched with SIMD_SCALAR.
+
+    @return The way holding the tag, or -1
+*/
+inline int match_tags(const uint32_t *tags, unsigned n, uint32_t tag, simd_level simd) {
+#if defined(SIMCACHE_X86)
+    if (simd == SIMD_AVX2)
+        return match_tags_avx2(tags, n, tag);
+    if (simd == SIMD_SSE2)
+        return match_tags_sse2(tags, n, tag);
+#endif
+    (void)simd;
+    return match_tags_scalar(tags, n, tag);
+}
+
+#endif
@@ -0,0 +1,703 @@
+/*
+simulator.h
+The simulator as a library: an E20 machine and a cache hierarchy that can
+be built, run, stepped and inspected in-process. The simcache command line
+is one client of it.
+
+    E20Machine machine;
+    std::string error;
+    machine.load("program.bin", error);
+
+    CacheHierarchy caches;
+    caches.configure("256,2,4,4096,8,16", POLICY_LRU);
+    caches.run(machine);
+    caches.stats(0).hits();
+
+A machine keeps the program it was loaded with, so one load can be run
+against many hierarchies: machine.reset() starts it over.
+
+machine.set_wide(true) switches to the wide address mode of e20.h, where the
+bank instruction gives lw and sw a 32-bit address space; caches with room
+for more than the 8K-word E20 memory then have something to hold.
+
+caches.set_prefetch("stride:2,next") gives L1 and L2 the prefetchers of
+prefetch.h; the prefetch counters of stats(i) say how they did.
+caches.set_classify_misses(true) splits each level's misses into the
+three Cs of classify.h.
+
+caches.set_ifetch("unified") sends every instruction fetch through L1 as
+well; caches.set_ifetch("256,2,4") gives fetches an L1 instruction cache of
+their own in front of L2 instead (see cache_fetch in cache.h).
+
+caches.set_write("back,back") makes L1 and L2 write-back (see timing.h);
+caches.set_latency("1,10,100") gives them hit latencies of 1 and 10 cycles
+and memory one of 100, and caches.timing() then has the stall cycles, AMAT
+and effective CPI of the runs.
+*/
+
+#ifndef SIMULATOR_H
+#define SIMULATOR_H
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "cache.h"
+#include "e20.h"
+#include "jit.h"
+#include "loader.h"
+#include "log.h"
+#include "pipeline.h"
+#include "policy.h"
+#include "prefetch.h"
+#include "sparse.h"
+#include "stats.h"
+#include "timing.h"
+#include "trace.h"
+
+//Receives the cache events of a CacheHierarchy run through a virtual call, for clients that choose
+//their handling at run time. Any class with the same entry() works as a log without the virtual call.
+struct event_sink
+{
+    virtual ~event_sink() {}
+
+    /*
+        @param level The level where the event occurred, 0 for L1
+
+        @param status The kind of cache event
+
+        @param pc The program counter of the lw or sw
+
+        @param addr The memory address accessed
+
+        @param row The row of the level the address maps to
+    */
+    virtual void entry(unsigned level, log_status status, unsigned pc, unsigned addr, unsigned row) = 0;
+};
+
+//Counts passed as a log, tap or hook argument must not be mistaken for one
+template <class T>
+using not_a_count = typename std::enable_if<!std::is_arithmetic<T>::value>::type;
+
+//An E20 processor and its memory
+class E20Machine
+{
+public:
+    E20Machine() : image(MEM_SIZE, 0), mem(MEM_SIZE, 0) { reset(); }
+
+    /*
+        Loads a program file, machine code or .e20img, and resets the
+        machine to run it.
+
+        @return false, with the reason in error, if the file can't be loaded;
+            the machine is unchanged
+    */
+    bool load(const char *path, std::string &error) {
+        std::vector<uint16_t> words(MEM_SIZE, 0);
+        if (!load_program(path, words.data(), error))
+            return false;
+        image = std::move(words);
+        reset();
+        return true;
+    }
+
+    /*
+        Loads a program from words already in memory and resets the machine
+        to run it.
+
+        @param words The initial contents of memory, from address 0
+
+        @param n Number of words; at most MEM_SIZE are used, and the rest of
+            memory is zero
+    */
+    void load(const uint16_t *words, size_t n) {
+        image.assign(MEM_SIZE, 0);
+        for (size_t i = 0; i < n && i < MEM_SIZE; i++)
+            image[i] = words[i];
+        reset();
+    }
+
+    //Restores the loaded program's memory and powers the processor on again
+    void reset() {
+        mem = image;
+        high.clear();
+        start_e20(mem.data(), state);
+        jit.flush();
+    }
+
+    /*
+        Switches between the E20's own MEM_SIZE-cell memory and the wide
+        address mode (see wide_memory in e20.h), and resets the machine.
+        Wide machines always run on the interpreter, even with the JIT
+        enabled.
+    */
+    void set_wide(bool on) {
+        wide_mode = on;
+        reset();
+    }
+
+    bool wide() const { return wide_mode; }
+
+    //Chooses which address a lw whose address register is also its destination reports to hooks:
+    //the one formed again from the loaded value, as the original simulator did, or, corrected,
+    //the cell it read (see e20_state in e20.h). Kept across reset() and load().
+    void set_corrected(bool on) { state.corrected_lw = on; }
+    bool corrected() const { return state.corrected_lw; }
+
+    /*
+        Runs the program on the JIT in jit.h from now on, rather than the
+        interpreter. Results and hook calls are the same. A hook that takes
+        instruction fetches (see hook_fetches in e20.h) still runs on the
+        interpreter, which makes the fetch calls.
+
+        @return false if this build or host can't run native code
+    */
+    bool enable_jit() { return jit.enable(); }
+
+    bool jit_enabled() const { return jit.enabled(); }
+
+    /*
+        Runs until the program halts, or until max_cycles more instructions
+        have executed if given. Can be called again to continue. Without
+        max_cycles the interpreter doesn't count down a budget, so leave it
+        out rather than passing a huge one.
+
+        @param hook Receives every lw and sw, as for resume_e20
+
+        @return The number of instructions executed by this call
+    */
+    template <class Hook, class = not_a_count<Hook>>
+    uint64_t run(Hook &hook) {
+        if (wide_mode)
+            return resume_e20<false>(wide_memory{mem.data(), &high}, state, hook);
+        if (jit.enabled() && !hook_fetches<Hook>::value)
+            return jit.run<false>(mem.data(), state, hook);
+        return resume_e20<false>(mem.data(), state, hook);
+    }
+
+    template <class Hook, class = not_a_count<Hook>>
+    uint64_t run(Hook &hook, uint64_t max_cycles) {
+        if (wide_mode)
+            return resume_e20<true>(wide_memory{mem.data(), &high}, state, hook, max_cycles);
+        if (jit.enabled() && !hook_fetches<Hook>::value)
+            return jit.run<true>(mem.data(), state, hook, max_cycles);
+        return resume_e20<true>(mem.data(), state, hook, max_cycles);
+    }
+
+    uint64_t run() {
+        no_hook hook;
+        return run(hook);
+    }
+
+    uint64_t run(uint64_t max_cycles) {
+        no_hook hook;
+        return run(hook, max_cycles);
+    }
+
+    //Executes one instruction. Returns false if the program had already halted.
+    template <class Hook, class = not_a_count<Hook>>
+    bool step(Hook &hook) { return run(hook, 1) == 1; }
+
+    bool step() { return run(1) == 1; }
+
+    bool halted() const { return state.halted; }
+    uint16_t pc() const { return state.pc; }
+    uint16_t reg(unsigned r) const { return state.regs[r % NUM_REGS]; }
+    uint64_t cycles() const { return state.clock_cycle; }
+
+    //The first MEM_SIZE cells of memory as the program has left them: all of it unless wide
+    const uint16_t *memory() const { return mem.data(); }
+
+    //Reads one memory cell, as a lw would
+    uint16_t peek(uint32_t addr) const {
+        if (!wide_mode || addr < MEM_SIZE)
+            return mem[addr % MEM_SIZE];
+        return high.get(addr);
+    }
+
+    //Writes one memory cell between runs, as a sw would
+    void poke(uint32_t addr, uint16_t value) {
+        if (wide_mode && addr >= MEM_SIZE) {
+            high.at(addr) = value;
+            return;
+        }
+        mem[addr % MEM_SIZE] = value;
+        state.code[addr % MEM_SIZE] = decode_e20(value);
+        jit.invalidate(addr % MEM_SIZE);
+    }
+
+    /*
+        Passes the loaded program, memory and processor through a checkpoint
+        archive (see checkpoint.h). The predecoded instructions aren't
+        stored; they are decoded again from memory.
+    */
+    template <class Archive>
+    void serialize(Archive &ar) {
+        ar.io(image);
+        ar.io(mem);
+        ar.io(state.pc);
+        for (size_t i = 0; i < NUM_REGS; i++)
+            ar.io(state.regs[i]);
+        ar.io(state.bank);
+        ar.io(state.clock_cycle);
+        ar.io(state.halted);
+        ar.io(wide_mode);
+        ar.io(state.corrected_lw);
+        high.serialize(ar);
+        state.code.resize(MEM_SIZE);
+        for (size_t i = 0; i < MEM_SIZE; i++)
+            state.code[i] = decode_e20(mem[i]);
+        jit.flush();
+    }
+
+private:
+    std::vector<uint16_t> image;
+    std::vector<uint16_t> mem;
+
+    //The wide memory above mem, empty unless wide_mode
+    bool wide_mode = false;
+    sparse_array<uint16_t> high;
+
+    e20_state state;
+    e20_jit jit;
+};
+
+//A cache hierarchy built from a configuration string and a replacement policy chosen at run time.
+//Inside, it is the basic_cache compiled for that policy; every run dispatches to it once, so the
+//per-access path is the same inlined code the templates give. Only a plain run, one with no tap
+//or budget through levels with nothing but a replacement policy, also gets L1's fixed shape (see
+//with_shape); every other path is compiled for generic_shape alone.
+class CacheHierarchy
+{
+public:
+    /*
+        Builds the hierarchy, empty, replacing any previous one.
+
+        @param cache_config See parse_cache_config
+
+        @param policy The replacement policy of every level
+
+        @return false if the configuration can't be parsed; the hierarchy is unchanged
+    */
+    bool configure(const std::string &cache_config, replacement_policy policy = POLICY_LRU) {
+        std::vector<int> parts, icache_parts;
+        std::vector<prefetch_config> prefetchers;
+        std::vector<write_config> writes;
+        std::vector<unsigned> latencies;
+        fetch_mode mode;
+        if (!parse_cache_config(cache_config, parts) || !prefetchers_fit(prefetch, parts.size() / 3, prefetchers) ||
+            !parse_fetch_config(ifetch, mode, icache_parts) || !writes_fit(write, parts.size() / 3, writes) ||
+            !latencies_fit(latency, parts.size() / 3, latencies))
+            return false;
+        return with_policy(policy, [&](auto tag) {
+            std::unique_ptr<holder<decltype(tag)>> h(new holder<decltype(tag)>);
+            if (!init_cache(h->My_cache, cache_config))
+                return false;
+            for (size_t i = 0; i < prefetchers.size(); i++)
+                set_prefetcher(h->My_cache.My_levels[i], prefetchers[i]);
+            for (auto &lvl : h->My_cache.My_levels)
+                set_miss_classification(lvl, classify);
+            for (size_t i = 0; i < writes.size(); i++)
+                set_write_policy(h->My_cache.My_levels[i], writes[i]);
+            h->My_cache.timing.init(latencies);
+            h->My_cache.detailed = !write.empty() || !latency.empty();
+            h->My_cache.fetch = mode;
+            h->My_cache.corrected_stores = corrected;
+            if (mode == FETCH_SPLIT) {
+                init_level(h->My_cache.icache, icache_parts[0], icache_parts[1], icache_parts[2]);
+                set_miss_classification(h->My_cache.icache, classify);
+            }
+            levels.clear();
+            for (level &lvl : h->My_cache.My_levels)
+                levels.push_back(&lvl);
+            fetch = mode;
+            icache = &h->My_cache.icache;
+            times = &h->My_cache.timing;
+            shaped_l1 = prefetchers.empty() && !classify && !h->My_cache.detailed && mode == FETCH_OFF;
+            impl = std::move(h);
+            config = cache_config;
+            replacement = policy;
+            l1_assoc = parts[1];
+            return true;
+        });
+    }
+
+    //Empties every level and zeroes its statistics
+    void reset() { configure(config, replacement); }
+
+    /*
+        Gives the levels prefetchers (see prefetch.h) and empties the
+        hierarchy, as reset() does. Kept across configure(), which fails for
+        a configuration with fewer levels than spec names.
+
+        @param spec See parse_prefetch_config; "" for none
+
+        @return false if spec can't be parsed or names more levels than the
+            hierarchy has; nothing is changed
+    */
+    bool set_prefetch(const std::string &spec) {
+        std::vector<prefetch_config> prefetchers;
+        if (!prefetchers_fit(spec, configured() ? num_levels() : SIZE_MAX, prefetchers))
+            return false;
+        prefetch = spec;
+        if (configured())
+            reset();
+        return true;
+    }
+
+    const std::string &prefetch_spec() const { return prefetch; }
+
+    //Sorts the misses of every level into compulsory, capacity and conflict misses (see classify.h),
+    //counted in stats(i). Empties the hierarchy, as reset() does, and is kept across configure().
+    void set_classify_misses(bool on) {
+        classify = on;
+        if (configured())
+            reset();
+    }
+
+    bool classify_misses() const { return classify; }
+
+    //Chooses how stores bring their block in: only down to the first level they hit, as the
+    //original simulator did, or, corrected, at every write-allocate level that misses (see
+    //corrected_stores in cache.h). Empties the hierarchy, as reset() does, and is kept across
+    //configure().
+    void set_corrected(bool on) {
+        corrected = on;
+        if (configured())
+            reset();
+    }
+
+    bool corrected_stores() const { return corrected; }
+
+    /*
+        Chooses where instruction fetches go (see cache_fetch in cache.h) and
+        empties the hierarchy, as reset() does. Kept across configure().
+        Fetches don't appear in the log; stats(i) counts them apart from
+        loads and stores. A hierarchy that models fetches isn't pipelined.
+
+        @param spec See parse_fetch_config: "" for nowhere, "unified", or the
+            size,associativity,blocksize of a split L1 instruction cache
+
+        @return false if spec can't be parsed; nothing is changed
+    */
+    bool set_ifetch(const std::string &spec) {
+        fetch_mode mode;
+        std::vector<int> parts;
+        if (!parse_fetch_config(spec, mode, parts))
+            return false;
+        ifetch = spec;
+        if (configured())
+            reset();
+        return true;
+    }
+
+    const std::string &ifetch_spec() const { return ifetch; }
+
+    fetch_mode ifetch_mode() const { return fetch; }
+
+    //The L1 instruction cache; fetches must be split (see set_ifetch) and the hierarchy configured
+    const level &icache_info() const {
+        assert(icache != nullptr);
+        return *icache;
+    }
+    const level_stats &icache_stats() const { return icache_info().stats; }
+    level_stats &icache_stats() {
+        assert(icache != nullptr);
+        return icache->stats;
+    }
+
+    /*
+        Sets the write policy of each level (see write_config in timing.h)
+        and empties the hierarchy, as reset() does. Kept across configure(),
+        which fails for a configuration with fewer levels than spec names.
+        A hierarchy with a level that isn't write-through with allocate
+        isn't pipelined.
+
+        @param spec See parse_write_config; "" for write-through with
+            allocate everywhere
+
+        @return false if spec can't be parsed or names more levels than the
+            hierarchy has; nothing is changed
+    */
+    bool set_write(const std::string &spec) {
+        std::vector<write_config> writes;
+        if (!writes_fit(spec, configured() ? num_levels() : SIZE_MAX, writes))
+            return false;
+        write = spec;
+        if (configured())
+            reset();
+        return true;
+    }
+
+    const std::string &write_spec() const { return write; }
+
+    /*
+        Gives the levels and memory latencies, so runs are timed (see
+        cache_timing in timing.h), and empties the hierarchy, as reset()
+        does. Kept across configure(), which fails for a configuration
+        with a different number of levels. A timed hierarchy isn't
+        pipelined.
+
+        @param spec See parse_latency_config; "" for no timing
+
+        @return false if spec can't be parsed or doesn't have one latency
+            per level plus memory's; nothing is changed
+    */
+    bool set_latency(const std::string &spec) {
+        std::vector<unsigned> latencies;
+        if (!latencies_fit(spec, configured() ? num_levels() : SIZE_MAX, latencies))
+            return false;
+        latency = spec;
+        if (configured())
+            reset();
+        return true;
+    }
+
+    const std::string &latency_spec() const { return latency; }
+
+    //The time the runs since the hierarchy was configured or reset have spent in it, if it has
+    //latencies. The hierarchy must be configured.
+    const cache_timing &timing() const {
+        assert(configured());
+        return *times;
+    }
+    cache_timing &timing() {
+        assert(configured());
+        return *times;
+    }
+
+    bool configured() const { return impl != nullptr; }
+    const std::string &cache_config() const { return config; }
+    replacement_policy policy() const { return replacement; }
+
+    size_t num_levels() const { return levels.size(); }
+
+    //Runs each level below L1, and the log, on a thread of its own (see pipeline.h). The results
+    //are the same either way. Kept across configure(); has no effect while fetches are modelled, a
+    //level isn't write-through with allocate or the hierarchy is timed.
+    void set_pipelined(bool on) { pipelined_levels = on; }
+    bool pipelined() const { return pipelined_levels; }
+
+    //The geometry of a level, 0 for L1; index must be below num_levels()
+    const level &level_info(size_t index) const {
+        assert(index < levels.size());
+        return *levels[index];
+    }
+
+    //The counters and miss histograms of a level since it was configured or reset; index must be
+    //below num_levels()
+    const level_stats &stats(size_t index) const {
+        assert(index < levels.size());
+        return levels[index]->stats;
+    }
+    level_stats &stats(size_t index) {
+        assert(index < levels.size());
+        return levels[index]->stats;
+    }
+
+    /*
+        Runs a machine with every lw and sw, and every instruction fetch if
+        set_ifetch asked for them, going through the hierarchy, until
+        the program halts or, if given, max_cycles more instructions have
+        executed (see E20Machine::run).
+
+        @param machine The machine to run. If the hierarchy isn't configured,
+            it isn't run at all
+
+        @param log Receives one entry(level, status, pc, addr, row) per
+            event, as event_log does. An event_sink, or anything else with
+            that entry().
+
+        @param tap Also sees every lw and sw, as an interpreter hook (for
+            example a trace_writer)
+
+        @return The number of instructions executed by this call, 0 if the
+            hierarchy isn't configured
+    */
+    template <class Log, class Tap, class = not_a_count<Log>, class = not_a_count<Tap>>
+    uint64_t run(E20Machine &machine, Log &log, Tap &tap) { return run_through<false>(machine, log, tap, 0); }
+
+    template <class Log, class Tap, class = not_a_count<Log>, class = not_a_count<Tap>>
+    uint64_t run(E20Machine &machine, Log &log, Tap &tap, uint64_t max_cycles) {
+        return run_through<true>(machine, log, tap, max_cycles);
+    }
+
+    template <class Log, class = not_a_count<Log>>
+    uint64_t run(E20Machine &machine, Log &log) {
+        no_hook tap;
+        return run_through<false>(machine, log, tap, 0);
+    }
+
+    template <class Log, class = not_a_count<Log>>
+    uint64_t run(E20Machine &machine, Log &log, uint64_t max_cycles) {
+        no_hook tap;
+        return run_through<true>(machine, log, tap, max_cycles);
+    }
+
+    uint64_t run(E20Machine &machine) {
+        null_log log;
+        return run(machine, log);
+    }
+
+    uint64_t run(E20Machine &machine, uint64_t max_cycles) {
+        null_log log;
+        return run(machine, log, max_cycles);
+    }
+
+    //Executes one instruction of a machine. Returns false if it had already halted.
+    template <class Log, class = not_a_count<Log>>
+    bool step(E20Machine &machine, Log &log) { return run(machine, log, 1) == 1; }
+
+    bool step(E20Machine &machine) { return run(machine, 1) == 1; }
+
+    /*
+        Calls fn with the basic_cache inside, for code that drives the cache
+        directly (a trace replay, say) with the templates in cache.h. The
+        hierarchy must be configured.
+
+        @return Whatever fn returns
+    */
+    template <class Fn>
+    auto visit(Fn &&fn) {
+        assert(configured());
+        return with_policy(replacement, [&](auto tag) {
+            return fn(static_cast<holder<decltype(tag)> &>(*impl).My_cache);
+        });
+    }
+
+    template <class Fn>
+    auto visit(Fn &&fn) const {
+        assert(configured());
+        return with_policy(replacement, [&](auto tag) {
+            return fn(static_cast<const holder<decltype(tag)> &>(*impl).My_cache);
+        });
+    }
+
+    //Writes the statistics of every level as one run of a stats report; nothing if the hierarchy
+    //isn't configured
+    void report(stats_writer &writer) const {
+        if (!configured())
+            return;
+        visit([&](const auto &My_cache) { writer.run(config, My_cache); });
+    }
+
+    //Passes the contents and statistics of every level through a checkpoint archive. The hierarchy
+    //must already be configured as the one that was saved (see checkpoint.h).
+    template <class Archive>
+    void serialize(Archive &ar) {
+        assert(configured());
+        visit([&](auto &My_cache) {
+            for (auto &lvl : My_cache.My_levels)
+                lvl.serialize(ar);
+            if (My_cache.fetch == FETCH_SPLIT)
+                My_cache.icache.serialize(ar);
+            My_cache.timing.serialize(ar);
+            My_cache.last_fetch = NO_FETCH_BLOCK;
+        });
+    }
+
+private:
+    //Parses a prefetch spec for a hierarchy of num_levels levels
+    static bool prefetchers_fit(const std::string &spec, size_t num_levels, std::vector<prefetch_config> &prefetchers) {
+        return spec.empty() || (parse_prefetch_config(spec, prefetchers) && prefetchers.size() <= num_levels);
+    }
+
+    //Parses a write policy spec for a hierarchy of num_levels levels
+    static bool writes_fit(const std::string &spec, size_t num_levels, std::vector<write_config> &writes) {
+        return spec.empty() || (parse_write_config(spec, writes) && writes.size() <= num_levels);
+    }
+
+    //Parses a latency spec for a hierarchy of num_levels levels, or of any number if SIZE_MAX
+    static bool latencies_fit(const std::string &spec, size_t num_levels, std::vector<unsigned> &latencies) {
+        return spec.empty() || (parse_latency_config(spec, latencies) &&
+            (num_levels == SIZE_MAX || latencies.size() == num_levels + 1));
+    }
+
+    //Builds the hook for the cache inside and runs the machine through it, with a budget if Bounded
+    template <bool Bounded, class Log, class Tap>
+    uint64_t run_through(E20Machine &machine, Log &log, Tap &tap, uint64_t max_cycles) {
+        if (!configured())
+            return 0;
+        return visit([&](auto &My_cache) {
+            typedef typename std::remove_reference<decltype(My_cache)>::type Cache;
+            uint64_t executed;
+            if (My_cache.fetch != FETCH_OFF) {
+                fetch_cache_hook<Cache, Log> hook{My_cache, log};
+                executed = run_with_tap<Bounded>(machine, hook, tap, max_cycles);
+            } else if (pipelined_levels && !My_cache.detailed) {
+                executed = run_pipelined(My_cache, log, [&](auto &hook) {
+                    return run_with_tap<Bounded>(machine, hook, tap, max_cycles);
+                });
+            } else {
+                executed = run_hooked<Bounded>(machine, My_cache, log, tap, max_cycles);
+            }
+            My_cache.timing.instructions += executed;
+            return executed;
+        });
+    }
+
+    //Runs the machine through a cache_hook, with L1's fixed shape if the run is a plain one
+    template <bool Bounded, class Cache, class Log, class Tap>
+    uint64_t run_hooked(E20Machine &machine, Cache &My_cache, Log &log, Tap &tap, uint64_t max_cycles) {
+        if constexpr (!Bounded && std::is_same<Tap, no_hook>::value) {
+            if (shaped_l1) {
+                return with_shape(l1_assoc, [&](auto shape) {
+                    cache_hook<Cache, Log, decltype(shape)> hook{My_cache, log};
+                    return run_with_tap<Bounded>(machine, hook, tap, max_cycles);
+                });
+            }
+        }
+        cache_hook<Cache, Log> hook{My_cache, log};
+        return run_with_tap<Bounded>(machine, hook, tap, max_cycles);
+    }
+
+    template <bool Bounded, class Hook, class Tap>
+    static uint64_t run_with_tap(E20Machine &machine, Hook &hook, Tap &tap, uint64_t max_cycles) {
+        if constexpr (std::is_same<Tap, no_hook>::value) {
+            if constexpr (Bounded)
+                return machine.run(hook, max_cycles);
+            else
+                return machine.run(hook);
+        } else {
+            hook_pair<Hook, Tap> both{hook, tap};
+            if constexpr (Bounded)
+                return machine.run(both, max_cycles);
+            else
+                return machine.run(both);
+        }
+    }
+
+    struct holder_base
+    {
+        virtual ~holder_base() {}
+    };
+
+    template <class Policy>
+    struct holder : holder_base
+    {
+        basic_cache<Policy> My_cache;
+    };
+
+    std::unique_ptr<holder_base> impl;
+    std::vector<level *> levels;
+    level *icache = nullptr;
+    cache_timing *times = nullptr;
+    fetch_mode fetch = FETCH_OFF;
+    std::string config;
+    replacement_policy replacement = POLICY_LRU;
+    int l1_assoc = 0;
+    bool shaped_l1 = false;
+    std::string prefetch;
+    std::string ifetch;
+    std::string write;
+    std::string latency;
+    bool classify = false;
+    bool corrected = false;
+    bool pipelined_levels = false;
+};
+
+#endif
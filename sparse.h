@@ -0,0 +1,142 @@
+/*
+sparse.h
+An array over the whole 32-bit index space that only allocates the pages
+that are written: the memory of the wide address mode, and the statistics
+kept per block address
+*/
+
+#ifndef SPARSE_H
+#define SPARSE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//Keeps the allocating path of at() out of its callers, which are often hot loops
+#if defined(__GNUC__)
+#define SPARSE_NOINLINE __attribute__((noinline))
+#else
+#define SPARSE_NOINLINE
+#endif
+
+//Indexes below DENSE_SIZE, which cover the E20's own memory and every block of it, live in a plain
+//vector that grows to the largest one written, so they cost one load as before. The rest are found
+//through a two-level index: the top bits of an index pick a table, the middle bits a page in that
+//table, and the low bits the entry in the page. Tables and pages are allocated on the first write
+//to them; everything never written reads as T().
+template <class T>
+class sparse_array
+{
+public:
+    static constexpr uint32_t DENSE_SIZE = 1u << 16;
+    static constexpr unsigned PAGE_BITS = 10;
+    static constexpr unsigned TABLE_BITS = 10;
+    static constexpr uint32_t PAGE_SIZE = 1u << PAGE_BITS;
+
+    //The entry at index i, without allocating anything
+    T get(uint32_t i) const {
+        if (i < dense.size())
+            return dense[i];
+        if (i < DENSE_SIZE)
+            return T();
+        uint32_t t = i >> (PAGE_BITS + TABLE_BITS);
+        if (t >= tables.size() || tables[t].empty())
+            return T();
+        uint32_t p = tables[t][(i >> PAGE_BITS) & (TABLE_SIZE - 1)];
+        return p == 0 ? T() : pages[p - 1][i & (PAGE_SIZE - 1)];
+    }
+
+    //The entry at index i, allocated if this is the first write to it
+    T &at(uint32_t i) {
+        if (i < dense.size())
+            return dense[i];
+        return grow(i);
+    }
+
+    //Number of entries allocated so far
+    size_t allocated() const { return dense.size() + pages.size() * PAGE_SIZE; }
+
+    void clear() {
+        dense.clear();
+        tables.clear();
+        pages.clear();
+    }
+
+    //Calls fn(index, value) for every allocated entry, in index order
+    template <class Fn>
+    void for_each(Fn fn) const {
+        for (uint32_t i = 0; i < dense.size(); i++)
+            fn(i, dense[i]);
+        for_each_page([&](uint32_t number, const std::vector<T> &entries) {
+            for (uint32_t k = 0; k < PAGE_SIZE; k++)
+                fn(number << PAGE_BITS | k, entries[k]);
+        });
+    }
+
+    /*
+        Passes the entries through a checkpoint archive (see checkpoint.h):
+        the dense vector, the numbers of the allocated pages, then their
+        contents. The array must be empty when it is read into.
+    */
+    template <class Archive>
+    void serialize(Archive &ar) {
+        ar.io_grow(dense);
+        std::vector<uint32_t> numbers;
+        for_each_page([&](uint32_t number, const std::vector<T> &) { numbers.push_back(number); });
+        ar.io_grow(numbers);
+        if (dense.size() > DENSE_SIZE)
+            ar.fail();
+        for (uint32_t number : numbers) {
+            if (number < (DENSE_SIZE >> PAGE_BITS) || number >> (32 - PAGE_BITS) != 0)
+                ar.fail();
+            else
+                ar.io(page(number));
+        }
+    }
+
+private:
+    static constexpr uint32_t TABLE_SIZE = 1u << TABLE_BITS;
+
+    std::vector<T> dense;
+
+    //tables[t][k] is 1 + the position in pages of page t * TABLE_SIZE + k, or 0 if it isn't allocated.
+    //Only grows as far as the highest table written.
+    std::vector<std::vector<uint32_t>> tables;
+    std::vector<std::vector<T>> pages;
+
+    //at() for an index that isn't allocated yet
+    SPARSE_NOINLINE T &grow(uint32_t i) {
+        if (i < DENSE_SIZE) {
+            dense.resize(i + 1, T());
+            return dense[i];
+        }
+        return page(i >> PAGE_BITS)[i & (PAGE_SIZE - 1)];
+    }
+
+    //The page with the given number (index >> PAGE_BITS), allocated if need be
+    std::vector<T> &page(uint32_t number) {
+        uint32_t t = number >> TABLE_BITS;
+        if (t >= tables.size())
+            tables.resize(t + 1);
+        if (tables[t].empty())
+            tables[t].assign(TABLE_SIZE, 0);
+        uint32_t &p = tables[t][number & (TABLE_SIZE - 1)];
+        if (p == 0) {
+            pages.emplace_back(PAGE_SIZE, T());
+            p = static_cast<uint32_t>(pages.size());
+        }
+        return pages[p - 1];
+    }
+
+    template <class Fn>
+    void for_each_page(Fn fn) const {
+        for (uint32_t t = 0; t < tables.size(); t++) {
+            for (uint32_t k = 0; k < tables[t].size(); k++) {
+                if (tables[t][k] != 0)
+                    fn(t << TABLE_BITS | k, pages[tables[t][k] - 1]);
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,221 @@
+/*
+stackdist.h
+Single-pass LRU stack-distance analysis: exact hit and miss counts for
+every associativity of a given row count and block size, without
+simulating each cache separately
+*/
+
+#ifndef STACKDIST_H
+#define STACKDIST_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "sparse.h"
+
+//A Fenwick (binary indexed) tree over one set's access times that can grow one slot at a time.
+//Slot t is 1 while the access made at set-local time t is still the most recent access to its block.
+struct growing_fenwick
+{
+    //tree[0] is unused so the usual 1-based index arithmetic works
+    std::vector<int32_t> tree{0};
+
+    //Number of slots so far, which is also the next set-local time
+    size_t size() const { return tree.size() - 1; }
+
+    //Sum of slots [1, i]
+    int64_t prefix(size_t i) const {
+        int64_t sum = 0;
+        for (; i > 0; i -= i & -i)
+            sum += tree[i];
+        return sum;
+    }
+
+    void add(size_t i, int32_t delta) {
+        for (; i < tree.size(); i += i & -i)
+            tree[i] += delta;
+    }
+
+    //Appends slot size()+1 holding value. A new node covers (i - lowbit(i), i], so it starts
+    //as the sum of the existing slots in that range plus its own value
+    void push_back(int32_t value) {
+        size_t i = tree.size();
+        size_t low = i - (i & -i);
+        tree.push_back(static_cast<int32_t>(prefix(i - 1) - prefix(low) + value));
+    }
+
+    //Replaces the slots with n slots that all hold 1: node i covers lowbit(i) of them
+    void assign_ones(size_t n) {
+        tree.resize(n + 1);
+        for (size_t i = 1; i <= n; i++)
+            tree[i] = static_cast<int32_t>(i & -i);
+    }
+};
+
+//One set's LRU stack: a slot per access, live while it is its block's most recent access. Once
+//dead slots outnumber the live ones, the live slots are renumbered 1, 2, ... in order, so the tree
+//stays within about twice the set's distinct blocks however long the run.
+struct stack_distance_set
+{
+    growing_fenwick slots;
+
+    //The block each slot was an access to
+    std::vector<uint32_t> owner;
+
+    //Live slots, which is the number of distinct blocks touched in this set
+    size_t live = 0;
+};
+
+//Stack distances for one row count. In an LRU cache with this many rows, an access hits
+//in an A-way level exactly when fewer than A other blocks of its row were touched since the
+//last access to its block.
+struct stack_distance_rows
+{
+    uint32_t num_rows;
+    std::vector<stack_distance_set> sets;
+
+    //Set-local slot of the last access to each block, or 0 if the block hasn't been seen. Sparse, as
+    //the blocks of a wide address space are too many to keep a slot for each.
+    sparse_array<uint64_t> last_access;
+
+    //hist[d] counts accesses with stack distance d; cold counts first touches
+    std::vector<uint64_t> load_hist, store_hist;
+    uint64_t load_cold = 0, store_cold = 0;
+
+    explicit stack_distance_rows(uint32_t rows) : num_rows(rows), sets(rows) {}
+
+    void access(uint32_t blockID, bool is_store) {
+        stack_distance_set &s = sets[blockID % num_rows];
+        if (s.owner.size() >= 2 * s.live + 64)
+            compact(s);
+        growing_fenwick &set = s.slots;
+        uint64_t &last = last_access.at(blockID);
+
+        size_t now = set.size() + 1;
+        if (last == 0) {
+            (is_store ? store_cold : load_cold)++;
+            s.live++;
+        } else {
+            //Distinct blocks of this set touched since the last access = live slots after it
+            uint64_t d = set.prefix(now - 1) - set.prefix(last);
+            std::vector<uint64_t> &hist = is_store ? store_hist : load_hist;
+            if (d >= hist.size())
+                hist.resize(d + 1, 0);
+            hist[d]++;
+            set.add(last, -1);
+        }
+        set.push_back(1);
+        s.owner.push_back(blockID);
+        last = now;
+    }
+
+private:
+    //Renumbers a set's live slots 1, 2, ... in access order and drops the dead ones. Distances
+    //only count live slots, so they don't change
+    void compact(stack_distance_set &s) {
+        size_t n = 0;
+        for (size_t t = 1; t <= s.owner.size(); t++) {
+            uint32_t block = s.owner[t - 1];
+            uint64_t &last = last_access.at(block);
+            if (last == t) {
+                s.owner[n++] = block;
+                last = n;
+            }
+        }
+        s.owner.resize(n);
+        s.slots.assign_ones(n);
+    }
+};
+
+//Runs the analysis for one block size and a list of row counts. Has the same load/store
+//interface as the other interpreter hooks, so it can watch a program or a trace replay.
+struct stack_distance
+{
+    uint32_t block_size;
+    std::vector<stack_distance_rows> by_rows;
+
+    /*
+        @param blocksize The block size, in memory cells, shared by every configuration
+
+        @param rows The row counts to analyze. 1 gives fully associative caches.
+    */
+    stack_distance(uint32_t blocksize, const std::vector<uint32_t> &rows) : block_size(blocksize) {
+        for (uint32_t r : rows)
+            by_rows.emplace_back(r);
+    }
+
+    void load(unsigned, unsigned addr, uint64_t) {
+        for (stack_distance_rows &r : by_rows)
+            r.access(addr / block_size, false);
+    }
+
+    void store(unsigned, unsigned addr, uint64_t) {
+        for (stack_distance_rows &r : by_rows)
+            r.access(addr / block_size, true);
+    }
+
+    /*
+        Writes one tab-separated row per (row count, associativity). For each
+        row count the associativity doubles from 1 until every reuse hits, so
+        the last row of each group only misses on first touches. Hits and
+        misses count every access; load_hits and load_misses count only lw,
+        which is what the L1 HIT and MISS log lines report.
+    */
+    void report(FILE *out) const {
+        fprintf(out, "blocksize\trows\tassoc\tsize\thits\tmisses\tload_hits\tload_misses\n");
+        for (const stack_distance_rows &r : by_rows) {
+            size_t max_d = std::max(r.load_hist.size(), r.store_hist.size());
+            uint64_t loads = r.load_cold, stores = r.store_cold;
+            for (uint64_t n : r.load_hist) loads += n;
+            for (uint64_t n : r.store_hist) stores += n;
+
+            uint64_t load_hits = 0, store_hits = 0;
+            size_t d = 0;
+            for (uint64_t assoc = 1; ; assoc *= 2) {
+                for (; d < assoc && d < max_d; d++) {
+                    if (d < r.load_hist.size()) load_hits += r.load_hist[d];
+                    if (d < r.store_hist.size()) store_hits += r.store_hist[d];
+                }
+                uint64_t hits = load_hits + store_hits;
+                fprintf(out, "%u\t%u\t%llu\t%llu\t%llu\t%llu\t%llu\t%llu\n", block_size, r.num_rows,
+                    static_cast<unsigned long long>(assoc),
+                    static_cast<unsigned long long>(assoc * r.num_rows * block_size),
+                    static_cast<unsigned long long>(hits),
+                    static_cast<unsigned long long>(loads + stores - hits),
+                    static_cast<unsigned long long>(load_hits),
+                    static_cast<unsigned long long>(loads - load_hits));
+                if (assoc >= max_d)
+                    break;
+            }
+        }
+    }
+};
+
+/*
+    Parses a comma-separated list of positive row counts, e.g. "1,8,64".
+
+    @return false if an entry isn't a positive number
+*/
+inline bool parse_rows_list(const std::string &list, std::vector<uint32_t> &rows) {
+    size_t lastpos = 0;
+    while (lastpos <= list.size()) {
+        size_t pos = list.find(',', lastpos);
+        if (pos == std::string::npos)
+            pos = list.size();
+        std::string item = list.substr(lastpos, pos - lastpos);
+        char *end = nullptr;
+        unsigned long v = strtoul(item.c_str(), &end, 10);
+        if (item.empty() || *end != '\0' || v == 0 || v > UINT32_MAX)
+            return false;
+        rows.push_back(static_cast<uint32_t>(v));
+        lastpos = pos + 1;
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,357 @@
+/*
+stats.h
+Writes the per-level counters and miss histograms kept by cache.h as JSON
+or CSV
+*/
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "cache.h"
+#include "sparse.h"
+
+enum stats_format { STATS_JSON, STATS_CSV };
+
+//Writes one report covering one or more cache runs: one for --cache, one per configuration for
+//--sweep. JSON is {"runs": [...]}, one object per run; CSV is one value per row,
+//"config,policy,level,metric,key,value". The fields of each are listed at level_json and
+//level_csv. Histograms list only nonzero entries, most misses first, ties by ascending pc or block.
+struct stats_writer
+{
+    FILE *out = nullptr;
+    stats_format format = STATS_JSON;
+
+    stats_writer() = default;
+    ~stats_writer() { close(); }
+
+    stats_writer(const stats_writer &) = delete;
+    stats_writer &operator=(const stats_writer &) = delete;
+
+    /*
+        Creates the report file. Nothing is written until the first run, so
+        a report on stdout follows the event log.
+
+        @param path The file to create: CSV if it ends in .csv, otherwise
+            JSON. - writes JSON to stdout.
+
+        @return false if the file can't be created
+    */
+    bool open(const char *path) {
+        std::string p(path);
+        format = p.size() >= 4 && p.compare(p.size() - 4, 4, ".csv") == 0 ? STATS_CSV : STATS_JSON;
+        out = p == "-" ? stdout : fopen(path, "w");
+        return out != nullptr;
+    }
+
+    /*
+        Writes the statistics of one cache: in JSON, {"config": "...",
+        "policy": "lru", "levels": [...]}. A cache that models instruction
+        fetches (see cache_fetch) adds "ifetch": "unified" or "split" before
+        "levels"; a split cache's instruction cache follows "levels" as
+        "icache", laid out like a level (level I1 in CSV). A timed cache ends
+        the run with "timing" (see timing_json).
+
+        @param config The configuration the cache was built from
+
+        @param My_cache The cache, after the run
+    */
+    template <class Policy, class Shape>
+    void run(const std::string &config, const basic_cache<Policy, Shape> &My_cache) {
+        if (!started)
+            start();
+        fetches = My_cache.fetch != FETCH_OFF;
+        writes = false;
+        for (const auto &lvl : My_cache.My_levels)
+            writes = writes || lvl.write.back || !lvl.write.allocate;
+        bool split = My_cache.fetch == FETCH_SPLIT;
+        if (format == STATS_JSON) {
+            fprintf(out, "%s\n  {\"config\": %s, \"policy\": \"%s\", ", runs > 0 ? "," : "",
+                quoted(config).c_str(), Policy::name());
+            if (fetches)
+                fprintf(out, "\"ifetch\": \"%s\", ", split ? "split" : "unified");
+            fprintf(out, "\"levels\": [");
+            for (size_t i = 0; i < My_cache.My_levels.size(); i++)
+                level_json(std::to_string(i + 1), My_cache.My_levels[i], i + 1 == My_cache.My_levels.size());
+            fprintf(out, "]");
+            if (split) {
+                fprintf(out, ", \"icache\":");
+                level_json("\"I1\"", My_cache.icache, true);
+            }
+            if (My_cache.timing.on)
+                timing_json(My_cache.timing);
+            fprintf(out, "}");
+        } else {
+            if (split)
+                level_csv(quoted(config), Policy::name(), "I1", My_cache.icache);
+            for (size_t i = 0; i < My_cache.My_levels.size(); i++)
+                level_csv(quoted(config), Policy::name(), std::to_string(i + 1), My_cache.My_levels[i]);
+            if (My_cache.timing.on)
+                timing_csv(quoted(config), Policy::name(), My_cache.timing);
+        }
+        runs++;
+    }
+
+    //Closes the JSON document and the file
+    void close() {
+        if (out == nullptr)
+            return;
+        if (!started)
+            start();
+        if (format == STATS_JSON)
+            fprintf(out, "\n]}\n");
+        if (out == stdout)
+            fflush(out);
+        else
+            fclose(out);
+        out = nullptr;
+    }
+
+private:
+    bool started = false;
+    size_t runs = 0;
+
+    //Whether the run being written models instruction fetches, and has a level that isn't
+    //write-through with allocate
+    bool fetches = false;
+    bool writes = false;
+
+    //Writes the JSON opening or the CSV column names
+    void start() {
+        if (format == STATS_JSON)
+            fprintf(out, "{\"runs\": [");
+        else
+            fprintf(out, "config,policy,level,metric,key,value\n");
+        started = true;
+    }
+
+    //(index, misses) for every nonzero entry, in index order
+    static void nonzero(const std::vector<uint64_t> &hist, std::vector<std::pair<size_t, uint64_t>> &r) {
+        for (size_t i = 0; i < hist.size(); i++) {
+            if (hist[i] > 0)
+                r.emplace_back(i, hist[i]);
+        }
+    }
+
+    static void nonzero(const sparse_array<uint64_t> &hist, std::vector<std::pair<size_t, uint64_t>> &r) {
+        hist.for_each([&](uint32_t i, uint64_t n) {
+            if (n > 0)
+                r.emplace_back(i, n);
+        });
+    }
+
+    //(index, misses) for every nonzero entry, most misses first
+    template <class Hist>
+    static std::vector<std::pair<size_t, uint64_t>> ranked(const Hist &hist) {
+        std::vector<std::pair<size_t, uint64_t>> r;
+        nonzero(hist, r);
+        std::stable_sort(r.begin(), r.end(), [](const std::pair<size_t, uint64_t> &a,
+            const std::pair<size_t, uint64_t> &b) { return a.second > b.second; });
+        return r;
+    }
+
+    //The config in double quotes: the CSV field needs them for its commas. Quotes inside are
+    //escaped as "" in CSV and \" in JSON; sweep files can hold anything stoi skips over.
+    std::string quoted(const std::string &config) const {
+        std::string q = "\"";
+        for (char c : config) {
+            if (c == '"')
+                q += format == STATS_CSV ? "\"\"" : "\\\"";
+            else if (c == '\\' && format == STATS_JSON)
+                q += "\\\\";
+            else if (static_cast<unsigned char>(c) >= 0x20)
+                q += c;
+        }
+        return q + "\"";
+    }
+
+    static unsigned long long ull(uint64_t v) { return static_cast<unsigned long long>(v); }
+
+    static uint64_t pc_class(const level_stats &s, size_t pc, miss_class c) {
+        return pc * 3 + c < s.pc_classes.size() ? s.pc_classes[pc * 3 + c] : 0;
+    }
+
+    static double accuracy(const level_stats &s) {
+        return s.prefetch_fills == 0 ? 0.0 : static_cast<double>(s.prefetch_useful) / s.prefetch_fills;
+    }
+
+    static double coverage(const level_stats &s) {
+        uint64_t would_miss = s.prefetch_useful + s.misses();
+        return would_miss == 0 ? 0.0 : static_cast<double>(s.prefetch_useful) / would_miss;
+    }
+
+    static long long misses_removed(const level_stats &s) {
+        return static_cast<long long>(s.prefetch_useful) - static_cast<long long>(s.prefetch_polluting);
+    }
+
+    /*
+        Writes one level as {"level": 1, "size", "associativity", "blocksize",
+        "rows", "accesses", "hits", "misses", "evictions", "load_hits",
+        "load_misses", "store_hits", "store_misses", "pc_misses": [[pc,
+        misses], ...], "block_misses": [[block, misses], ...]}. Optional
+        fields, each only when the cache has the feature:
+
+          write_policy, writebacks         after evictions, when a level isn't
+                                           write-through with allocate
+          fetch_hits, fetch_misses         after store_misses, with fetches
+          compulsory_misses,               after store_misses, with classify.h;
+            capacity_misses,               also "pc_miss_classes": [[pc,
+            conflict_misses                compulsory, capacity, conflict],
+                                           ...] last, in pc_misses order
+          prefetcher, prefetch_requests,   after store_misses, with prefetch.h
+            prefetch_fills, _useful,
+            _late, _useless, _polluting
+          prefetch_accuracy                useful / fills
+          prefetch_coverage                useful / (useful + misses)
+          misses_removed                   useful - polluting; can be negative
+
+        Fetches count in accesses, hits, misses and the histograms.
+
+        @param label The value of "level": the level's number, or "I1" quoted
+            for the instruction cache
+    */
+    void level_json(const std::string &label, const level &lvl, bool last) {
+        const level_stats &s = lvl.stats;
+        fprintf(out, "\n    {\"level\": %s, \"size\": %d, \"associativity\": %d, \"blocksize\": %d, \"rows\": %u,\n",
+            label.c_str(), lvl.cache_size, lvl.associativity, lvl.block_size, lvl.num_rows);
+        fprintf(out, "     \"accesses\": %llu, \"hits\": %llu, \"misses\": %llu, \"evictions\": %llu,\n",
+            ull(s.accesses()), ull(s.hits()), ull(s.misses()), ull(s.evictions));
+        if (writes)
+            fprintf(out, "     \"write_policy\": \"%s\", \"writebacks\": %llu,\n", write_name(lvl.write).c_str(),
+                ull(s.writebacks));
+        fprintf(out, "     \"load_hits\": %llu, \"load_misses\": %llu, \"store_hits\": %llu, \"store_misses\": %llu,\n",
+            ull(s.load_hits), ull(s.load_misses), ull(s.store_hits), ull(s.store_misses));
+        if (fetches)
+            fprintf(out, "     \"fetch_hits\": %llu, \"fetch_misses\": %llu,\n", ull(s.fetch_hits), ull(s.fetch_misses));
+        if (lvl.classifier.on()) {
+            fprintf(out, "     \"compulsory_misses\": %llu, \"capacity_misses\": %llu, \"conflict_misses\": %llu,\n",
+                ull(s.compulsory_misses), ull(s.capacity_misses), ull(s.conflict_misses));
+        }
+        if (lvl.prefetch.on()) {
+            fprintf(out, "     \"prefetcher\": \"%s\", \"prefetch_requests\": %llu, \"prefetch_fills\": %llu,\n",
+                prefetch_name(lvl.prefetch.config).c_str(), ull(s.prefetch_requests), ull(s.prefetch_fills));
+            fprintf(out, "     \"prefetch_useful\": %llu, \"prefetch_late\": %llu, \"prefetch_useless\": %llu, "
+                "\"prefetch_polluting\": %llu,\n", ull(s.prefetch_useful), ull(s.prefetch_late),
+                ull(s.prefetch_useless), ull(s.prefetch_polluting));
+            fprintf(out, "     \"prefetch_accuracy\": %.6f, \"prefetch_coverage\": %.6f, \"misses_removed\": %lld,\n",
+                accuracy(s), coverage(s), misses_removed(s));
+        }
+        histogram_json("pc_misses", s.pc_misses);
+        fprintf(out, ",\n");
+        histogram_json("block_misses", s.block_misses);
+        if (lvl.classifier.on()) {
+            fprintf(out, ",\n     \"pc_miss_classes\": [");
+            std::vector<std::pair<size_t, uint64_t>> r = ranked(s.pc_misses);
+            for (size_t i = 0; i < r.size(); i++) {
+                size_t pc = r[i].first;
+                fprintf(out, "%s[%zu, %llu, %llu, %llu]", i > 0 ? ", " : "", pc, ull(pc_class(s, pc, MISS_COMPULSORY)),
+                    ull(pc_class(s, pc, MISS_CAPACITY)), ull(pc_class(s, pc, MISS_CONFLICT)));
+            }
+            fprintf(out, "]");
+        }
+        fprintf(out, "}%s", last ? "" : ",");
+    }
+
+    //"timing": {"latencies": [L1, ..., memory], "instructions", "accesses", "access_cycles",
+    //"stall_cycles", "amat", "cpi"}
+    void timing_json(const cache_timing &t) {
+        fprintf(out, ",\n   \"timing\": {\"latencies\": [");
+        for (unsigned h : t.hit)
+            fprintf(out, "%u, ", h);
+        fprintf(out, "%u], \"instructions\": %llu, \"accesses\": %llu, \"access_cycles\": %llu,\n", t.memory,
+            ull(t.instructions), ull(t.accesses), ull(t.access_cycles));
+        fprintf(out, "     \"stall_cycles\": %llu, \"amat\": %.6f, \"cpi\": %.6f}", ull(t.stall_cycles), t.amat(), t.cpi());
+    }
+
+    //Rows with an empty level; the latencies are one row each, keyed by level number or memory
+    void timing_csv(const std::string &config, const char *policy, const cache_timing &t) {
+        for (size_t i = 0; i < t.hit.size(); i++)
+            fprintf(out, "%s,%s,,latency,%zu,%u\n", config.c_str(), policy, i + 1, t.hit[i]);
+        fprintf(out, "%s,%s,,latency,memory,%u\n", config.c_str(), policy, t.memory);
+        const std::pair<const char *, uint64_t> counters[] = {
+            {"instructions", t.instructions}, {"accesses", t.accesses}, {"access_cycles", t.access_cycles},
+            {"stall_cycles", t.stall_cycles},
+        };
+        for (const auto &c : counters)
+            fprintf(out, "%s,%s,,%s,,%llu\n", config.c_str(), policy, c.first, ull(c.second));
+        fprintf(out, "%s,%s,,amat,,%.6f\n", config.c_str(), policy, t.amat());
+        fprintf(out, "%s,%s,,cpi,,%.6f\n", config.c_str(), policy, t.cpi());
+    }
+
+    template <class Hist>
+    void histogram_json(const char *name, const Hist &hist) {
+        fprintf(out, "     \"%s\": [", name);
+        std::vector<std::pair<size_t, uint64_t>> r = ranked(hist);
+        for (size_t i = 0; i < r.size(); i++)
+            fprintf(out, "%s[%zu, %llu]", i > 0 ? ", " : "", r[i].first, ull(r[i].second));
+        fprintf(out, "]");
+    }
+
+    //The counters of level_json, one row each with an empty key. write_policy and prefetcher are
+    //rows keyed by the policy or prefetcher name, with an empty value. The histograms are rows with
+    //metric pc_misses or block_misses keyed by pc or block; pc_miss_classes becomes the metrics
+    //pc_compulsory_misses, pc_capacity_misses and pc_conflict_misses, nonzero entries only.
+    void level_csv(const std::string &config, const char *policy, const std::string &label, const level &lvl) {
+        const level_stats &s = lvl.stats;
+        const std::pair<const char *, uint64_t> counters[] = {
+            {"accesses", s.accesses()}, {"hits", s.hits()}, {"misses", s.misses()},
+            {"evictions", s.evictions}, {"load_hits", s.load_hits}, {"load_misses", s.load_misses},
+            {"store_hits", s.store_hits}, {"store_misses", s.store_misses},
+        };
+        for (const auto &c : counters)
+            fprintf(out, "%s,%s,%s,%s,,%llu\n", config.c_str(), policy, label.c_str(), c.first, ull(c.second));
+        if (writes) {
+            fprintf(out, "%s,%s,%s,write_policy,%s,\n", config.c_str(), policy, label.c_str(), write_name(lvl.write).c_str());
+            fprintf(out, "%s,%s,%s,writebacks,,%llu\n", config.c_str(), policy, label.c_str(), ull(s.writebacks));
+        }
+        if (fetches) {
+            fprintf(out, "%s,%s,%s,fetch_hits,,%llu\n", config.c_str(), policy, label.c_str(), ull(s.fetch_hits));
+            fprintf(out, "%s,%s,%s,fetch_misses,,%llu\n", config.c_str(), policy, label.c_str(), ull(s.fetch_misses));
+        }
+        if (lvl.classifier.on()) {
+            const std::pair<const char *, uint64_t> class_counters[] = {
+                {"compulsory_misses", s.compulsory_misses}, {"capacity_misses", s.capacity_misses},
+                {"conflict_misses", s.conflict_misses},
+            };
+            for (const auto &c : class_counters)
+                fprintf(out, "%s,%s,%s,%s,,%llu\n", config.c_str(), policy, label.c_str(), c.first, ull(c.second));
+        }
+        if (lvl.prefetch.on()) {
+            const std::pair<const char *, uint64_t> prefetch_counters[] = {
+                {"prefetch_requests", s.prefetch_requests}, {"prefetch_fills", s.prefetch_fills},
+                {"prefetch_useful", s.prefetch_useful}, {"prefetch_late", s.prefetch_late},
+                {"prefetch_useless", s.prefetch_useless}, {"prefetch_polluting", s.prefetch_polluting},
+            };
+            fprintf(out, "%s,%s,%s,prefetcher,%s,\n", config.c_str(), policy, label.c_str(),
+                prefetch_name(lvl.prefetch.config).c_str());
+            for (const auto &c : prefetch_counters)
+                fprintf(out, "%s,%s,%s,%s,,%llu\n", config.c_str(), policy, label.c_str(), c.first, ull(c.second));
+            fprintf(out, "%s,%s,%s,prefetch_accuracy,,%.6f\n", config.c_str(), policy, label.c_str(), accuracy(s));
+            fprintf(out, "%s,%s,%s,prefetch_coverage,,%.6f\n", config.c_str(), policy, label.c_str(), coverage(s));
+            fprintf(out, "%s,%s,%s,misses_removed,,%lld\n", config.c_str(), policy, label.c_str(), misses_removed(s));
+        }
+        for (const auto &e : ranked(s.pc_misses))
+            fprintf(out, "%s,%s,%s,pc_misses,%zu,%llu\n", config.c_str(), policy, label.c_str(), e.first, ull(e.second));
+        for (const auto &e : ranked(s.block_misses))
+            fprintf(out, "%s,%s,%s,block_misses,%zu,%llu\n", config.c_str(), policy, label.c_str(), e.first, ull(e.second));
+        if (lvl.classifier.on()) {
+            const char *names[] = {"pc_compulsory_misses", "pc_capacity_misses", "pc_conflict_misses"};
+            for (const auto &e : ranked(s.pc_misses)) {
+                for (unsigned c = 0; c < 3; c++) {
+                    uint64_t n = pc_class(s, e.first, static_cast<miss_class>(c));
+                    if (n > 0)
+                        fprintf(out, "%s,%s,%s,%s,%zu,%llu\n", config.c_str(), policy, label.c_str(), names[c], e.first, ull(n));
+                }
+            }
+        }
+    }
+};
+
+#endif
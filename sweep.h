@@ -0,0 +1,191 @@
+/*
+sweep.h
+Replays the memory accesses of one E20 run against many cache
+configurations in parallel. trace.h records and maps the accesses
+*/
+
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "cache.h"
+#include "log.h"
+#include "pool.h"
+#include "stats.h"
+
+//One lw or sw made by the program
+struct mem_access
+{
+    uint64_t clock_cycle;
+    uint32_t addr;
+    uint16_t pc;
+    bool is_store;
+};
+
+/*
+    Reads a sweep file: one cache configuration per line, in the same form
+    as --cache. Blank lines and lines starting with # are skipped.
+
+    @param path The sweep file
+
+    @param configs Receives the configurations, in file order
+
+    @return false, after printing an error, if the file can't be read or
+        a line is not a valid configuration
+*/
+inline bool read_sweep_configs(const char *path, std::vector<std::string> &configs) {
+    std::ifstream f(path);
+    if (!f.is_open()) {
+        fprintf(stderr, "Can't open file %s\n", path);
+        return false;
+    }
+    std::string line;
+    int line_number = 0;
+    while (getline(f, line)) {
+        line_number++;
+        line.erase(0, line.find_first_not_of(" \t\r"));
+        line.erase(line.find_last_not_of(" \t\r") + 1);
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::vector<int> parts;
+        if (!parse_cache_config(line, parts)) {
+            fprintf(stderr, "Invalid cache config on line %d of %s: %s\n", line_number, path, line.c_str());
+            return false;
+        }
+        configs.push_back(line);
+    }
+    return true;
+}
+
+/*
+    Writes the table printed by --sweep and --batch: one tab-separated row
+    per run, with hits, misses, stores and hit rate for every level.
+
+    @param out Where the table is written
+
+    @param label_columns The header of the columns that name a run, tab-separated
+
+    @param labels The text of those columns for each run
+
+    @param results The counts of each run, in the same order as labels
+
+    @param classes If not null, the compulsory, capacity and conflict misses
+        of every level of each run (see classify.h), three per level, which
+        get three more columns per level
+*/
+inline void write_count_table(FILE *out, const char *label_columns, const std::vector<std::string> &labels,
+    const std::vector<count_log> &results, const std::vector<std::vector<uint64_t>> *classes = nullptr) {
+    size_t max_levels = 0;
+    for (const count_log &r : results)
+        max_levels = std::max(max_levels, r.counts.size() / 3);
+
+    fprintf(out, "%s", label_columns);
+    for (size_t l = 1; l <= max_levels; l++) {
+        fprintf(out, "\tL%zu_hits\tL%zu_misses\tL%zu_stores\tL%zu_hit_rate", l, l, l, l);
+        if (classes != nullptr)
+            fprintf(out, "\tL%zu_compulsory\tL%zu_capacity\tL%zu_conflict", l, l, l);
+    }
+    fprintf(out, "\n");
+    for (size_t i = 0; i < labels.size(); i++) {
+        fprintf(out, "%s", labels[i].c_str());
+        const std::vector<uint64_t> &c = results[i].counts;
+        for (size_t l = 0; l < max_levels; l++) {
+            if (l * 3 >= c.size()) {
+                fprintf(out, classes != nullptr ? "\t-\t-\t-\t-\t-\t-\t-" : "\t-\t-\t-\t-");
+                continue;
+            }
+            uint64_t hits = c[l * 3 + LOG_HIT];
+            uint64_t misses = c[l * 3 + LOG_MISS];
+            double rate = hits + misses > 0 ? static_cast<double>(hits) / (hits + misses) : 0.0;
+            fprintf(out, "\t%llu\t%llu\t%llu\t%.4f", static_cast<unsigned long long>(hits),
+                static_cast<unsigned long long>(misses),
+                static_cast<unsigned long long>(c[l * 3 + LOG_SW]), rate);
+            if (classes != nullptr) {
+                const std::vector<uint64_t> &k = (*classes)[i];
+                fprintf(out, "\t%llu\t%llu\t%llu", static_cast<unsigned long long>(k[l * 3 + MISS_COMPULSORY]),
+                    static_cast<unsigned long long>(k[l * 3 + MISS_CAPACITY]),
+                    static_cast<unsigned long long>(k[l * 3 + MISS_CONFLICT]));
+            }
+        }
+        fprintf(out, "\n");
+    }
+}
+
+/*
+    Evaluates every configuration on a pool of threads and writes one
+    tab-separated row per configuration, in the order the configurations
+    were given. Every cache uses the replacement policy Policy.
+
+    @param configs The cache configurations to evaluate
+
+    @param out Where the table is written
+
+    @param replay_one Called as replay_one(basic_cache<Policy, Shape> &, count_log &) to send the
+        access stream through one configuration's cache. Returns false if
+        the stream couldn't be read. It is called from several threads at once,
+        and with a different Shape for each L1 shape in the sweep, so it is
+        normally a generic lambda.
+
+    @param stats If not null, also receives the statistics of every configuration's cache
+
+    @param num_threads Number of worker threads, 0 to use one per hardware thread
+
+    @param classify Whether to sort every level's misses into the three Cs (see classify.h), which
+        the table then shows
+
+    @param corrected Whether stores bring their block into every level that misses (see
+        corrected_stores in cache.h)
+
+    @return false if any replay failed, in which case nothing is written
+*/
+template <class Policy, class Replay>
+bool run_sweep(const std::vector<std::string> &configs, FILE *out, Replay replay_one,
+    stats_writer *stats = nullptr, unsigned num_threads = 0, bool classify = false, bool corrected = false) {
+    //Every configuration is one job; each writes only its own slot of results
+    std::vector<count_log> results(configs.size());
+    std::vector<std::vector<uint64_t>> classes(classify ? configs.size() : 0);
+    std::vector<basic_cache<Policy>> caches(stats != nullptr ? configs.size() : 0);
+    std::atomic<bool> failed(false);
+    work_stealing_pool pool(num_threads);
+    pool.run(configs.size(), [&](size_t i) {
+        with_shape(configs[i], [&](auto shape) {
+            basic_cache<Policy, decltype(shape)> My_cache;
+            init_cache(My_cache, configs[i]);
+            My_cache.corrected_stores = corrected;
+            for (auto &lvl : My_cache.My_levels)
+                set_miss_classification(lvl, classify);
+            count_log counts(My_cache.My_levels.size());
+            if (!replay_one(My_cache, counts))
+                failed = true;
+            results[i] = std::move(counts);
+            if (classify) {
+                for (const auto &lvl : My_cache.My_levels) {
+                    classes[i].push_back(lvl.stats.compulsory_misses);
+                    classes[i].push_back(lvl.stats.capacity_misses);
+                    classes[i].push_back(lvl.stats.conflict_misses);
+                }
+            }
+            if (stats != nullptr)
+                caches[i].My_levels = std::move(My_cache.My_levels);
+        });
+    });
+    if (failed)
+        return false;
+
+    write_count_table(out, "config", configs, results, classify ? &classes : nullptr);
+
+    if (stats != nullptr) {
+        for (size_t i = 0; i < configs.size(); i++)
+            stats->run(configs[i], caches[i]);
+    }
+    return true;
+}
+
+#endif
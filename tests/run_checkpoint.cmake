@@ -0,0 +1,28 @@
+# Runs simcache on PROGRAM with ARGS straight through, then again saving a checkpoint after AT
+# instructions and restoring it, and fails unless both --stats reports are exactly the same.
+# Invoked by ctest as: cmake -DSIMCACHE=... -DPROGRAM=... -DARGS=... -DAT=... -DWORKDIR=... -P run_checkpoint.cmake
+separate_arguments(ARGS)
+set(straight ${WORKDIR}/checkpoint_straight.json)
+set(saved ${WORKDIR}/checkpoint.e20ckp)
+set(restored ${WORKDIR}/checkpoint_restored.json)
+file(REMOVE ${straight} ${saved} ${restored})
+execute_process(COMMAND ${SIMCACHE} ${ARGS} --log none --stats ${straight} ${PROGRAM}
+    OUTPUT_QUIET RESULT_VARIABLE status)
+if(NOT status EQUAL 0)
+    message(FATAL_ERROR "straight run exited with ${status}")
+endif()
+execute_process(COMMAND ${SIMCACHE} ${ARGS} --log none --checkpoint-at ${AT} --save-checkpoint ${saved} ${PROGRAM}
+    OUTPUT_QUIET RESULT_VARIABLE status)
+if(NOT status EQUAL 0)
+    message(FATAL_ERROR "checkpointed run exited with ${status}")
+endif()
+execute_process(COMMAND ${SIMCACHE} --restore ${saved} --log none --stats ${restored}
+    OUTPUT_QUIET RESULT_VARIABLE status)
+if(NOT status EQUAL 0)
+    message(FATAL_ERROR "restored run exited with ${status}")
+endif()
+file(READ ${straight} expected)
+file(READ ${restored} actual)
+if(NOT actual STREQUAL expected)
+    message(FATAL_ERROR "restored statistics differ from the straight run:\n${actual}")
+endif()
@@ -0,0 +1,12 @@
+# Runs simcache on PROGRAM with ARGS and fails unless its stdout is exactly EXPECTED.
+# Invoked by ctest as: cmake -DSIMCACHE=... -DPROGRAM=... -DEXPECTED=... -DARGS=... -P run_regress.cmake
+separate_arguments(ARGS)
+execute_process(COMMAND ${SIMCACHE} ${ARGS} ${PROGRAM}
+    OUTPUT_VARIABLE actual RESULT_VARIABLE status)
+if(NOT status EQUAL 0)
+    message(FATAL_ERROR "simcache exited with ${status}")
+endif()
+file(READ ${EXPECTED} expected)
+if(NOT actual STREQUAL expected)
+    message(FATAL_ERROR "output differs from ${EXPECTED}:\n${actual}")
+endif()
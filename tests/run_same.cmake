@@ -0,0 +1,17 @@
+# Runs simcache on PROGRAM with ARGS_A and with ARGS_B and fails unless both print exactly the same.
+# Invoked by ctest as: cmake -DSIMCACHE=... -DPROGRAM=... -DARGS_A=... -DARGS_B=... -P run_same.cmake
+separate_arguments(ARGS_A)
+separate_arguments(ARGS_B)
+execute_process(COMMAND ${SIMCACHE} ${ARGS_A} ${PROGRAM}
+    OUTPUT_VARIABLE expected RESULT_VARIABLE status)
+if(NOT status EQUAL 0)
+    message(FATAL_ERROR "simcache ${ARGS_A} exited with ${status}")
+endif()
+execute_process(COMMAND ${SIMCACHE} ${ARGS_B} ${PROGRAM}
+    OUTPUT_VARIABLE actual RESULT_VARIABLE status)
+if(NOT status EQUAL 0)
+    message(FATAL_ERROR "simcache ${ARGS_B} exited with ${status}")
+endif()
+if(NOT actual STREQUAL expected)
+    message(FATAL_ERROR "${ARGS_B} differs from ${ARGS_A}:\n${expected}\n---\n${actual}")
+endif()
@@ -0,0 +1,381 @@
+/*
+timeline.h
+Interval profiling: the run is cut into intervals of a fixed number of
+instructions, and each one gets its per-level accesses, misses and working
+set, and a phase. Phases are found online by clustering the intervals'
+signatures, so a long run can be simulated through one representative
+interval per phase.
+*/
+
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "cache.h"
+#include "log.h"
+#include "simulator.h"
+#include "sparse.h"
+#include "trace.h"
+
+//Timeline file layout, binary, all fixed-width fields little-endian:
+//
+//  header (32 bytes):
+//      char[8]  magic "E20TLN1\n"
+//      uint64   instructions per interval
+//      uint64   clock cycle the first interval starts at
+//      uint32   number of cache levels
+//      uint32   0
+//
+//  one record per interval, in order, each a run of LEB128 varints: the instructions it ran (the
+//  interval length, except for the last), its phase, then for each level from L1 down its accesses,
+//  misses and working set
+//
+//CSV: a header row, then one row per interval, "interval,start_cycle,instructions,phase" followed by
+//L1_accesses,L1_misses,L1_working_set and the same for every further level.
+static const char TIMELINE_MAGIC[8] = {'E', '2', '0', 'T', 'L', 'N', '1', '\n'};
+
+//Buckets of an interval's signature
+const unsigned PHASE_SIGNATURE_SIZE = 32;
+
+//An interval joins the nearest phase if the Manhattan distance between its signature and the phase's
+//is below this (signatures are normalized, so distances run from 0 to 2); otherwise it starts a new phase
+const double PHASE_THRESHOLD = 0.5;
+
+//What an interval's signature counts, hashed into its buckets:
+//  pc     the pcs of the lw and sw it executed, standing in for its basic blocks
+//  block  the L1 blocks its lw and sw touched
+enum phase_signature { SIGNATURE_PC, SIGNATURE_BLOCK };
+
+/*
+    Parses the name of a signature, the argument of --phase-signature.
+
+    @return false if name is neither pc nor block
+*/
+inline bool parse_phase_signature(const std::string &name, phase_signature &kind) {
+    if (name == "pc") kind = SIGNATURE_PC;
+    else if (name == "block") kind = SIGNATURE_BLOCK;
+    else return false;
+    return true;
+}
+
+//An interpreter hook that collects what an interval needs beyond the level statistics: the working
+//set of each level, counted as the distinct blocks of its block size the interval's lw and sw touched,
+//and the interval's signature
+struct interval_profiler
+{
+    phase_signature kind = SIGNATURE_PC;
+    std::vector<int> block_sizes;
+
+    //touched[i].get(block) is the number of the last interval that touched the block at level i, + 1
+    std::vector<sparse_array<uint32_t>> touched;
+    uint32_t stamp = 1;
+
+    std::vector<uint64_t> working_set;
+    std::array<uint64_t, PHASE_SIGNATURE_SIZE> signature{};
+
+    //Profiles the levels of a configured hierarchy
+    void init(const CacheHierarchy &caches, phase_signature k) {
+        kind = k;
+        block_sizes.clear();
+        for (size_t i = 0; i < caches.num_levels(); i++)
+            block_sizes.push_back(caches.level_info(i).block_size);
+        touched.assign(block_sizes.size(), sparse_array<uint32_t>());
+        working_set.assign(block_sizes.size(), 0);
+        stamp = 1;
+        signature.fill(0);
+    }
+
+    void load(unsigned pc, unsigned addr, uint64_t) { access(pc, addr); }
+
+    void store(unsigned pc, unsigned addr, uint64_t) { access(pc, addr); }
+
+    //Starts the next interval with an empty working set and signature
+    void next_interval() {
+        stamp++;
+        working_set.assign(working_set.size(), 0);
+        signature.fill(0);
+    }
+
+private:
+    void access(unsigned pc, unsigned addr) {
+        for (size_t i = 0; i < block_sizes.size(); i++) {
+            uint32_t &last = touched[i].at(addr / block_sizes[i]);
+            if (last != stamp) {
+                last = stamp;
+                working_set[i]++;
+            }
+        }
+        //The top five bits of a multiplicative hash pick one of the 32 buckets
+        uint32_t key = kind == SIGNATURE_PC ? pc : addr / block_sizes[0];
+        signature[static_cast<uint32_t>(key * 2654435761u) >> 27]++;
+    }
+};
+
+//Sorts intervals into phases as they finish. Each phase keeps the mean of its intervals' normalized
+//signatures; an interval joins the phase whose mean is nearest, if it is near enough (see
+//PHASE_THRESHOLD), and starts a phase of its own if not.
+struct phase_tracker
+{
+    typedef std::array<double, PHASE_SIGNATURE_SIZE> vector;
+
+    std::vector<vector> centroids;
+    std::vector<uint64_t> sizes;
+
+    //Each phase's representative: the interval nearest the phase's mean when it was assigned, kept
+    //until a later interval is nearer the mean as it is then. Only these signatures are kept, so
+    //memory grows with the phases, not the intervals.
+    std::vector<uint64_t> representatives;
+    std::vector<vector> representative_signatures;
+
+    //Intervals assigned so far
+    uint64_t intervals = 0;
+
+    /*
+        Assigns an interval to a phase.
+
+        @param counts The interval's signature
+
+        @return Its phase, numbered from 0 in order of first appearance
+    */
+    uint32_t classify(const std::array<uint64_t, PHASE_SIGNATURE_SIZE> &counts) {
+        vector v = normalized(counts);
+        uint32_t best = 0;
+        double best_distance = PHASE_THRESHOLD;
+        bool found = false;
+        for (uint32_t p = 0; p < centroids.size(); p++) {
+            double d = distance(v, centroids[p]);
+            if (d < best_distance) {
+                best = p;
+                best_distance = d;
+                found = true;
+            }
+        }
+        if (!found) {
+            best = static_cast<uint32_t>(centroids.size());
+            centroids.push_back(vector{});
+            sizes.push_back(0);
+            representatives.push_back(intervals);
+            representative_signatures.push_back(v);
+        }
+        sizes[best]++;
+        for (size_t i = 0; i < v.size(); i++)
+            centroids[best][i] += (v[i] - centroids[best][i]) / sizes[best];
+        //The earlier interval wins a tie
+        if (distance(v, centroids[best]) < distance(representative_signatures[best], centroids[best])) {
+            representatives[best] = intervals;
+            representative_signatures[best] = v;
+        }
+        intervals++;
+        return best;
+    }
+
+    size_t num_phases() const { return centroids.size(); }
+
+private:
+    static vector normalized(const std::array<uint64_t, PHASE_SIGNATURE_SIZE> &counts) {
+        uint64_t total = 0;
+        for (uint64_t n : counts)
+            total += n;
+        vector v{};
+        for (size_t i = 0; i < v.size() && total > 0; i++)
+            v[i] = static_cast<double>(counts[i]) / total;
+        return v;
+    }
+
+    static double distance(const vector &a, const vector &b) {
+        double d = 0;
+        for (size_t i = 0; i < a.size(); i++)
+            d += a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+        return d;
+    }
+};
+
+//What one interval did, per level from L1 down
+struct interval_record
+{
+    uint64_t start_cycle = 0;
+    uint64_t instructions = 0;
+    uint32_t phase = 0;
+    std::vector<uint64_t> accesses;
+    std::vector<uint64_t> misses;
+    std::vector<uint64_t> working_set;
+};
+
+//Streams the intervals of a run to a timeline file as they finish
+struct timeline_writer
+{
+    FILE *out = nullptr;
+    bool csv = false;
+
+    timeline_writer() = default;
+    ~timeline_writer() { close(); }
+
+    timeline_writer(const timeline_writer &) = delete;
+    timeline_writer &operator=(const timeline_writer &) = delete;
+
+    /*
+        Creates the timeline file. Nothing is written until start().
+
+        @param path The file to create: CSV if it ends in .csv, otherwise
+            binary
+
+        @return false if the file can't be created
+    */
+    bool open(const char *path) {
+        std::string p(path);
+        csv = p.size() >= 4 && p.compare(p.size() - 4, 4, ".csv") == 0;
+        out = fopen(path, csv ? "w" : "wb");
+        return out != nullptr;
+    }
+
+    //Writes the header
+    void start(uint64_t interval, uint64_t start_cycle, uint32_t num_levels) {
+        if (csv) {
+            fprintf(out, "interval,start_cycle,instructions,phase");
+            for (uint32_t i = 1; i <= num_levels; i++)
+                fprintf(out, ",L%u_accesses,L%u_misses,L%u_working_set", i, i, i);
+            fprintf(out, "\n");
+            return;
+        }
+        unsigned char header[32] = {};
+        memcpy(header, TIMELINE_MAGIC, sizeof(TIMELINE_MAGIC));
+        put_le(header + 8, interval, 8);
+        put_le(header + 16, start_cycle, 8);
+        put_le(header + 24, num_levels, 4);
+        fwrite(header, sizeof(header), 1, out);
+    }
+
+    void write(uint64_t index, const interval_record &r) {
+        if (csv) {
+            fprintf(out, "%llu,%llu,%llu,%u", ull(index), ull(r.start_cycle), ull(r.instructions), r.phase);
+            for (size_t i = 0; i < r.accesses.size(); i++)
+                fprintf(out, ",%llu,%llu,%llu", ull(r.accesses[i]), ull(r.misses[i]), ull(r.working_set[i]));
+            fprintf(out, "\n");
+            return;
+        }
+        put_varint(r.instructions);
+        put_varint(r.phase);
+        for (size_t i = 0; i < r.accesses.size(); i++) {
+            put_varint(r.accesses[i]);
+            put_varint(r.misses[i]);
+            put_varint(r.working_set[i]);
+        }
+    }
+
+    //Returns false if anything failed to be written
+    bool close() {
+        if (out == nullptr)
+            return true;
+        bool ok = !ferror(out);
+        ok = fclose(out) == 0 && ok;
+        out = nullptr;
+        return ok;
+    }
+
+private:
+    static unsigned long long ull(uint64_t v) { return static_cast<unsigned long long>(v); }
+
+    static void put_le(unsigned char *p, uint64_t v, unsigned bytes) {
+        for (unsigned i = 0; i < bytes; i++)
+            p[i] = static_cast<unsigned char>(v >> (8 * i));
+    }
+
+    void put_varint(uint64_t v) {
+        while (v >= 0x80) {
+            fputc(static_cast<int>((v & 0x7f) | 0x80), out);
+            v >>= 7;
+        }
+        fputc(static_cast<int>(v), out);
+    }
+};
+
+//The phases a profiled run found: the number of intervals in each, and its representative
+struct timeline_result
+{
+    uint64_t intervals = 0;
+    std::vector<uint64_t> phase_intervals;
+    std::vector<uint64_t> representatives;
+    std::vector<uint64_t> representative_cycles;
+};
+
+/*
+    Runs a machine to its halt through a hierarchy, an interval at a time,
+    writing each interval to a timeline as it finishes.
+
+    @param machine The machine to run, from wherever it is
+
+    @param caches The hierarchy to simulate, configured
+
+    @param log Receives the cache events, as from CacheHierarchy::run
+
+    @param tap Also sees every lw and sw (no_hook for nothing)
+
+    @param interval Instructions per interval, more than 0
+
+    @param kind What the phase signatures count
+
+    @param out The timeline, opened
+
+    @return The phases found
+*/
+template <class Log, class Tap>
+timeline_result run_timeline(E20Machine &machine, CacheHierarchy &caches, Log &log, Tap &tap, uint64_t interval,
+    phase_signature kind, timeline_writer &out) {
+    size_t num_levels = caches.num_levels();
+    interval_profiler profiler;
+    profiler.init(caches, kind);
+    phase_tracker tracker;
+    interval_record r;
+    std::vector<uint64_t> accesses(num_levels), misses(num_levels);
+    //The start cycle of each phase's representative
+    std::vector<uint64_t> cycles;
+    out.start(interval, machine.cycles(), static_cast<uint32_t>(num_levels));
+
+    while (!machine.halted()) {
+        for (size_t i = 0; i < num_levels; i++) {
+            accesses[i] = caches.stats(i).accesses();
+            misses[i] = caches.stats(i).misses();
+        }
+        r.start_cycle = machine.cycles();
+        if constexpr (std::is_same<Tap, no_hook>::value) {
+            r.instructions = caches.run(machine, log, profiler, interval);
+        } else {
+            hook_pair<interval_profiler, Tap> both{profiler, tap};
+            r.instructions = caches.run(machine, log, both, interval);
+        }
+        if (r.instructions == 0)
+            break;
+        r.accesses.resize(num_levels);
+        r.misses.resize(num_levels);
+        for (size_t i = 0; i < num_levels; i++) {
+            r.accesses[i] = caches.stats(i).accesses() - accesses[i];
+            r.misses[i] = caches.stats(i).misses() - misses[i];
+        }
+        r.working_set = profiler.working_set;
+        uint64_t index = tracker.intervals;
+        r.phase = tracker.classify(profiler.signature);
+        out.write(index, r);
+        if (cycles.size() < tracker.num_phases())
+            cycles.push_back(r.start_cycle);
+        if (tracker.representatives[r.phase] == index)
+            cycles[r.phase] = r.start_cycle;
+        profiler.next_interval();
+    }
+
+    timeline_result result;
+    result.intervals = tracker.intervals;
+    result.phase_intervals = tracker.sizes;
+    result.representatives = tracker.representatives;
+    result.representative_cycles = cycles;
+    return result;
+}
+
+#endif
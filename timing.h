@@ -0,0 +1,148 @@
+/*
+timing.h
+Write policies of cache levels, and the latency model that turns the
+accesses of a run into cycles
+*/
+
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//How a cache level handles a store. Write-through passes every store on to the next level; write-back
+//keeps it, marking the block dirty, and writes the block to the next level only when it is evicted.
+//Without allocate, a store that misses goes on to the next level without bringing the block in.
+struct write_config
+{
+    bool back = false;
+    bool allocate = true;
+};
+
+/*
+    Parses the argument of --write.
+
+    @param spec One write policy per cache level, L1 first, separated by
+        commas: through or back, each optionally followed by :noalloc.
+        Levels past the end of the list are write-through with allocate.
+
+    @param levels Receives one write_config per item
+
+    @return false if spec can't be parsed
+*/
+inline bool parse_write_config(const std::string &spec, std::vector<write_config> &levels) {
+    size_t start = 0;
+    while (true) {
+        size_t end = spec.find(',', start);
+        std::string item = spec.substr(start, end == std::string::npos ? std::string::npos : end - start);
+        std::string name = item.substr(0, item.find(':'));
+        write_config c;
+        if (name == "back") c.back = true;
+        else if (name != "through") return false;
+        if (name.size() < item.size()) {
+            if (item.substr(name.size() + 1) != "noalloc")
+                return false;
+            c.allocate = false;
+        }
+        levels.push_back(c);
+        if (end == std::string::npos)
+            return true;
+        start = end + 1;
+    }
+}
+
+/*
+    Returns the name of a write policy as --write spells it, e.g. back:noalloc.
+*/
+inline std::string write_name(const write_config &c) {
+    return std::string(c.back ? "back" : "through") + (c.allocate ? "" : ":noalloc");
+}
+
+/*
+    Parses the argument of --latency.
+
+    @param spec The hit latency of every cache level in cycles, L1 first,
+        then the latency of memory, separated by commas
+
+    @param cycles Receives the numbers, memory last
+
+    @return false if spec can't be parsed or has fewer than two numbers
+*/
+inline bool parse_latency_config(const std::string &spec, std::vector<unsigned> &cycles) {
+    size_t start = 0;
+    while (true) {
+        size_t end = spec.find(',', start);
+        std::string n = spec.substr(start, end == std::string::npos ? std::string::npos : end - start);
+        if (n.empty() || n.size() > 6 || n.find_first_not_of("0123456789") != std::string::npos)
+            return false;
+        cycles.push_back(static_cast<unsigned>(std::stoul(n)));
+        if (end == std::string::npos)
+            return cycles.size() >= 2;
+        start = end + 1;
+    }
+}
+
+//The time the loads and stores of a run spend in the memory system, when the cache has latencies.
+//
+//An access takes the hit latency of every level it reaches, plus the memory latency if it goes past
+//the last level. A load stops at the level that hits; a store stops at the first write-back level that
+//holds or allocates its block, so write-through stores wait for every level below (there is no write
+//buffer), and a write-allocate miss waits for the block to be brought in as a load would. Writebacks of
+//dirty blocks happen off the critical path and take no time. Instruction fetches aren't timed: they are
+//part of the base CPI of 1.
+//
+//The part of an access beyond the L1 hit latency stalls the processor, so the effective CPI is
+//(instructions + stall_cycles) / instructions, and AMAT is access_cycles / accesses.
+struct cache_timing
+{
+    bool on = false;
+
+    //Hit latency per level, and of memory
+    std::vector<unsigned> hit;
+    unsigned memory = 0;
+
+    uint64_t instructions = 0;
+    uint64_t accesses = 0;
+    uint64_t access_cycles = 0;
+    uint64_t stall_cycles = 0;
+
+    /*
+        Gives the cache latencies, and zeroes the counters.
+
+        @param cycles As parse_latency_config returns them, one per level
+            and memory last; empty for none
+    */
+    void init(const std::vector<unsigned> &cycles) {
+        on = !cycles.empty();
+        hit.assign(cycles.begin(), on ? cycles.end() - 1 : cycles.end());
+        memory = on ? cycles.back() : 0;
+        instructions = accesses = access_cycles = stall_cycles = 0;
+    }
+
+    //Counts one access that took the given number of cycles
+    void record(uint64_t cycles) {
+        accesses++;
+        access_cycles += cycles;
+        stall_cycles += cycles - hit[0];
+    }
+
+    double amat() const { return accesses == 0 ? 0.0 : static_cast<double>(access_cycles) / accesses; }
+
+    double cpi() const {
+        return instructions == 0 ? 0.0 : static_cast<double>(instructions + stall_cycles) / instructions;
+    }
+
+    //Passes the counters through a checkpoint archive (see checkpoint.h). The latencies aren't saved;
+    //they come with the hierarchy's configuration.
+    template <class Archive>
+    void serialize(Archive &ar) {
+        ar.io(instructions);
+        ar.io(accesses);
+        ar.io(access_cycles);
+        ar.io(stall_cycles);
+    }
+};
+
+#endif
@@ -0,0 +1,335 @@
+/*
+trace.h
+Compact on-disk memory-trace format: capture from the interpreter and
+memory-mapped replay through the cache
+*/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sweep.h"
+
+//Trace file layout, all fixed-width fields little-endian:
+//
+//  header (24 bytes):
+//      char[8]  magic "E20TRC1\n"
+//      uint64   number of records
+//      uint64   number of payload bytes that follow the header
+//
+//  payload: one record per lw/sw, in program order. Each record is three
+//  LEB128 varints, every one a delta against the previous record (the
+//  first record is relative to cycle 0, pc 0, addr 0):
+//      (cycle delta << 1) | is_store       cycle delta is never negative
+//      zigzag(pc delta)
+//      zigzag(addr delta)
+//
+//Loops that walk memory mostly produce records of 3 or 4 bytes.
+static const char TRACE_MAGIC[8] = {'E', '2', '0', 'T', 'R', 'C', '1', '\n'};
+static const size_t TRACE_HEADER_BYTES = 24;
+
+struct trace_header
+{
+    char magic[8];
+    uint64_t num_records;
+    uint64_t payload_bytes;
+};
+
+//A header as its TRACE_HEADER_BYTES bytes in the file, and back
+inline void encode_trace_header(const trace_header &header, unsigned char bytes[TRACE_HEADER_BYTES]) {
+    memcpy(bytes, header.magic, 8);
+    for (unsigned i = 0; i < 8; i++) {
+        bytes[8 + i] = static_cast<unsigned char>(header.num_records >> (8 * i));
+        bytes[16 + i] = static_cast<unsigned char>(header.payload_bytes >> (8 * i));
+    }
+}
+
+inline void decode_trace_header(const unsigned char bytes[TRACE_HEADER_BYTES], trace_header &header) {
+    memcpy(header.magic, bytes, 8);
+    header.num_records = 0;
+    header.payload_bytes = 0;
+    for (unsigned i = 0; i < 8; i++) {
+        header.num_records |= static_cast<uint64_t>(bytes[8 + i]) << (8 * i);
+        header.payload_bytes |= static_cast<uint64_t>(bytes[16 + i]) << (8 * i);
+    }
+}
+
+inline uint64_t zigzag(int64_t v) {
+    return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+
+inline int64_t unzigzag(uint64_t v) {
+    return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+}
+
+//An interpreter hook that writes every memory access to a trace file
+struct trace_writer
+{
+    FILE *out = nullptr;
+    std::vector<unsigned char> buf;
+    trace_header header;
+    uint64_t last_cycle = 0;
+    uint32_t last_pc = 0;
+    uint32_t last_addr = 0;
+
+    trace_writer() : buf(1 << 20) {
+        memcpy(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+        header.num_records = 0;
+        header.payload_bytes = 0;
+    }
+
+    ~trace_writer() { close(); }
+
+    trace_writer(const trace_writer &) = delete;
+    trace_writer &operator=(const trace_writer &) = delete;
+
+    /*
+        Creates the trace file and writes a placeholder header, which
+        close() fills in.
+
+        @param path The file to create
+
+        @return false if the file can't be created
+    */
+    bool open(const char *path) {
+        out = fopen(path, "wb");
+        if (out == nullptr)
+            return false;
+        write_header();
+        return true;
+    }
+
+    /*
+        Creates a trace file of its own in $TMPDIR (or /tmp), as open does.
+        The caller removes it once done with it.
+
+        @param path Receives the path of the file
+
+        @return false if the file can't be created
+    */
+    bool open_temp(std::string &path) {
+        const char *dir = getenv("TMPDIR");
+        path = std::string(dir != nullptr && *dir != '\0' ? dir : "/tmp") + "/e20trace.XXXXXX";
+        int fd = mkstemp(&path[0]);
+        if (fd < 0)
+            return false;
+        out = fdopen(fd, "wb");
+        if (out == nullptr) {
+            ::close(fd);
+            unlink(path.c_str());
+            return false;
+        }
+        write_header();
+        return true;
+    }
+
+    void load(unsigned pc, unsigned addr, uint64_t clock_cycle) { record(pc, addr, clock_cycle, false); }
+
+    void store(unsigned pc, unsigned addr, uint64_t clock_cycle) { record(pc, addr, clock_cycle, true); }
+
+    //Flushes the remaining records and rewrites the header with the final counts
+    void close() {
+        if (out == nullptr)
+            return;
+        flush();
+        fseek(out, 0, SEEK_SET);
+        write_header();
+        fclose(out);
+        out = nullptr;
+    }
+
+private:
+    size_t used = 0;
+
+    void write_header() {
+        unsigned char bytes[TRACE_HEADER_BYTES];
+        encode_trace_header(header, bytes);
+        fwrite(bytes, sizeof(bytes), 1, out);
+    }
+
+    void flush() {
+        fwrite(buf.data(), 1, used, out);
+        header.payload_bytes += used;
+        used = 0;
+    }
+
+    void put_varint(uint64_t v) {
+        while (v >= 0x80) {
+            buf[used++] = static_cast<unsigned char>(v | 0x80);
+            v >>= 7;
+        }
+        buf[used++] = static_cast<unsigned char>(v);
+    }
+
+    void record(uint32_t pc, uint32_t addr, uint64_t clock_cycle, bool is_store) {
+        //Three varints of at most 10 bytes each
+        if (used + 30 > buf.size())
+            flush();
+        put_varint(((clock_cycle - last_cycle) << 1) | is_store);
+        put_varint(zigzag(static_cast<int64_t>(pc) - last_pc));
+        put_varint(zigzag(static_cast<int64_t>(addr) - last_addr));
+        last_cycle = clock_cycle;
+        last_pc = pc;
+        last_addr = addr;
+        header.num_records++;
+    }
+};
+
+//A trace file mapped into memory for replay
+struct trace_file
+{
+    const unsigned char *map = nullptr;
+    size_t map_size = 0;
+    trace_header header;
+
+    trace_file() = default;
+    ~trace_file() {
+        if (map != nullptr)
+            munmap(const_cast<unsigned char *>(map), map_size);
+    }
+
+    trace_file(const trace_file &) = delete;
+    trace_file &operator=(const trace_file &) = delete;
+
+    /*
+        Maps a trace file and checks its header.
+
+        @param path The trace file
+
+        @param error Receives a message if the file can't be used
+
+        @return false if the file can't be opened or isn't a valid trace
+    */
+    bool open(const char *path, std::string &error) {
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0) {
+            error = std::string("Can't open file ") + path;
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < TRACE_HEADER_BYTES) {
+            ::close(fd);
+            error = std::string("Not a trace file: ") + path;
+            return false;
+        }
+        map_size = st.st_size;
+        void *p = mmap(nullptr, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) {
+            map_size = 0;
+            error = std::string("Can't map file ") + path;
+            return false;
+        }
+        map = static_cast<const unsigned char *>(p);
+        madvise(p, map_size, MADV_SEQUENTIAL);
+        decode_trace_header(map, header);
+        if (memcmp(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0 ||
+            header.payload_bytes != map_size - TRACE_HEADER_BYTES) {
+            error = std::string("Not a trace file: ") + path;
+            return false;
+        }
+        return true;
+    }
+
+    /*
+        Decodes the trace, calling fn(const mem_access &) for every record
+        in order.
+
+        @return false if the payload is truncated or holds fewer records
+            than the header says
+    */
+    template <class Fn>
+    bool for_each(Fn fn) const {
+        const unsigned char *p = map + TRACE_HEADER_BYTES;
+        const unsigned char *end = map + map_size;
+        mem_access a = {0, 0, 0, false};
+        uint64_t v;
+        for (uint64_t n = 0; n < header.num_records; n++) {
+            if (!get_varint(p, end, v))
+                return false;
+            a.clock_cycle += v >> 1;
+            a.is_store = v & 1;
+            if (!get_varint(p, end, v))
+                return false;
+            a.pc = static_cast<uint16_t>(a.pc + unzigzag(v));
+            if (!get_varint(p, end, v))
+                return false;
+            a.addr = static_cast<uint32_t>(a.addr + unzigzag(v));
+            fn(a);
+        }
+        return true;
+    }
+
+private:
+    static bool get_varint(const unsigned char *&p, const unsigned char *end, uint64_t &v) {
+        v = 0;
+        for (unsigned shift = 0; p < end && shift < 64; shift += 7) {
+            unsigned char b = *p++;
+            v |= static_cast<uint64_t>(b & 0x7f) << shift;
+            if ((b & 0x80) == 0)
+                return true;
+        }
+        return false;
+    }
+};
+
+/*
+    Replays a trace against every configuration, with the given replacement
+    policy. See the run_sweep in sweep.h.
+
+    @return false if the trace is truncated, in which case nothing is written
+*/
+inline bool run_sweep(const trace_file &trace, const std::vector<std::string> &configs, FILE *out,
+    replacement_policy policy = POLICY_LRU, stats_writer *stats = nullptr, unsigned num_threads = 0,
+    bool classify = false, bool corrected = false) {
+    return with_policy(policy, [&](auto tag) {
+        return run_sweep<decltype(tag)>(configs, out, [&](auto &My_cache, count_log &counts) {
+            return trace.for_each([&](const mem_access &a) {
+                if (a.is_store)
+                    cache_store(My_cache, a.pc, a.addr, counts);
+                else
+                    cache_load(My_cache, a.pc, a.addr, counts);
+            });
+        }, stats, num_threads, classify, corrected);
+    });
+}
+
+//Runs two interpreter hooks side by side, e.g. a cache and a trace_writer
+template <class A, class B>
+struct hook_pair
+{
+    A &first;
+    B &second;
+
+    void load(unsigned pc, unsigned addr, uint64_t clock_cycle) {
+        first.load(pc, addr, clock_cycle);
+        second.load(pc, addr, clock_cycle);
+    }
+
+    void store(unsigned pc, unsigned addr, uint64_t clock_cycle) {
+        first.store(pc, addr, clock_cycle);
+        second.store(pc, addr, clock_cycle);
+    }
+
+    //Instruction fetches (see hook_fetches in e20.h) go to the first hook, if it takes them; the
+    //second is a trace, and traces only hold lw and sw
+    template <class H = A>
+    auto fetch(unsigned pc, uint64_t clock_cycle) -> decltype(std::declval<H &>().fetch(pc, clock_cycle)) {
+        return first.fetch(pc, clock_cycle);
+    }
+};
+
+#endif